@@ -0,0 +1,81 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/src/app/CMakeLists.txt"
+  "/root/repo/src/core/CMakeLists.txt"
+  "/root/repo/src/core/dependencies/glfw-3.4/CMake/cmake_uninstall.cmake.in"
+  "/root/repo/src/core/dependencies/glfw-3.4/CMake/glfw3.pc.in"
+  "/root/repo/src/core/dependencies/glfw-3.4/CMake/glfw3Config.cmake.in"
+  "/root/repo/src/core/dependencies/glfw-3.4/CMakeLists.txt"
+  "/root/repo/src/core/dependencies/glfw-3.4/docs/CMakeLists.txt"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/BasicConfigVersion-SameMajorVersion.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDependentOption.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakePackageConfigHelpers.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFile.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindDoxygen.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/GNUInstallDirs.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  "/usr/share/cmake-3.25/Modules/WriteBasicConfigVersionFile.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "src/core/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "src/core/dependencies/glfw-3.4/src/glfw3Config.cmake"
+  "src/core/dependencies/glfw-3.4/src/glfw3ConfigVersion.cmake"
+  "src/core/dependencies/glfw-3.4/cmake_uninstall.cmake"
+  "src/core/dependencies/glfw-3.4/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "src/core/dependencies/glfw-3.4/src/glfw3.pc"
+  "src/core/dependencies/glfw-3.4/src/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "src/core/dependencies/glfw-3.4/docs/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "src/app/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "src/core/CMakeFiles/CoreEngine.dir/DependInfo.cmake"
+  "src/core/dependencies/glfw-3.4/CMakeFiles/uninstall.dir/DependInfo.cmake"
+  "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/DependInfo.cmake"
+  "src/core/dependencies/glfw-3.4/src/CMakeFiles/update_mappings.dir/DependInfo.cmake"
+  "src/app/CMakeFiles/PhysicsEngine.dir/DependInfo.cmake"
+  )
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "/root/repo/PhysicsEngine"
+  "/root/repo/PhysicsEngine.pdb"
+  "CMakeFiles/PhysicsEngine.dir/Main.cpp.o"
+  "CMakeFiles/PhysicsEngine.dir/Main.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/PhysicsEngine.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,38 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/core/src/glad.c" "src/core/CMakeFiles/CoreEngine.dir/src/glad.c.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/glad.c.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_demo.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_demo.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_demo.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_draw.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_draw.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_draw.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_impl_glfw.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_glfw.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_glfw.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_impl_opengl3.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_opengl3.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_opengl3.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_tables.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_tables.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_tables.cpp.o.d"
+  "/root/repo/src/core/dependencies/imgui/imgui_widgets.cpp" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_widgets.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_widgets.cpp.o.d"
+  "/root/repo/src/core/src/physics/BodyStore.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/BodyStore.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/BodyStore.cpp.o.d"
+  "/root/repo/src/core/src/physics/ChunkedMesh.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/ChunkedMesh.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/ChunkedMesh.cpp.o.d"
+  "/root/repo/src/core/src/physics/ContactSolver.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/ContactSolver.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/ContactSolver.cpp.o.d"
+  "/root/repo/src/core/src/physics/DynamicTree.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/DynamicTree.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/DynamicTree.cpp.o.d"
+  "/root/repo/src/core/src/physics/InstanceTree.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/InstanceTree.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/InstanceTree.cpp.o.d"
+  "/root/repo/src/core/src/physics/Narrowphase.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/Narrowphase.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/Narrowphase.cpp.o.d"
+  "/root/repo/src/core/src/physics/PhysicsSystem.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/PhysicsSystem.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/PhysicsSystem.cpp.o.d"
+  "/root/repo/src/core/src/physics/SignedDistanceField.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/SignedDistanceField.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/SignedDistanceField.cpp.o.d"
+  "/root/repo/src/core/src/physics/StaticTree.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/physics/StaticTree.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/physics/StaticTree.cpp.o.d"
+  "/root/repo/src/core/src/renderer/RenderSystem.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/renderer/RenderSystem.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/renderer/RenderSystem.cpp.o.d"
+  "/root/repo/src/core/src/stb.cpp" "src/core/CMakeFiles/CoreEngine.dir/src/stb.cpp.o" "gcc" "src/core/CMakeFiles/CoreEngine.dir/src/stb.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_asan/src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,47 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_demo.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_demo.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_draw.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_draw.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_glfw.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_glfw.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_opengl3.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_impl_opengl3.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_tables.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_tables.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_widgets.cpp.o"
+  "CMakeFiles/CoreEngine.dir/dependencies/imgui/imgui_widgets.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/glad.c.o"
+  "CMakeFiles/CoreEngine.dir/src/glad.c.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/BodyStore.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/BodyStore.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/ChunkedMesh.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/ChunkedMesh.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/ContactSolver.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/ContactSolver.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/DynamicTree.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/DynamicTree.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/InstanceTree.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/InstanceTree.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/Narrowphase.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/Narrowphase.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/PhysicsSystem.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/PhysicsSystem.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/SignedDistanceField.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/SignedDistanceField.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/physics/StaticTree.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/physics/StaticTree.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/renderer/RenderSystem.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/renderer/RenderSystem.cpp.o.d"
+  "CMakeFiles/CoreEngine.dir/src/stb.cpp.o"
+  "CMakeFiles/CoreEngine.dir/src/stb.cpp.o.d"
+  "libCoreEngine.a"
+  "libCoreEngine.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C CXX)
+  include(CMakeFiles/CoreEngine.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,34 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/core/dependencies/glfw-3.4/src/context.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/context.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/context.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/egl_context.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/egl_context.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/egl_context.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/init.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/init.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/init.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/input.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/input.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/input.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/monitor.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/monitor.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/monitor.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/null_init.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_init.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_init.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/null_joystick.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_joystick.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_joystick.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/null_monitor.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_monitor.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_monitor.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/null_window.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_window.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/null_window.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/osmesa_context.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/osmesa_context.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/osmesa_context.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/platform.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/platform.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/platform.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/posix_module.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_module.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_module.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/posix_thread.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_thread.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_thread.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/posix_time.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_time.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/posix_time.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/vulkan.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/vulkan.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/vulkan.c.o.d"
+  "/root/repo/src/core/dependencies/glfw-3.4/src/window.c" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/window.c.o" "gcc" "src/core/dependencies/glfw-3.4/src/CMakeFiles/glfw.dir/window.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,41 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/glfw.dir/context.c.o"
+  "CMakeFiles/glfw.dir/context.c.o.d"
+  "CMakeFiles/glfw.dir/egl_context.c.o"
+  "CMakeFiles/glfw.dir/egl_context.c.o.d"
+  "CMakeFiles/glfw.dir/init.c.o"
+  "CMakeFiles/glfw.dir/init.c.o.d"
+  "CMakeFiles/glfw.dir/input.c.o"
+  "CMakeFiles/glfw.dir/input.c.o.d"
+  "CMakeFiles/glfw.dir/monitor.c.o"
+  "CMakeFiles/glfw.dir/monitor.c.o.d"
+  "CMakeFiles/glfw.dir/null_init.c.o"
+  "CMakeFiles/glfw.dir/null_init.c.o.d"
+  "CMakeFiles/glfw.dir/null_joystick.c.o"
+  "CMakeFiles/glfw.dir/null_joystick.c.o.d"
+  "CMakeFiles/glfw.dir/null_monitor.c.o"
+  "CMakeFiles/glfw.dir/null_monitor.c.o.d"
+  "CMakeFiles/glfw.dir/null_window.c.o"
+  "CMakeFiles/glfw.dir/null_window.c.o.d"
+  "CMakeFiles/glfw.dir/osmesa_context.c.o"
+  "CMakeFiles/glfw.dir/osmesa_context.c.o.d"
+  "CMakeFiles/glfw.dir/platform.c.o"
+  "CMakeFiles/glfw.dir/platform.c.o.d"
+  "CMakeFiles/glfw.dir/posix_module.c.o"
+  "CMakeFiles/glfw.dir/posix_module.c.o.d"
+  "CMakeFiles/glfw.dir/posix_thread.c.o"
+  "CMakeFiles/glfw.dir/posix_thread.c.o.d"
+  "CMakeFiles/glfw.dir/posix_time.c.o"
+  "CMakeFiles/glfw.dir/posix_time.c.o.d"
+  "CMakeFiles/glfw.dir/vulkan.c.o"
+  "CMakeFiles/glfw.dir/vulkan.c.o.d"
+  "CMakeFiles/glfw.dir/window.c.o"
+  "CMakeFiles/glfw.dir/window.c.o.d"
+  "libglfw3.a"
+  "libglfw3.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/glfw.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
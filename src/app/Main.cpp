@@ -108,6 +108,7 @@ int main()
 	floor.ShaderID = defaultShader.ID;
 	floor.Scale(10.0f);
 	floor.AddToECS();
+	physicsSystem->AddToTree(floor, Physics::BodyType::STATIC);
 
 
 
@@ -121,14 +122,19 @@ int main()
 	// Number of cubes to generate
 	int numCubes = 100;
 
+	// Cube bounding boxes, built into the tree all at once
+	std::vector<std::pair<Entity, BoundingBox>> cubeProxies;
+	cubeProxies.reserve(numCubes);
+
 	for (int i = 0; i < numCubes; ++i) {
 		Mesh cube(cubeData);
 		cube.SetPosition(glm::vec3(dis(gen), abs(dis(gen)), dis(gen))); // random position
 		cube.Scale(0.1f);
 		cube.ShaderID = flatShader.ID;
 		cube.AddToECS();
-		physicsSystem->AddToTree(cube);
+		cubeProxies.emplace_back(cube.mEntityID, cube.CalcBoundingBox());
 	}
+	physicsSystem->BuildTree(cubeProxies, Physics::BodyType::DYNAMIC);
 
 	const ModelData sphereData = Utils::UVSphereData(20,20, 1);
 	Model light(sphereData);
@@ -204,8 +210,8 @@ int main()
 
 	// bunny.transform.CalculateModelMat();
 	// bunny.InitTree();
-	// rootRenderer.PushBoundingBoxes(bunny.mTree.GetBoxes(bunny.transform.modelMat, true));
-	// parentRenderer.PushBoundingBoxes(bunny.mTree.GetBoxes(bunny.transform.modelMat, false));
+	// rootRenderer.PushBoundingBoxes(bunny.mTree->GetBoxes(bunny.transform.modelMat, true));
+	// parentRenderer.PushBoundingBoxes(bunny.mTree->GetBoxes(bunny.transform.modelMat, false));
 
 
 	// boundsBox.Clear();
@@ -252,7 +258,8 @@ int main()
 		// TODO: Create better position update system than reinserting into tree
 		// tree.UpdateEntity(light.mEntityID, light.CalcBoundingBox());
 
-		// physicsSystem->Update(dt_mill);
+		// Physics steps in seconds
+		// physicsSystem->Update(dt_mill / 1000.0f);
 
 		boxRenderer.Clear();
 		if (GUI.config.showDynamicBoxes)
@@ -261,7 +268,7 @@ int main()
 		}
 		//
 		// collideBox.Clear();
-		// const auto collidedEntities = tree.ComputeCollisionPairs();
+		// const auto collidedEntities = physicsSystem->ComputeCollisionPairs();
 		// for (const auto entity : collidedEntities)
 		// {
 		// 	collideBox.PushBoundingBox(tree.GetBoundingBox(entity));
@@ -278,8 +285,8 @@ int main()
 		// 	LOG(LOG_WARNING) << "Regenerating static tree.\n";
 		// 	dragon.InitTree();
 		//
-		// 	auto rootBoxes = dragon.mTree.GetBoxes(dragon.transform.modelMat, true);
-		// 	auto parentBoxes = dragon.mTree.GetBoxes(dragon.transform.modelMat, false);
+		// 	auto rootBoxes = dragon.mTree->GetBoxes(dragon.transform.modelMat, true);
+		// 	auto parentBoxes = dragon.mTree->GetBoxes(dragon.transform.modelMat, false);
 		//
 		// 	std::cout << "Root boxes: " << parentBoxes.size() << std::endl;
 		//
@@ -332,6 +339,11 @@ int main()
 			{
 				LOG(LOG_INFO) << "Hit entity\n";
 				hitBox.PushBoundingBox(tree.GetBoundingBox(entityHit));
+
+				// Meshes with a static tree can refine the hit to the exact triangle
+				// const auto [triangleHit, hitTriangle] = dragon.Raycast(r);
+				// if (hitTriangle)
+				// 	LOG(LOG_INFO) << "Hit triangle " << triangleHit.triangle << " at " << glm::to_string(r.GetPoint(triangleHit.t)) << "\n";
 			} else
 			{
 				LOG(LOG_INFO) << "No hit\n";
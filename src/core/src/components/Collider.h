@@ -6,5 +6,7 @@ namespace Components
 	struct Collider
 	{
 		glm::mat3 m_inertiaTensor;
+		// Coefficient of friction, combined with the other collider's where they touch
+		float friction = 0.5f;
 	};
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Collider.h"
 namespace Components
 {
+	// Bodies the physics system is stepping are written back only when they fall asleep or stop being dynamic
 	struct Rigidbody 
 	{
 	    float inverseMass = 1.0f/100.0f;
@@ -12,6 +13,8 @@ namespace Components
 
 		// TODO: Use transform position
 		glm::vec3 position;
+		// Position before the last physics step, rendering interpolates from it
+		glm::vec3 previousPosition;
 
 	    glm::vec3 linearVelocity;
 		glm::vec3 angularVelocity;
@@ -21,7 +24,7 @@ namespace Components
 
 		Collider* m_collider;
 
-	    bool sleeping;
+	    bool sleeping = false;
 
 		void SetMass(float mass)
 		{
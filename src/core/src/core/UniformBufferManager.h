@@ -1,7 +1,7 @@
 #pragma once
 #include "GlobalTypes.h"
 #include "../renderer/Camera.h"
-#include "../utils/Logger.h"
+#include "../utils/GLError.h"
 
 namespace Core {
     // Global Uniforms
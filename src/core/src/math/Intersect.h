@@ -0,0 +1,487 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <initializer_list>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+#include "math/Ray.h"
+#include "physics/BoundingBox.h"
+
+// Intersection and distance tests between primitives, triangles and bounding boxes
+// Moving primitives are parameterized as origin + t * displacement, where t is in [0, tMax]
+namespace Utils
+{
+	// Returns the entry time of a moving point into the box, or false if it doesn't enter before tMax
+	// Returns 0 if the point starts inside the box
+	inline std::pair<float, bool> SegmentBox(const glm::vec3& origin, const glm::vec3& displacement, const BoundingBox& box, const float tMax)
+	{
+		float tEnter = 0.0f;
+		float tExit = tMax;
+
+		for (unsigned int d = 0; d < 3; d++)
+		{
+			if (displacement[d] == 0.0f)
+			{
+				// Moving parallel to the slab, so the origin has to be inside of it
+				if (origin[d] < box.min[d] || origin[d] > box.max[d])
+					return std::make_pair(FLT_MAX, false);
+				continue;
+			}
+
+			const float invD = 1.0f / displacement[d];
+			float t1 = (box.min[d] - origin[d]) * invD;
+			float t2 = (box.max[d] - origin[d]) * invD;
+			if (t1 > t2) std::swap(t1, t2);
+
+			tEnter = std::max(tEnter, t1);
+			tExit = std::min(tExit, t2);
+			if (tEnter > tExit)
+				return std::make_pair(FLT_MAX, false);
+		}
+		return std::make_pair(tEnter, true);
+	}
+
+	// Returns the entry time of a ray into the box, or false if it misses or enters after tMax
+	// Unlike Ray::IsColliding, boxes behind the origin are rejected and a ray starting inside returns 0
+	inline std::pair<float, bool> RayBox(const Ray& ray, const BoundingBox& box, const float tMax)
+	{
+		const glm::vec3 t1 = (box.min - ray.origin) * ray.invdir;
+		const glm::vec3 t2 = (box.max - ray.origin) * ray.invdir;
+		const glm::vec3 tNear = glm::min(t1, t2);
+		const glm::vec3 tFar = glm::max(t1, t2);
+
+		const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		if (tEnter > tExit) return std::make_pair(FLT_MAX, false);
+		return std::make_pair(tEnter, true);
+	}
+
+	// Moller-Trumbore ray triangle intersection
+	// On a hit, t is the ray distance and barycentrics are the weights of v1 and v2
+	inline bool RayTriangle(const Ray& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const float tMax,
+	                        float& t, glm::vec2& barycentrics)
+	{
+		constexpr float EPSILON = 1e-8f;
+
+		const glm::vec3 edge1 = v1 - v0;
+		const glm::vec3 edge2 = v2 - v0;
+		const glm::vec3 p = glm::cross(ray.direction, edge2);
+		const float determinant = glm::dot(edge1, p);
+
+		// Ray is parallel to the triangle
+		if (std::abs(determinant) < EPSILON) return false;
+		const float invDeterminant = 1.0f / determinant;
+
+		const glm::vec3 s = ray.origin - v0;
+		const float u = glm::dot(s, p) * invDeterminant;
+		if (u < 0.0f || u > 1.0f) return false;
+
+		const glm::vec3 q = glm::cross(s, edge1);
+		const float v = glm::dot(ray.direction, q) * invDeterminant;
+		if (v < 0.0f || u + v > 1.0f) return false;
+
+		const float hitT = glm::dot(edge2, q) * invDeterminant;
+		if (hitT < 0.0f || hitT > tMax) return false;
+
+		t = hitT;
+		barycentrics = glm::vec2(u, v);
+		return true;
+	}
+
+	// Returns the first time a moving point comes within radius of center
+	inline std::pair<float, bool> SegmentSphere(const glm::vec3& origin, const glm::vec3& displacement, const glm::vec3& center, const float radius, const float tMax)
+	{
+		const glm::vec3 m = origin - center;
+		const float c = glm::dot(m, m) - radius * radius;
+
+		// Starts inside the sphere
+		if (c <= 0.0f) return std::make_pair(0.0f, true);
+
+		const float b = glm::dot(m, displacement);
+		// Moving away from the sphere
+		if (b > 0.0f) return std::make_pair(FLT_MAX, false);
+
+		const float a = glm::dot(displacement, displacement);
+		const float discriminant = b * b - a * c;
+		if (discriminant < 0.0f) return std::make_pair(FLT_MAX, false);
+
+		const float t = (-b - std::sqrt(discriminant)) / a;
+		if (t > tMax) return std::make_pair(FLT_MAX, false);
+		return std::make_pair(std::max(t, 0.0f), true);
+	}
+
+	// Returns the first time a moving point comes within radius of the box edge running along axis
+	// The edge starts at corner and spans the box along that axis
+	inline std::pair<float, bool> SegmentEdgeCapsule(const glm::vec3& origin, const glm::vec3& displacement, const BoundingBox& box,
+	                                                 const glm::vec3& corner, const unsigned int axis, const float radius, float tMax)
+	{
+		const unsigned int i = (axis + 1) % 3;
+		const unsigned int j = (axis + 2) % 3;
+
+		bool hit = false;
+		float best = tMax;
+
+		// Infinite cylinder around the edge, only accepted inside the edge's extent
+		const glm::vec2 m(origin[i] - corner[i], origin[j] - corner[j]);
+		const glm::vec2 d(displacement[i], displacement[j]);
+		const float a = glm::dot(d, d);
+		const float c = glm::dot(m, m) - radius * radius;
+		float tCylinder = FLT_MAX;
+		if (c <= 0.0f) tCylinder = 0.0f;
+		else if (a > 0.0f)
+		{
+			const float b = glm::dot(m, d);
+			const float discriminant = b * b - a * c;
+			if (b <= 0.0f && discriminant >= 0.0f)
+				tCylinder = (-b - std::sqrt(discriminant)) / a;
+		}
+		if (tCylinder <= best)
+		{
+			const float along = origin[axis] + displacement[axis] * tCylinder;
+			if (along >= box.min[axis] && along <= box.max[axis])
+			{
+				best = tCylinder;
+				hit = true;
+			}
+		}
+
+		// Spheres at both ends of the edge
+		glm::vec3 end = corner;
+		for (const float bound : { box.min[axis], box.max[axis] })
+		{
+			end[axis] = bound;
+			const auto [t, colliding] = SegmentSphere(origin, displacement, end, radius, best);
+			if (colliding && t <= best)
+			{
+				best = t;
+				hit = true;
+			}
+		}
+
+		return hit ? std::make_pair(best, true) : std::make_pair(FLT_MAX, false);
+	}
+
+	// Returns the first time a moving sphere touches the box
+	// Adapted from Real-Time Collision Detection (Ericson), 5.5.7
+	inline std::pair<float, bool> SweptSphereBox(const glm::vec3& center, const float radius, const glm::vec3& displacement, const BoundingBox& box, const float tMax)
+	{
+		// Intersect with the box expanded by the radius, which contains the rounded box
+		const BoundingBox expanded(box.min - glm::vec3(radius), box.max + glm::vec3(radius));
+		const auto [t, colliding] = SegmentBox(center, displacement, expanded, tMax);
+		if (!colliding) return std::make_pair(FLT_MAX, false);
+
+		// Classify entry point by which of the original box's slabs it lies outside of
+		const glm::vec3 p = center + displacement * t;
+		unsigned int outsideCount = 0;
+		unsigned int insideAxis = 0;
+		glm::vec3 corner;
+		for (unsigned int d = 0; d < 3; d++)
+		{
+			if (p[d] < box.min[d]) { corner[d] = box.min[d]; outsideCount++; }
+			else if (p[d] > box.max[d]) { corner[d] = box.max[d]; outsideCount++; }
+			else { corner[d] = box.min[d]; insideAxis = d; }
+		}
+
+		// Face region, the expanded box is exact here
+		if (outsideCount <= 1) return std::make_pair(t, true);
+
+		// Edge region, sphere can only hit the rounded edge
+		if (outsideCount == 2)
+			return SegmentEdgeCapsule(center, displacement, box, corner, insideAxis, radius, tMax);
+
+		// Vertex region, sphere can hit any of the three edges meeting at the corner
+		bool hit = false;
+		float best = tMax;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			const auto [tEdge, edgeHit] = SegmentEdgeCapsule(center, displacement, box, corner, axis, radius, best);
+			if (edgeHit && tEdge <= best)
+			{
+				best = tEdge;
+				hit = true;
+			}
+		}
+		return hit ? std::make_pair(best, true) : std::make_pair(FLT_MAX, false);
+	}
+
+	// Returns the point on the triangle closest to point
+	// Adapted from Real-Time Collision Detection (Ericson), 5.1.5
+	inline glm::vec3 ClosestPointTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		const glm::vec3 ab = b - a;
+		const glm::vec3 ac = c - a;
+
+		// Vertex region outside a
+		const glm::vec3 ap = point - a;
+		const float d1 = glm::dot(ab, ap);
+		const float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+		// Vertex region outside b
+		const glm::vec3 bp = point - b;
+		const float d3 = glm::dot(ab, bp);
+		const float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return b;
+
+		// Edge region of ab
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return a + ab * (d1 / (d1 - d3));
+
+		// Vertex region outside c
+		const glm::vec3 cp = point - c;
+		const float d5 = glm::dot(ab, cp);
+		const float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return c;
+
+		// Edge region of ac
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return a + ac * (d2 / (d2 - d6));
+
+		// Edge region of bc
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		// Inside the face
+		const float denominator = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	// Returns false if the box is entirely outside one of the frustum planes of a projection times view matrix
+	// Planes are extracted as in Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+	// Conservative, boxes near a frustum corner can pass without being visible
+	inline bool FrustumBox(const glm::mat4& viewProjection, const BoundingBox& box)
+	{
+		const glm::vec4 rows[4] = {
+			glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]),
+			glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]),
+			glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]),
+			glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]),
+		};
+		for (unsigned int i = 0; i < 6; i++)
+		{
+			const glm::vec4 plane = i % 2 == 0 ? rows[3] + rows[i / 2] : rows[3] - rows[i / 2];
+			// Corner farthest along the plane normal
+			const glm::vec3 corner = glm::mix(box.min, box.max, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+		}
+		return true;
+	}
+
+	// Box transformed by an affine matrix, stored as a center and the three transformed half extent vectors
+	struct OrientedBox
+	{
+		glm::vec3 center;
+		glm::vec3 halfAxes[3];
+	};
+
+	// Separating axes for testing axis aligned boxes against boxes transformed by one linear transform
+	// Axes only depend on the transform, so they're computed once and reused for every box pair
+	struct SeparatingAxes
+	{
+		glm::vec3 axes[15];
+		// Axes aren't normalized, distances along them are scaled by their lengths
+		float lengths[15];
+
+		explicit SeparatingAxes(const glm::mat3& linear)
+		{
+			// Face normals of the axis aligned box
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				axes[i] = glm::vec3(0.0f);
+				axes[i][i] = 1.0f;
+			}
+			// Face normals of the transformed box
+			for (unsigned int i = 0; i < 3; i++)
+				axes[3 + i] = glm::cross(linear[(i + 1) % 3], linear[(i + 2) % 3]);
+			// Edge pairs
+			for (unsigned int i = 0; i < 3; i++)
+				for (unsigned int j = 0; j < 3; j++)
+					axes[6 + i * 3 + j] = glm::cross(axes[i], linear[j]);
+
+			for (unsigned int i = 0; i < 15; i++)
+				lengths[i] = glm::length(axes[i]);
+		}
+	};
+
+	// Returns the box transformed by an affine matrix
+	inline OrientedBox TransformBox(const BoundingBox& box, const glm::mat4& mat)
+	{
+		const glm::vec3 halfExtents = (box.max - box.min) * 0.5f;
+		OrientedBox output;
+		output.center = glm::vec3(mat * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+		for (unsigned int i = 0; i < 3; i++)
+			output.halfAxes[i] = glm::vec3(mat[i]) * halfExtents[i];
+		return output;
+	}
+
+	// Separating axis test between an axis aligned box and a transformed box
+	// Works for any affine transform, including non-uniform scale, since only projections are compared
+	inline bool BoxOrientedBox(const BoundingBox& box, const OrientedBox& other, const SeparatingAxes& separatingAxes)
+	{
+		// Boxes closer than this fraction of their size overlap, so nearly touching triangles inside them aren't culled
+		constexpr float BOX_EPSILON = 1e-5f;
+
+		const glm::vec3 center = (box.min + box.max) * 0.5f;
+		const glm::vec3 halfExtents = (box.max - box.min) * 0.5f;
+		const glm::vec3 offset = other.center - center;
+		const float tolerance = BOX_EPSILON * (glm::length(halfExtents) + glm::length(other.halfAxes[0]) +
+		                                       glm::length(other.halfAxes[1]) + glm::length(other.halfAxes[2]));
+
+		for (unsigned int i = 0; i < 15; i++)
+		{
+			const glm::vec3& axis = separatingAxes.axes[i];
+			const float radius = glm::dot(halfExtents, glm::abs(axis));
+			const float otherRadius = std::abs(glm::dot(other.halfAxes[0], axis)) +
+			                          std::abs(glm::dot(other.halfAxes[1], axis)) +
+			                          std::abs(glm::dot(other.halfAxes[2], axis));
+			if (std::abs(glm::dot(offset, axis)) > radius + otherRadius + tolerance * separatingAxes.lengths[i])
+				return false;
+		}
+		return true;
+	}
+
+	namespace Detail
+	{
+		// Distances smaller than this fraction of a triangle's size are treated as touching its plane
+		constexpr float TRI_EPSILON = 1e-6f;
+
+		// Plane distances are scaled by the length of the unnormalized normal, which is twice the triangle's area
+		inline float PlaneTolerance(const glm::vec3& normal)
+		{
+			const float normalLength = glm::length(normal);
+			return TRI_EPSILON * normalLength * std::sqrt(normalLength);
+		}
+
+		// Projected interval where a triangle crosses the other triangle's plane
+		// Vertex 0 is on the opposite side of the plane from vertices 1 and 2
+		inline glm::vec2 CrossingInterval(const float p0, const float p1, const float p2, const float d0, const float d1, const float d2)
+		{
+			glm::vec2 interval(p0 + (p1 - p0) * d0 / (d0 - d1), p0 + (p2 - p0) * d0 / (d0 - d2));
+			if (interval.x > interval.y) std::swap(interval.x, interval.y);
+			return interval;
+		}
+
+		// Returns false if the triangle lies in the plane
+		inline bool ComputeInterval(const glm::vec3& p, const glm::vec3& d, glm::vec2& interval)
+		{
+			if (d[0] * d[1] > 0.0f) interval = CrossingInterval(p[2], p[0], p[1], d[2], d[0], d[1]);
+			else if (d[0] * d[2] > 0.0f) interval = CrossingInterval(p[1], p[0], p[2], d[1], d[0], d[2]);
+			else if (d[1] * d[2] > 0.0f || d[0] != 0.0f) interval = CrossingInterval(p[0], p[1], p[2], d[0], d[1], d[2]);
+			else if (d[1] != 0.0f) interval = CrossingInterval(p[1], p[0], p[2], d[1], d[0], d[2]);
+			else if (d[2] != 0.0f) interval = CrossingInterval(p[2], p[0], p[1], d[2], d[0], d[1]);
+			else return false;
+			return true;
+		}
+
+		inline float Cross2D(const glm::vec2& a, const glm::vec2& b)
+		{
+			return a.x * b.y - a.y * b.x;
+		}
+
+		inline bool SegmentsIntersect2D(const glm::vec2& a0, const glm::vec2& a1, const glm::vec2& b0, const glm::vec2& b1)
+		{
+			const float d1 = Cross2D(b1 - b0, a0 - b0);
+			const float d2 = Cross2D(b1 - b0, a1 - b0);
+			const float d3 = Cross2D(a1 - a0, b0 - a0);
+			const float d4 = Cross2D(a1 - a0, b1 - a0);
+			if (((d1 > 0.0f && d2 < 0.0f) || (d1 < 0.0f && d2 > 0.0f)) &&
+				((d3 > 0.0f && d4 < 0.0f) || (d3 < 0.0f && d4 > 0.0f)))
+				return true;
+
+			// Collinear touching cases
+			const auto onSegment = [](const glm::vec2& p, const glm::vec2& q, const glm::vec2& r)
+			{
+				return std::min(p.x, q.x) <= r.x && r.x <= std::max(p.x, q.x) &&
+				       std::min(p.y, q.y) <= r.y && r.y <= std::max(p.y, q.y);
+			};
+			return (d1 == 0.0f && onSegment(b0, b1, a0)) || (d2 == 0.0f && onSegment(b0, b1, a1)) ||
+			       (d3 == 0.0f && onSegment(a0, a1, b0)) || (d4 == 0.0f && onSegment(a0, a1, b1));
+		}
+
+		inline bool PointInTriangle2D(const glm::vec2& p, const glm::vec2 (&tri)[3])
+		{
+			const float d0 = Cross2D(tri[1] - tri[0], p - tri[0]);
+			const float d1 = Cross2D(tri[2] - tri[1], p - tri[1]);
+			const float d2 = Cross2D(tri[0] - tri[2], p - tri[2]);
+			const bool hasNegative = d0 < 0.0f || d1 < 0.0f || d2 < 0.0f;
+			const bool hasPositive = d0 > 0.0f || d1 > 0.0f || d2 > 0.0f;
+			return !(hasNegative && hasPositive);
+		}
+
+		// Both triangles lie in the plane with the given normal
+		inline bool CoplanarTriangles(const glm::vec3& normal, const glm::vec3 (&a)[3], const glm::vec3 (&b)[3])
+		{
+			// Project onto the axis aligned plane the triangles are most parallel to
+			const glm::vec3 absNormal = glm::abs(normal);
+			unsigned int i0, i1;
+			if (absNormal.x > absNormal.y && absNormal.x > absNormal.z) { i0 = 1; i1 = 2; }
+			else if (absNormal.y > absNormal.z) { i0 = 0; i1 = 2; }
+			else { i0 = 0; i1 = 1; }
+
+			glm::vec2 a2[3], b2[3];
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				a2[i] = glm::vec2(a[i][i0], a[i][i1]);
+				b2[i] = glm::vec2(b[i][i0], b[i][i1]);
+			}
+
+			for (unsigned int i = 0; i < 3; i++)
+				for (unsigned int j = 0; j < 3; j++)
+					if (SegmentsIntersect2D(a2[i], a2[(i + 1) % 3], b2[j], b2[(j + 1) % 3]))
+						return true;
+
+			// One triangle is entirely inside the other
+			return PointInTriangle2D(a2[0], b2) || PointInTriangle2D(b2[0], a2);
+		}
+	}
+
+	// Returns true if the triangles intersect or touch
+	// Adapted from Moller, "A Fast Triangle-Triangle Intersection Test" (1997)
+	inline bool TriangleTriangle(const glm::vec3 (&a)[3], const glm::vec3 (&b)[3])
+	{
+		// Signed distances of b's vertices to a's plane
+		const glm::vec3 normalA = glm::cross(a[1] - a[0], a[2] - a[0]);
+		const float planeA = -glm::dot(normalA, a[0]);
+		const float toleranceA = Detail::PlaneTolerance(normalA);
+		glm::vec3 distB;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			distB[i] = glm::dot(normalA, b[i]) + planeA;
+			if (std::abs(distB[i]) < toleranceA) distB[i] = 0.0f;
+		}
+		if (distB[0] * distB[1] > 0.0f && distB[0] * distB[2] > 0.0f) return false;
+
+		// Signed distances of a's vertices to b's plane
+		const glm::vec3 normalB = glm::cross(b[1] - b[0], b[2] - b[0]);
+		const float planeB = -glm::dot(normalB, b[0]);
+		const float toleranceB = Detail::PlaneTolerance(normalB);
+		glm::vec3 distA;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			distA[i] = glm::dot(normalB, a[i]) + planeB;
+			if (std::abs(distA[i]) < toleranceB) distA[i] = 0.0f;
+		}
+		if (distA[0] * distA[1] > 0.0f && distA[0] * distA[2] > 0.0f) return false;
+
+		// Both triangles cross the line where the planes meet, project onto its largest axis
+		const glm::vec3 lineDirection = glm::abs(glm::cross(normalA, normalB));
+		unsigned int index = 0;
+		if (lineDirection.y > lineDirection[index]) index = 1;
+		if (lineDirection.z > lineDirection[index]) index = 2;
+
+		const glm::vec3 projA(a[0][index], a[1][index], a[2][index]);
+		const glm::vec3 projB(b[0][index], b[1][index], b[2][index]);
+
+		glm::vec2 intervalA, intervalB;
+		if (!Detail::ComputeInterval(projA, distA, intervalA) || !Detail::ComputeInterval(projB, distB, intervalB))
+			return Detail::CoplanarTriangles(normalA, a, b);
+
+		return intervalA.x <= intervalB.y && intervalB.x <= intervalA.y;
+	}
+}
@@ -0,0 +1,390 @@
+#include "BodyStore.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BODY_STORE_X86
+#endif
+
+#include "utils/TaskScheduler.h"
+
+namespace Physics
+{
+	namespace
+	{
+		// Pointers into a store's arrays, so kernels don't go through vectors
+		struct Arrays
+		{
+			float *px, *py, *pz;
+			float *ppx, *ppy, *ppz;
+			float *vx, *vy, *vz;
+			float *wx, *wy, *wz;
+			float *fx, *fy, *fz;
+			const float* inverseMass;
+			float *qw, *qx, *qy, *qz;
+		};
+
+		// Wider kernels do the same operations in the same order as these, and use them for the bodies left over
+		inline void IntegrateVelocity(const Arrays& a, const size_t i, const float dt, const glm::vec3& gravity, const float damping)
+		{
+			a.vx[i] = (a.vx[i] + (a.fx[i] * a.inverseMass[i] + gravity.x) * dt) * damping;
+			a.vy[i] = (a.vy[i] + (a.fy[i] * a.inverseMass[i] + gravity.y) * dt) * damping;
+			a.vz[i] = (a.vz[i] + (a.fz[i] * a.inverseMass[i] + gravity.z) * dt) * damping;
+			a.wx[i] *= damping;
+			a.wy[i] *= damping;
+			a.wz[i] *= damping;
+			a.fx[i] = 0.0f;
+			a.fy[i] = 0.0f;
+			a.fz[i] = 0.0f;
+		}
+
+		inline void IntegratePosition(const Arrays& a, const size_t i, const float dt)
+		{
+			a.ppx[i] = a.px[i];
+			a.ppy[i] = a.py[i];
+			a.ppz[i] = a.pz[i];
+			a.px[i] += a.vx[i] * dt;
+			a.py[i] += a.vy[i] * dt;
+			a.pz[i] += a.vz[i] * dt;
+
+			// q' = w * q / 2, with w as a quaternion without a real part
+			const float halfDt = 0.5f * dt;
+			const float qw = a.qw[i], qx = a.qx[i], qy = a.qy[i], qz = a.qz[i];
+			const float wx = a.wx[i], wy = a.wy[i], wz = a.wz[i];
+			float w = qw + halfDt * -(wx * qx + wy * qy + wz * qz);
+			float x = qx + halfDt * (wx * qw + (wy * qz - wz * qy));
+			float y = qy + halfDt * (wy * qw + (wz * qx - wx * qz));
+			float z = qz + halfDt * (wz * qw + (wx * qy - wy * qx));
+
+			const float inverseLength = 1.0f / std::sqrt(w * w + x * x + y * y + z * z);
+			a.qw[i] = w * inverseLength;
+			a.qx[i] = x * inverseLength;
+			a.qy[i] = y * inverseLength;
+			a.qz[i] = z * inverseLength;
+		}
+
+		void IntegrateVelocitiesScalar(const Arrays& a, const size_t begin, const size_t end, const float dt, const glm::vec3& gravity, const float damping)
+		{
+			for (size_t i = begin; i < end; i++)
+				IntegrateVelocity(a, i, dt, gravity, damping);
+		}
+
+		void IntegratePositionsScalar(const Arrays& a, const size_t begin, const size_t end, const float dt)
+		{
+			for (size_t i = begin; i < end; i++)
+				IntegratePosition(a, i, dt);
+		}
+
+#ifdef BODY_STORE_X86
+		// Lambdas don't take their function's target, so each width has its own helpers
+		__attribute__((target("sse2"))) inline void IntegrateAxisSSE2(float* velocity, float* force, const __m128 inverseMass,
+		                                                              const __m128 gravity, const __m128 dt, const __m128 damping)
+		{
+			const __m128 acceleration = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(force), inverseMass), gravity);
+			_mm_storeu_ps(velocity, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocity), _mm_mul_ps(acceleration, dt)), damping));
+			_mm_storeu_ps(force, _mm_setzero_ps());
+		}
+
+		__attribute__((target("sse2"))) inline void DampSSE2(float* velocity, const __m128 damping)
+		{
+			_mm_storeu_ps(velocity, _mm_mul_ps(_mm_loadu_ps(velocity), damping));
+		}
+
+		__attribute__((target("sse2"))) inline void MoveSSE2(float* position, float* previousPosition, const float* velocity, const __m128 dt)
+		{
+			const __m128 current = _mm_loadu_ps(position);
+			_mm_storeu_ps(previousPosition, current);
+			_mm_storeu_ps(position, _mm_add_ps(current, _mm_mul_ps(_mm_loadu_ps(velocity), dt)));
+		}
+
+		__attribute__((target("sse2")))
+		void IntegrateVelocitiesSSE2(const Arrays& a, const size_t begin, const size_t end, const float dt, const glm::vec3& gravity, const float damping)
+		{
+			const __m128 dtWide = _mm_set1_ps(dt);
+			const __m128 dampingWide = _mm_set1_ps(damping);
+			const __m128 gx = _mm_set1_ps(gravity.x), gy = _mm_set1_ps(gravity.y), gz = _mm_set1_ps(gravity.z);
+
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				const __m128 inverseMass = _mm_loadu_ps(a.inverseMass + i);
+				IntegrateAxisSSE2(a.vx + i, a.fx + i, inverseMass, gx, dtWide, dampingWide);
+				IntegrateAxisSSE2(a.vy + i, a.fy + i, inverseMass, gy, dtWide, dampingWide);
+				IntegrateAxisSSE2(a.vz + i, a.fz + i, inverseMass, gz, dtWide, dampingWide);
+				DampSSE2(a.wx + i, dampingWide);
+				DampSSE2(a.wy + i, dampingWide);
+				DampSSE2(a.wz + i, dampingWide);
+			}
+			IntegrateVelocitiesScalar(a, i, end, dt, gravity, damping);
+		}
+
+		__attribute__((target("sse2")))
+		void IntegratePositionsSSE2(const Arrays& a, const size_t begin, const size_t end, const float dt)
+		{
+			const __m128 dtWide = _mm_set1_ps(dt);
+			const __m128 halfDt = _mm_set1_ps(0.5f * dt);
+			const __m128 signBit = _mm_set1_ps(-0.0f);
+			const __m128 one = _mm_set1_ps(1.0f);
+
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4)
+			{
+				MoveSSE2(a.px + i, a.ppx + i, a.vx + i, dtWide);
+				MoveSSE2(a.py + i, a.ppy + i, a.vy + i, dtWide);
+				MoveSSE2(a.pz + i, a.ppz + i, a.vz + i, dtWide);
+
+				const __m128 qw = _mm_loadu_ps(a.qw + i), qx = _mm_loadu_ps(a.qx + i), qy = _mm_loadu_ps(a.qy + i), qz = _mm_loadu_ps(a.qz + i);
+				const __m128 wx = _mm_loadu_ps(a.wx + i), wy = _mm_loadu_ps(a.wy + i), wz = _mm_loadu_ps(a.wz + i);
+				const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, qx), _mm_mul_ps(wy, qy)), _mm_mul_ps(wz, qz));
+				const __m128 w = _mm_add_ps(qw, _mm_mul_ps(halfDt, _mm_xor_ps(dot, signBit)));
+				const __m128 x = _mm_add_ps(qx, _mm_mul_ps(halfDt, _mm_add_ps(_mm_mul_ps(wx, qw), _mm_sub_ps(_mm_mul_ps(wy, qz), _mm_mul_ps(wz, qy)))));
+				const __m128 y = _mm_add_ps(qy, _mm_mul_ps(halfDt, _mm_add_ps(_mm_mul_ps(wy, qw), _mm_sub_ps(_mm_mul_ps(wz, qx), _mm_mul_ps(wx, qz)))));
+				const __m128 z = _mm_add_ps(qz, _mm_mul_ps(halfDt, _mm_add_ps(_mm_mul_ps(wz, qw), _mm_sub_ps(_mm_mul_ps(wx, qy), _mm_mul_ps(wy, qx)))));
+
+				const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+				const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+				_mm_storeu_ps(a.qw + i, _mm_mul_ps(w, inverseLength));
+				_mm_storeu_ps(a.qx + i, _mm_mul_ps(x, inverseLength));
+				_mm_storeu_ps(a.qy + i, _mm_mul_ps(y, inverseLength));
+				_mm_storeu_ps(a.qz + i, _mm_mul_ps(z, inverseLength));
+			}
+			IntegratePositionsScalar(a, i, end, dt);
+		}
+
+		__attribute__((target("avx2"))) inline void IntegrateAxisAVX2(float* velocity, float* force, const __m256 inverseMass,
+		                                                              const __m256 gravity, const __m256 dt, const __m256 damping)
+		{
+			const __m256 acceleration = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(force), inverseMass), gravity);
+			_mm256_storeu_ps(velocity, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(velocity), _mm256_mul_ps(acceleration, dt)), damping));
+			_mm256_storeu_ps(force, _mm256_setzero_ps());
+		}
+
+		__attribute__((target("avx2"))) inline void DampAVX2(float* velocity, const __m256 damping)
+		{
+			_mm256_storeu_ps(velocity, _mm256_mul_ps(_mm256_loadu_ps(velocity), damping));
+		}
+
+		__attribute__((target("avx2"))) inline void MoveAVX2(float* position, float* previousPosition, const float* velocity, const __m256 dt)
+		{
+			const __m256 current = _mm256_loadu_ps(position);
+			_mm256_storeu_ps(previousPosition, current);
+			_mm256_storeu_ps(position, _mm256_add_ps(current, _mm256_mul_ps(_mm256_loadu_ps(velocity), dt)));
+		}
+
+		__attribute__((target("avx2")))
+		void IntegrateVelocitiesAVX2(const Arrays& a, const size_t begin, const size_t end, const float dt, const glm::vec3& gravity, const float damping)
+		{
+			const __m256 dtWide = _mm256_set1_ps(dt);
+			const __m256 dampingWide = _mm256_set1_ps(damping);
+			const __m256 gx = _mm256_set1_ps(gravity.x), gy = _mm256_set1_ps(gravity.y), gz = _mm256_set1_ps(gravity.z);
+
+			size_t i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				const __m256 inverseMass = _mm256_loadu_ps(a.inverseMass + i);
+				IntegrateAxisAVX2(a.vx + i, a.fx + i, inverseMass, gx, dtWide, dampingWide);
+				IntegrateAxisAVX2(a.vy + i, a.fy + i, inverseMass, gy, dtWide, dampingWide);
+				IntegrateAxisAVX2(a.vz + i, a.fz + i, inverseMass, gz, dtWide, dampingWide);
+				DampAVX2(a.wx + i, dampingWide);
+				DampAVX2(a.wy + i, dampingWide);
+				DampAVX2(a.wz + i, dampingWide);
+			}
+			IntegrateVelocitiesScalar(a, i, end, dt, gravity, damping);
+		}
+
+		__attribute__((target("avx2")))
+		void IntegratePositionsAVX2(const Arrays& a, const size_t begin, const size_t end, const float dt)
+		{
+			const __m256 dtWide = _mm256_set1_ps(dt);
+			const __m256 halfDt = _mm256_set1_ps(0.5f * dt);
+			const __m256 signBit = _mm256_set1_ps(-0.0f);
+			const __m256 one = _mm256_set1_ps(1.0f);
+
+			size_t i = begin;
+			for (; i + 8 <= end; i += 8)
+			{
+				MoveAVX2(a.px + i, a.ppx + i, a.vx + i, dtWide);
+				MoveAVX2(a.py + i, a.ppy + i, a.vy + i, dtWide);
+				MoveAVX2(a.pz + i, a.ppz + i, a.vz + i, dtWide);
+
+				const __m256 qw = _mm256_loadu_ps(a.qw + i), qx = _mm256_loadu_ps(a.qx + i), qy = _mm256_loadu_ps(a.qy + i), qz = _mm256_loadu_ps(a.qz + i);
+				const __m256 wx = _mm256_loadu_ps(a.wx + i), wy = _mm256_loadu_ps(a.wy + i), wz = _mm256_loadu_ps(a.wz + i);
+				const __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wx, qx), _mm256_mul_ps(wy, qy)), _mm256_mul_ps(wz, qz));
+				const __m256 w = _mm256_add_ps(qw, _mm256_mul_ps(halfDt, _mm256_xor_ps(dot, signBit)));
+				const __m256 x = _mm256_add_ps(qx, _mm256_mul_ps(halfDt, _mm256_add_ps(_mm256_mul_ps(wx, qw), _mm256_sub_ps(_mm256_mul_ps(wy, qz), _mm256_mul_ps(wz, qy)))));
+				const __m256 y = _mm256_add_ps(qy, _mm256_mul_ps(halfDt, _mm256_add_ps(_mm256_mul_ps(wy, qw), _mm256_sub_ps(_mm256_mul_ps(wz, qx), _mm256_mul_ps(wx, qz)))));
+				const __m256 z = _mm256_add_ps(qz, _mm256_mul_ps(halfDt, _mm256_add_ps(_mm256_mul_ps(wz, qw), _mm256_sub_ps(_mm256_mul_ps(wx, qy), _mm256_mul_ps(wy, qx)))));
+
+				const __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w, w), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+				const __m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+				_mm256_storeu_ps(a.qw + i, _mm256_mul_ps(w, inverseLength));
+				_mm256_storeu_ps(a.qx + i, _mm256_mul_ps(x, inverseLength));
+				_mm256_storeu_ps(a.qy + i, _mm256_mul_ps(y, inverseLength));
+				_mm256_storeu_ps(a.qz + i, _mm256_mul_ps(z, inverseLength));
+			}
+			IntegratePositionsScalar(a, i, end, dt);
+		}
+#endif
+
+		Arrays GetArrays(BodyStore& store)
+		{
+			return Arrays{
+				store.positions.x.data(), store.positions.y.data(), store.positions.z.data(),
+				store.previousPositions.x.data(), store.previousPositions.y.data(), store.previousPositions.z.data(),
+				store.linearVelocities.x.data(), store.linearVelocities.y.data(), store.linearVelocities.z.data(),
+				store.angularVelocities.x.data(), store.angularVelocities.y.data(), store.angularVelocities.z.data(),
+				store.forces.x.data(), store.forces.y.data(), store.forces.z.data(),
+				store.inverseMasses.data(),
+				store.orientationW.data(), store.orientationX.data(), store.orientationY.data(), store.orientationZ.data()
+			};
+		}
+	}
+
+	void BodyStore::Vectors::Resize(const size_t size)
+	{
+		x.resize(size);
+		y.resize(size);
+		z.resize(size);
+	}
+
+	void BodyStore::Vectors::Set(const size_t i, const glm::vec3& v)
+	{
+		x[i] = v.x;
+		y[i] = v.y;
+		z[i] = v.z;
+	}
+
+	uint32_t BodyStore::Add(const glm::vec3& position, const glm::quat& orientation, const glm::vec3& linearVelocity,
+	                        const glm::vec3& angularVelocity, const glm::vec3& force, const float inverseMass)
+	{
+		const size_t index = Size();
+		Resize(index + 1);
+
+		positions.Set(index, position);
+		previousPositions.Set(index, position);
+		linearVelocities.Set(index, linearVelocity);
+		angularVelocities.Set(index, angularVelocity);
+		forces.Set(index, force);
+		inverseMasses[index] = inverseMass;
+		orientationW[index] = orientation.w;
+		orientationX[index] = orientation.x;
+		orientationY[index] = orientation.y;
+		orientationZ[index] = orientation.z;
+		return static_cast<uint32_t>(index);
+	}
+
+	void BodyStore::Remove(const size_t i)
+	{
+		const size_t last = Size() - 1;
+		if (i != last)
+		{
+			positions.Set(i, positions.Get(last));
+			previousPositions.Set(i, previousPositions.Get(last));
+			linearVelocities.Set(i, linearVelocities.Get(last));
+			angularVelocities.Set(i, angularVelocities.Get(last));
+			forces.Set(i, forces.Get(last));
+			inverseMasses[i] = inverseMasses[last];
+			orientationW[i] = orientationW[last];
+			orientationX[i] = orientationX[last];
+			orientationY[i] = orientationY[last];
+			orientationZ[i] = orientationZ[last];
+			sleepTimes[i] = sleepTimes[last];
+		}
+		Resize(last);
+	}
+
+	void BodyStore::Resize(const size_t size)
+	{
+		positions.Resize(size);
+		previousPositions.Resize(size);
+		linearVelocities.Resize(size);
+		angularVelocities.Resize(size);
+		forces.Resize(size);
+		inverseMasses.resize(size);
+		// Added bodies face along the axes
+		orientationW.resize(size, 1.0f);
+		orientationX.resize(size);
+		orientationY.resize(size);
+		orientationZ.resize(size);
+		sleepTimes.resize(size);
+	}
+
+	void BodyStore::IntegrateVelocities(const float dt, const glm::vec3& gravity, const float damping)
+	{
+		const Arrays arrays = GetArrays(*this);
+		const Kernel kernel = mKernel;
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, Size(), GRAIN_SIZE, [&](const size_t begin, const size_t end)
+		{
+			switch (kernel)
+			{
+#ifdef BODY_STORE_X86
+			case Kernel::AVX2:
+				IntegrateVelocitiesAVX2(arrays, begin, end, dt, gravity, damping);
+				break;
+			case Kernel::SSE2:
+				IntegrateVelocitiesSSE2(arrays, begin, end, dt, gravity, damping);
+				break;
+#endif
+			default:
+				IntegrateVelocitiesScalar(arrays, begin, end, dt, gravity, damping);
+			}
+		});
+	}
+
+	void BodyStore::IntegratePositions(const float dt)
+	{
+		const Arrays arrays = GetArrays(*this);
+		const Kernel kernel = mKernel;
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, Size(), GRAIN_SIZE, [&](const size_t begin, const size_t end)
+		{
+			switch (kernel)
+			{
+#ifdef BODY_STORE_X86
+			case Kernel::AVX2:
+				IntegratePositionsAVX2(arrays, begin, end, dt);
+				break;
+			case Kernel::SSE2:
+				IntegratePositionsSSE2(arrays, begin, end, dt);
+				break;
+#endif
+			default:
+				IntegratePositionsScalar(arrays, begin, end, dt);
+			}
+		});
+	}
+
+	BodyStore::Kernel BodyStore::GetSupportedKernel()
+	{
+		static const Kernel kernel = []
+		{
+#ifdef BODY_STORE_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return Kernel::AVX2;
+			if (__builtin_cpu_supports("sse2")) return Kernel::SSE2;
+#endif
+			return Kernel::SCALAR;
+		}();
+		return kernel;
+	}
+
+	BodyStore::Kernel BodyStore::SetKernel(const Kernel kernel)
+	{
+		mKernel = std::min(kernel, GetSupportedKernel());
+		return mKernel;
+	}
+
+	const char* BodyStore::GetKernelName() const
+	{
+		switch (mKernel)
+		{
+		case Kernel::AVX2:
+			return "AVX2";
+		case Kernel::SSE2:
+			return "SSE2";
+		default:
+			return "scalar";
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Rigid body state kept in one array per value, so stepping bodies streams through memory in SIMD registers
+// Kernels are picked at runtime from what the CPU supports, AVX2 steps 8 bodies per instruction and SSE2 4
+namespace Physics
+{
+	class BodyStore
+	{
+	public:
+		// Bodies stepped between yielding to other tasks
+		static constexpr size_t GRAIN_SIZE = 16384;
+
+		// Instruction sets the kernels are written for, later ones are faster
+		enum class Kernel
+		{
+			SCALAR,
+			SSE2,
+			AVX2
+		};
+
+		// Arrays of each component of a vector per body
+		struct Vectors
+		{
+			std::vector<float> x, y, z;
+
+			void Resize(size_t size);
+			void Set(size_t i, const glm::vec3& v);
+			glm::vec3 Get(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+		};
+
+		Vectors positions;
+		// Positions before the last IntegratePositions, rendering interpolates from them
+		Vectors previousPositions;
+		Vectors linearVelocities;
+		Vectors angularVelocities;
+		// Summed since the last step, cleared when velocities are integrated
+		Vectors forces;
+		std::vector<float> inverseMasses;
+		// Quaternion components, kept unit length
+		std::vector<float> orientationW, orientationX, orientationY, orientationZ;
+		// Seconds each body has been slow enough to fall asleep, the kernels leave it alone
+		std::vector<float> sleepTimes;
+
+		// Returns the body's index, indices stay valid until a body is removed
+		uint32_t Add(const glm::vec3& position, const glm::quat& orientation, const glm::vec3& linearVelocity,
+		             const glm::vec3& angularVelocity, const glm::vec3& force, float inverseMass);
+		// Moves the last body into i, so only the last body's index changes
+		void Remove(size_t i);
+		void Resize(size_t size);
+		size_t Size() const { return inverseMasses.size(); }
+		void Clear() { Resize(0); }
+
+		glm::quat GetOrientation(size_t i) const { return glm::quat(orientationW[i], orientationX[i], orientationY[i], orientationZ[i]); }
+
+		// Adds forces and gravity to linear velocities, scales every velocity by damping and clears forces
+		void IntegrateVelocities(float dt, const glm::vec3& gravity, float damping);
+		// Moves bodies by their linear velocities and spins them by their angular ones, keeping where they were in previousPositions
+		void IntegratePositions(float dt);
+
+		// Fastest kernel the CPU supports, which stores use unless told otherwise
+		static Kernel GetSupportedKernel();
+		// Picks the kernel this store steps with, e.g. to compare a SIMD kernel with the scalar one
+		// Kernels the CPU doesn't support fall back to the supported one, returns the kernel that will be used
+		Kernel SetKernel(Kernel kernel);
+		Kernel GetKernel() const { return mKernel; }
+		// Instruction set the kernels use, "AVX2", "SSE2" or "scalar"
+		const char* GetKernelName() const;
+
+	private:
+		Kernel mKernel = GetSupportedKernel();
+	};
+}
@@ -31,6 +31,8 @@ public:
 
 	glm::vec3 GetBound(bool min) const;
 	bool IsColliding(const BoundingBox& other) const;
+	// Returns 0 if the point is inside the box
+	float DistanceSquared(const glm::vec3& point) const;
 	void UpdateSurfaceArea();
 };
 
@@ -54,6 +56,12 @@ inline bool BoundingBox::IsColliding(const BoundingBox& other) const
 		max.z >= other.min.z;
 }
 
+inline float BoundingBox::DistanceSquared(const glm::vec3& point) const
+{
+	const glm::vec3 offset = glm::max(min - point, glm::vec3(0.0f)) + glm::max(point - max, glm::vec3(0.0f));
+	return glm::dot(offset, offset);
+}
+
 inline void BoundingBox::Merge(const BoundingBox& box1, const BoundingBox& box2)
 {
 	for (unsigned int d = 0; d < 3; d++) {
@@ -0,0 +1,512 @@
+#include "ChunkedMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <glm/gtx/hash.hpp>
+
+#include "math/Intersect.h"
+#include "utils/Logger.h"
+#include "utils/Timer.h"
+
+namespace Physics
+{
+	namespace
+	{
+		// Triangle record of a binary STL file, without its 2 attribute bytes
+		struct StlTriangle
+		{
+			glm::vec3 normal;
+			glm::vec3 v[3];
+		};
+		static_assert(sizeof(StlTriangle) == 48, "StlTriangle should match the STL record layout");
+
+		constexpr size_t STL_HEADER_SIZE = 84;
+		constexpr size_t STL_RECORD_SIZE = 50;
+		// Triangles read from the STL file at once
+		constexpr size_t READ_BLOCK_SIZE = 1 << 16;
+		// Memory for triangles waiting to be written to their chunk, split between chunks
+		constexpr size_t SCATTER_BUFFER_BYTES = 64 << 20;
+		// Keeps the chunk table small enough to always hold in memory
+		constexpr size_t MAX_CHUNK_COUNT = 1 << 20;
+
+		// Reads every triangle of a binary STL file in blocks, calling func(triangle) for each
+		template <typename Func>
+		bool ForEachStlTriangle(std::ifstream& is, const uint32_t triangleCount, Func func)
+		{
+			std::vector<char> block(READ_BLOCK_SIZE * STL_RECORD_SIZE);
+			is.clear();
+			is.seekg(STL_HEADER_SIZE);
+			for (size_t first = 0; first < triangleCount; first += READ_BLOCK_SIZE)
+			{
+				const size_t count = std::min(READ_BLOCK_SIZE, triangleCount - first);
+				is.read(block.data(), static_cast<std::streamsize>(count * STL_RECORD_SIZE));
+				if (!is) return false;
+
+				for (size_t i = 0; i < count; i++)
+				{
+					StlTriangle triangle;
+					std::memcpy(&triangle, block.data() + i * STL_RECORD_SIZE, sizeof(StlTriangle));
+					func(triangle);
+				}
+			}
+			return true;
+		}
+	}
+
+
+	size_t MeshChunk::GetMemoryUsage() const
+	{
+		return vertices.size() * sizeof(MeshPt) + indices.size() * sizeof(unsigned) + tree.GetMemoryUsage();
+	}
+
+
+	bool ChunkedMesh::Partition(const std::string& stlPath, const std::string& chunkPath, const float chunkSize, const BuildOptions& options)
+	{
+		if (chunkSize <= 0.0f)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Chunk size has to be positive.\n";
+			return false;
+		}
+
+		std::ifstream is(stlPath, std::ios::binary);
+		if (!is)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Can't open " << stlPath << "\n";
+			return false;
+		}
+
+		// Only binary STL files are supported, their size gives away ASCII ones
+		uint32_t triangleCount = 0;
+		is.seekg(80);
+		is.read(reinterpret_cast<char*>(&triangleCount), sizeof(uint32_t));
+		std::error_code error;
+		const uintmax_t fileSize = std::filesystem::file_size(stlPath, error);
+		if (!is || error || fileSize < STL_HEADER_SIZE + static_cast<uintmax_t>(triangleCount) * STL_RECORD_SIZE || triangleCount == 0)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: " << stlPath << " isn't a binary STL file with triangles.\n";
+			return false;
+		}
+
+		Utils::Timer t("Chunked mesh partition");
+
+		// First pass finds the grid, the second counts triangles per chunk
+		BoundingBox bounds(glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+		if (!ForEachStlTriangle(is, triangleCount, [&](const StlTriangle& triangle)
+		{
+			for (const glm::vec3& v : triangle.v)
+				bounds.IncludePoint(v);
+		}))
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: " << stlPath << " is truncated.\n";
+			return false;
+		}
+
+		const glm::uvec3 gridSize = glm::max(glm::uvec3(glm::ceil((bounds.max - bounds.min) / chunkSize)), glm::uvec3(1));
+		const size_t cellCount = static_cast<size_t>(gridSize.x) * gridSize.y * gridSize.z;
+		if (cellCount > MAX_CHUNK_COUNT)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Chunk size " << chunkSize << " makes " << cellCount << " chunks, at most " << MAX_CHUNK_COUNT << " are supported.\n";
+			return false;
+		}
+		const auto cellOf = [&](const StlTriangle& triangle)
+		{
+			const glm::vec3 centroid = (triangle.v[0] + triangle.v[1] + triangle.v[2]) / 3.0f;
+			const glm::uvec3 cell = glm::min(glm::uvec3(glm::max((centroid - bounds.min) / chunkSize, 0.0f)), gridSize - 1u);
+			return cell.x + static_cast<size_t>(cell.y) * gridSize.x + static_cast<size_t>(cell.z) * gridSize.x * gridSize.y;
+		};
+
+		std::vector<uint64_t> cellTriangles(cellCount, 0);
+		ForEachStlTriangle(is, triangleCount, [&](const StlTriangle& triangle) { cellTriangles[cellOf(triangle)]++; });
+
+		std::vector<uint64_t> cellOffsets(cellCount + 1, 0);
+		size_t usedCells = 0;
+		for (size_t cell = 0; cell < cellCount; cell++)
+		{
+			cellOffsets[cell + 1] = cellOffsets[cell] + cellTriangles[cell];
+			usedCells += cellTriangles[cell] > 0;
+		}
+
+		// Third pass groups triangles by chunk in a scratch file, buffering a few per chunk so writes aren't one triangle at a time
+		const std::string scratchPath = chunkPath + ".scratch";
+		{
+			std::ofstream scratch(scratchPath, std::ios::binary | std::ios::trunc);
+			const size_t bufferSize = std::clamp<size_t>(SCATTER_BUFFER_BYTES / sizeof(StlTriangle) / usedCells, 16, 4096);
+			std::vector<std::vector<StlTriangle>> buffers(cellCount);
+			std::vector<uint64_t> written(cellCount, 0);
+			const auto flush = [&](const size_t cell)
+			{
+				scratch.seekp(static_cast<std::streamoff>((cellOffsets[cell] + written[cell]) * sizeof(StlTriangle)));
+				scratch.write(reinterpret_cast<const char*>(buffers[cell].data()), static_cast<std::streamsize>(buffers[cell].size() * sizeof(StlTriangle)));
+				written[cell] += buffers[cell].size();
+				buffers[cell].clear();
+			};
+
+			ForEachStlTriangle(is, triangleCount, [&](const StlTriangle& triangle)
+			{
+				const size_t cell = cellOf(triangle);
+				buffers[cell].push_back(triangle);
+				if (buffers[cell].size() >= bufferSize) flush(cell);
+			});
+			for (size_t cell = 0; cell < cellCount; cell++)
+				if (!buffers[cell].empty()) flush(cell);
+
+			if (!scratch)
+			{
+				LOG(LOG_ERROR) << "Chunked mesh: Failed to write " << scratchPath << "\n";
+				scratch.close();
+				std::filesystem::remove(scratchPath, error);
+				return false;
+			}
+		}
+		is.close();
+
+		// Last pass builds each chunk from its triangles and saves it, the table is filled in once every offset is known
+		FileHeader header{};
+		std::memcpy(header.magic, "CHNK", 4);
+		header.version = FILE_VERSION;
+		header.chunkCount = usedCells;
+		header.chunkSize = chunkSize;
+		header.binCount = options.binCount;
+		header.maxLeafSize = options.maxLeafSize;
+		header.traversalCost = options.traversalCost;
+		header.method = static_cast<uint32_t>(options.method);
+		header.spatialSplitBudget = options.spatialSplitBudget;
+
+		std::vector<ChunkEntry> entries;
+		entries.reserve(usedCells);
+
+		// Written under another name first, so a crash never leaves a partial file behind
+		const std::string tempPath = chunkPath + ".tmp";
+		bool success = true;
+		{
+			std::ifstream scratch(scratchPath, std::ios::binary);
+			std::ofstream os(tempPath, std::ios::binary | std::ios::trunc);
+			os.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+			const std::vector<ChunkEntry> placeholder(usedCells);
+			os.write(reinterpret_cast<const char*>(placeholder.data()), static_cast<std::streamsize>(usedCells * sizeof(ChunkEntry)));
+
+			std::vector<StlTriangle> triangles;
+			for (size_t cell = 0; cell < cellCount && success; cell++)
+			{
+				if (cellTriangles[cell] == 0) continue;
+
+				triangles.resize(cellTriangles[cell]);
+				scratch.seekg(static_cast<std::streamoff>(cellOffsets[cell] * sizeof(StlTriangle)));
+				scratch.read(reinterpret_cast<char*>(triangles.data()), static_cast<std::streamsize>(triangles.size() * sizeof(StlTriangle)));
+
+				// Welds vertices shared by triangles of the chunk and averages their normals, like ReadSTL
+				MeshChunk chunk;
+				std::unordered_map<glm::vec3, unsigned, std::hash<glm::vec3>> pointToIndex;
+				chunk.indices.reserve(triangles.size() * 3);
+				for (const StlTriangle& triangle : triangles)
+				{
+					for (const glm::vec3& v : triangle.v)
+					{
+						const auto [point, inserted] = pointToIndex.emplace(v, static_cast<unsigned>(chunk.vertices.size()));
+						if (inserted) chunk.vertices.push_back(MeshPt{ v, triangle.normal });
+						else chunk.vertices[point->second].normal += triangle.normal;
+						chunk.indices.push_back(point->second);
+					}
+				}
+				for (MeshPt& vertex : chunk.vertices)
+				{
+					const float length = glm::length(vertex.normal);
+					if (length > 0.0f) vertex.normal /= length;
+				}
+
+				chunk.tree.CreateStaticTree(chunk.vertices, chunk.indices, options);
+
+				ChunkEntry entry{};
+				const BoundingBox chunkBounds = chunk.tree.GetBounds();
+				for (unsigned int axis = 0; axis < 3; axis++)
+				{
+					entry.min[axis] = chunkBounds.min[axis];
+					entry.max[axis] = chunkBounds.max[axis];
+				}
+				entry.offset = static_cast<uint64_t>(os.tellp());
+				entry.vertexCount = chunk.vertices.size();
+				entry.indexCount = chunk.indices.size();
+				entry.key = chunk.tree.GetKey();
+
+				os.write(reinterpret_cast<const char*>(chunk.vertices.data()), static_cast<std::streamsize>(chunk.vertices.size() * sizeof(MeshPt)));
+				chunk.tree.Write(os, entry.key, chunk.indices);
+				entry.size = static_cast<uint64_t>(os.tellp()) - entry.offset;
+				entries.push_back(entry);
+
+				success = scratch && os;
+			}
+
+			os.seekp(sizeof(FileHeader));
+			os.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(ChunkEntry)));
+			success = success && os;
+		}
+		std::filesystem::remove(scratchPath, error);
+
+		if (success)
+			std::filesystem::rename(tempPath, chunkPath, error);
+		if (!success || error)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Failed to write " << chunkPath << "\n";
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		LOG(LOG_INFO) << "Partitioned " << triangleCount << " triangles into " << usedCells << " chunks in " << std::to_string(t.GetElapsed()) << "s.\n";
+		return true;
+	}
+
+
+	bool ChunkedMesh::Open(const std::string& chunkPath, const size_t memoryBudget)
+	{
+		Close();
+
+		std::ifstream is(chunkPath, std::ios::binary);
+		if (!is)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Can't open " << chunkPath << "\n";
+			return false;
+		}
+
+		FileHeader header{};
+		is.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+		if (!is || std::memcmp(header.magic, "CHNK", 4) != 0 || header.version != FILE_VERSION || header.chunkCount == 0 || header.chunkCount > MAX_CHUNK_COUNT)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: " << chunkPath << " isn't a chunk file of this version.\n";
+			return false;
+		}
+
+		std::vector<ChunkEntry> entries(header.chunkCount);
+		is.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(ChunkEntry)));
+		if (!is)
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: " << chunkPath << " is truncated.\n";
+			return false;
+		}
+
+		mPath = chunkPath;
+		mEntries.swap(entries);
+		mOptions.binCount = header.binCount;
+		mOptions.maxLeafSize = header.maxLeafSize;
+		mOptions.traversalCost = header.traversalCost;
+		mOptions.method = static_cast<BuildMethod>(header.method);
+		mOptions.spatialSplitBudget = header.spatialSplitBudget;
+		mMemoryBudget = memoryBudget;
+
+		std::vector<std::pair<Entity, BoundingBox>> proxies;
+		proxies.reserve(mEntries.size());
+		for (uint32_t chunk = 0; chunk < mEntries.size(); chunk++)
+			proxies.emplace_back(chunk, GetChunkBounds(chunk));
+		mChunkTree.Build(proxies);
+		return true;
+	}
+
+
+	void ChunkedMesh::Close()
+	{
+		std::unique_lock<std::mutex> lock(chunksMutex);
+		mPath.clear();
+		mEntries.clear();
+		mChunkTree.Build({});
+		mLoaded.clear();
+		mRecentChunks.clear();
+		mMemoryUsage = 0;
+	}
+
+
+	void ChunkedMesh::SetMemoryBudget(const size_t memoryBudget)
+	{
+		std::unique_lock<std::mutex> lock(chunksMutex);
+		mMemoryBudget = memoryBudget;
+		Evict(UINT32_MAX);
+	}
+
+
+	BoundingBox ChunkedMesh::GetChunkBounds(const uint32_t chunk) const
+	{
+		const ChunkEntry& entry = mEntries[chunk];
+		return BoundingBox(glm::vec3(entry.min[0], entry.min[1], entry.min[2]), glm::vec3(entry.max[0], entry.max[1], entry.max[2]));
+	}
+
+
+	BoundingBox ChunkedMesh::GetBounds() const
+	{
+		if (mEntries.empty()) return BoundingBox(glm::vec3(0.0f), glm::vec3(0.0f));
+
+		BoundingBox bounds = GetChunkBounds(0);
+		for (uint32_t chunk = 1; chunk < mEntries.size(); chunk++)
+			bounds.Merge(GetChunkBounds(chunk));
+		return bounds;
+	}
+
+
+	size_t ChunkedMesh::GetLoadedCount()
+	{
+		std::unique_lock<std::mutex> lock(chunksMutex);
+		return mLoaded.size();
+	}
+
+
+	size_t ChunkedMesh::GetMemoryUsage()
+	{
+		std::unique_lock<std::mutex> lock(chunksMutex);
+		return mMemoryUsage;
+	}
+
+
+	std::shared_ptr<const MeshChunk> ChunkedMesh::GetChunk(const uint32_t chunk)
+	{
+		if (chunk >= mEntries.size()) return nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(chunksMutex);
+			const auto loaded = mLoaded.find(chunk);
+			if (loaded != mLoaded.end())
+			{
+				mRecentChunks.splice(mRecentChunks.begin(), mRecentChunks, loaded->second.recent);
+				return loaded->second.chunk;
+			}
+		}
+
+		// Read outside the lock so other threads can use loaded chunks meanwhile
+		std::shared_ptr<MeshChunk> read = ReadChunk(chunk);
+		if (!read) return nullptr;
+
+		std::unique_lock<std::mutex> lock(chunksMutex);
+		// Another thread may have loaded it first
+		const auto loaded = mLoaded.find(chunk);
+		if (loaded != mLoaded.end())
+		{
+			mRecentChunks.splice(mRecentChunks.begin(), mRecentChunks, loaded->second.recent);
+			return loaded->second.chunk;
+		}
+
+		mRecentChunks.push_front(chunk);
+		const size_t memoryUsage = read->GetMemoryUsage();
+		mLoaded[chunk] = LoadedChunk{ read, memoryUsage, mRecentChunks.begin() };
+		mMemoryUsage += memoryUsage;
+		Evict(chunk);
+		return read;
+	}
+
+
+	std::pair<ChunkRayHit, bool> ChunkedMesh::Raycast(const Ray& ray, const float tMax)
+	{
+		ChunkRayHit best{ 0, RayHit{ tMax, 0, glm::vec2(0.0f) } };
+
+		const auto [entity, hit] = mChunkTree.Raycast(ray, tMax, [&](const Entity chunk, const float tBest)
+		{
+			const std::shared_ptr<const MeshChunk> loaded = GetChunk(chunk);
+			if (!loaded) return std::make_pair(tBest, false);
+
+			const auto [triangleHit, hitTriangle] = loaded->tree.Raycast(ray, tBest);
+			if (hitTriangle) best.hit = triangleHit;
+			return std::make_pair(triangleHit.t, hitTriangle);
+		});
+
+		best.chunk = entity;
+		return std::make_pair(best, hit);
+	}
+
+
+	std::vector<uint32_t> ChunkedMesh::QueryChunks(const BoundingBox& box) const
+	{
+		const std::vector<Entity> chunks = mChunkTree.QueryBox(box);
+		return std::vector<uint32_t>(chunks.begin(), chunks.end());
+	}
+
+
+	std::vector<std::pair<uint32_t, size_t>> ChunkedMesh::QueryTriangles(const BoundingBox& box)
+	{
+		std::vector<std::pair<uint32_t, size_t>> output;
+		for (const uint32_t chunk : QueryChunks(box))
+		{
+			const std::shared_ptr<const MeshChunk> loaded = GetChunk(chunk);
+			if (!loaded) continue;
+
+			for (const size_t triangle : loaded->tree.QueryTriangles(box))
+				output.emplace_back(chunk, triangle);
+		}
+		return output;
+	}
+
+
+	std::vector<std::shared_ptr<const MeshChunk>> ChunkedMesh::GetVisibleChunks(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+	{
+		// Stores squared distance from the camera and chunk
+		std::vector<std::pair<float, uint32_t>> visible;
+		for (uint32_t chunk = 0; chunk < mEntries.size(); chunk++)
+		{
+			const BoundingBox bounds = GetChunkBounds(chunk);
+			if (!Utils::FrustumBox(viewProjection, bounds)) continue;
+
+			const glm::vec3 offset = cameraPosition - glm::clamp(cameraPosition, bounds.min, bounds.max);
+			visible.emplace_back(glm::dot(offset, offset), chunk);
+		}
+		std::sort(visible.begin(), visible.end());
+
+		std::vector<std::shared_ptr<const MeshChunk>> output;
+		size_t visibleBytes = 0;
+		for (const auto& [distance, chunk] : visible)
+		{
+			visibleBytes += mEntries[chunk].size;
+			if (visibleBytes > mMemoryBudget) break;
+
+			if (std::shared_ptr<const MeshChunk> loaded = GetChunk(chunk))
+				output.push_back(std::move(loaded));
+		}
+		return output;
+	}
+
+
+	std::shared_ptr<MeshChunk> ChunkedMesh::ReadChunk(const uint32_t chunk) const
+	{
+		const ChunkEntry& entry = mEntries[chunk];
+		std::ifstream is(mPath, std::ios::binary | std::ios::ate);
+		const std::streampos fileSize = is.tellg();
+
+		// Counts have to fit in the chunk and the chunk in the file before anything is allocated
+		const auto corrupted = [&]
+		{
+			LOG(LOG_ERROR) << "Chunked mesh: Chunk " << chunk << " of " << mPath << " is corrupted.\n";
+			return nullptr;
+		};
+		if (!is || fileSize < 0 || entry.offset > static_cast<uint64_t>(fileSize) || entry.size > static_cast<uint64_t>(fileSize) - entry.offset
+			|| entry.vertexCount > entry.size / sizeof(MeshPt) || entry.indexCount > (entry.size - entry.vertexCount * sizeof(MeshPt)) / sizeof(unsigned))
+			return corrupted();
+		is.seekg(static_cast<std::streamoff>(entry.offset));
+
+		auto loaded = std::make_shared<MeshChunk>();
+		loaded->vertices.resize(entry.vertexCount);
+		loaded->indices.resize(entry.indexCount);
+		is.read(reinterpret_cast<char*>(loaded->vertices.data()), static_cast<std::streamsize>(loaded->vertices.size() * sizeof(MeshPt)));
+		if (!is || !loaded->tree.Read(is, entry.key, loaded->indices, mOptions) || static_cast<uint64_t>(is.tellg()) > entry.offset + entry.size)
+			return corrupted();
+
+		// The tree only checks its own arrays, the saved indices could still point past the chunk's vertices
+		for (const unsigned index : loaded->indices)
+		{
+			if (index >= entry.vertexCount) return corrupted();
+		}
+		return loaded;
+	}
+
+
+	void ChunkedMesh::Evict(const uint32_t keep)
+	{
+		auto it = mRecentChunks.end();
+		while (mMemoryUsage > mMemoryBudget && it != mRecentChunks.begin())
+		{
+			--it;
+			if (*it == keep) continue;
+
+			const auto loaded = mLoaded.find(*it);
+			mMemoryUsage -= loaded->second.memoryUsage;
+			mLoaded.erase(loaded);
+			it = mRecentChunks.erase(it);
+		}
+	}
+}
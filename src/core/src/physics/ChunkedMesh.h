@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DynamicTree.h"
+#include "StaticTree.h"
+
+// Mesh too large to keep in memory, split on a uniform grid into chunks that each have their own triangles and StaticTree
+// Chunks live in one paged file and are only loaded when a query or the camera reaches them
+namespace Physics
+{
+	// Geometry and tree of one chunk, in the mesh's space
+	struct MeshChunk
+	{
+		std::vector<MeshPt> vertices;
+		// Reordered to match the tree
+		std::vector<unsigned> indices;
+		StaticTree tree;
+
+		// Bytes used by the vertices, indices and tree
+		size_t GetMemoryUsage() const;
+	};
+
+	// Closest triangle hit by a ray, and the chunk it belongs to
+	struct ChunkRayHit
+	{
+		uint32_t chunk;
+		// Triangle is an index into the chunk's index buffer, divided by 3
+		RayHit hit;
+	};
+
+	class ChunkedMesh
+	{
+	public:
+		// Splits a binary STL file into chunks about chunkSize wide along each axis, builds a tree for each and saves them to chunkPath
+		// Triangles belong to the chunk holding their centroid, so chunk bounds overlap a little
+		// The STL file is streamed, only one chunk's triangles are in memory at a time
+		static bool Partition(const std::string& stlPath, const std::string& chunkPath, float chunkSize, const BuildOptions& options = {});
+
+		ChunkedMesh() = default;
+		ChunkedMesh(const ChunkedMesh&) = delete;
+		void operator=(const ChunkedMesh&) = delete;
+
+		// Opens a file saved by Partition, only the chunk table is read
+		// Once loaded chunks use more than memoryBudget bytes, the least recently used ones are unloaded
+		bool Open(const std::string& chunkPath, size_t memoryBudget);
+		void Close();
+		bool IsOpen() const { return !mEntries.empty(); }
+
+		void SetMemoryBudget(size_t memoryBudget);
+		size_t GetChunkCount() const { return mEntries.size(); }
+		BoundingBox GetChunkBounds(uint32_t chunk) const;
+		// Bounds of the whole mesh
+		BoundingBox GetBounds() const;
+		size_t GetLoadedCount();
+		// Bytes used by loaded chunks
+		size_t GetMemoryUsage();
+
+		// Returns the chunk, loading it if needed, or nullptr if it can't be read
+		// Chunks stay valid while held, even after they're unloaded
+		std::shared_ptr<const MeshChunk> GetChunk(uint32_t chunk);
+
+		// Returns the closest triangle hit closer than tMax
+		// Chunks are visited closest first, so chunks behind the hit are never loaded
+		std::pair<ChunkRayHit, bool> Raycast(const Ray& ray, float tMax = FLT_MAX);
+		// Returns chunks whose bounds overlap box, without loading them
+		std::vector<uint32_t> QueryChunks(const BoundingBox& box) const;
+		// Returns chunk and triangle pairs whose triangle bounds overlap box
+		std::vector<std::pair<uint32_t, size_t>> QueryTriangles(const BoundingBox& box);
+		// Returns the chunks inside the frustum of a projection times view matrix, closest to cameraPosition first
+		// Loading stops at the memory budget, so far chunks are skipped instead of unloading nearer ones
+		std::vector<std::shared_ptr<const MeshChunk>> GetVisibleChunks(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+	private:
+		// Changing the file layout has to bump this
+		static constexpr uint32_t FILE_VERSION = 1;
+
+		// Written at the start of chunk files
+		struct FileHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint64_t chunkCount;
+			float chunkSize;
+			uint32_t binCount;
+			uint32_t maxLeafSize;
+			float traversalCost;
+			uint32_t method;
+			float spatialSplitBudget;
+		};
+
+		// Written after the header for each chunk
+		struct ChunkEntry
+		{
+			float min[3];
+			float max[3];
+			// Byte offset of the chunk's vertices, its tree follows them
+			uint64_t offset;
+			// Bytes of vertices and tree, about what the chunk uses once loaded
+			uint64_t size;
+			uint64_t vertexCount;
+			uint64_t indexCount;
+			// Key its tree was saved with
+			uint64_t key;
+		};
+
+		struct LoadedChunk
+		{
+			std::shared_ptr<MeshChunk> chunk;
+			// Bytes counted in mMemoryUsage, winding numbers can grow the chunk after it's loaded
+			size_t memoryUsage;
+			// Position in mRecentChunks
+			std::list<uint32_t>::iterator recent;
+		};
+
+		std::string mPath;
+		BuildOptions mOptions;
+		std::vector<ChunkEntry> mEntries;
+		// Leaves are chunks, to find the ones a query reaches
+		DynamicBBTree mChunkTree;
+
+		size_t mMemoryBudget = 0;
+		size_t mMemoryUsage = 0;
+		std::unordered_map<uint32_t, LoadedChunk> mLoaded;
+		// Loaded chunks, most recently used first
+		std::list<uint32_t> mRecentChunks;
+		// Guards the loaded chunks, reading a chunk from the file happens outside it
+		std::mutex chunksMutex;
+
+		// Reads a chunk from the file, returns nullptr if the file doesn't match its table entry
+		std::shared_ptr<MeshChunk> ReadChunk(uint32_t chunk) const;
+		// Unloads least recently used chunks until they fit the budget, except keep
+		void Evict(uint32_t keep);
+	};
+}
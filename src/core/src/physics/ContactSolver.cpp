@@ -0,0 +1,471 @@
+#include "ContactSolver.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+namespace Physics
+{
+	namespace
+	{
+		// Any unit direction perpendicular to unit v
+		glm::vec3 Perpendicular(const glm::vec3& v)
+		{
+			const glm::vec3 axis = std::abs(v.x) < 0.57f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			return glm::normalize(glm::cross(v, axis));
+		}
+	}
+
+	glm::mat3 InverseInertia(const ConvexShape& shape, const float inverseMass)
+	{
+		glm::vec3 extents = shape.halfExtents;
+		if (shape.type == ShapeType::HULL)
+		{
+			glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+			for (size_t i = 0; i < shape.pointCount; i++)
+			{
+				min = glm::min(min, shape.points[i] * shape.scale);
+				max = glm::max(max, shape.points[i] * shape.scale);
+			}
+			extents = 0.5f * (max - min);
+		}
+
+		// Box of mass m and half extents h has inertia m / 3 * (h.y^2 + h.z^2) around x
+		const glm::vec3 squared = extents * extents;
+		const glm::vec3 sums(squared.y + squared.z, squared.x + squared.z, squared.x + squared.y);
+		glm::vec3 local(0.0f);
+		for (int axis = 0; axis < 3; axis++)
+			local[axis] = sums[axis] > 0.0f ? 3.0f * inverseMass / sums[axis] : 0.0f;
+
+		return shape.rotation * glm::mat3(local.x, 0.0f, 0.0f, 0.0f, local.y, 0.0f, 0.0f, 0.0f, local.z) * glm::transpose(shape.rotation);
+	}
+
+	void ContactSolver::Vectors::Resize(const size_t size)
+	{
+		x.resize(size);
+		y.resize(size);
+		z.resize(size);
+	}
+
+	void ContactSolver::Vectors::Set(const size_t i, const glm::vec3& v)
+	{
+		x[i] = v.x;
+		y[i] = v.y;
+		z[i] = v.z;
+	}
+
+	void ContactSolver::Row::Resize(const size_t size)
+	{
+		crossA.Resize(size);
+		crossB.Resize(size);
+		angularA.Resize(size);
+		angularB.Resize(size);
+		mass.resize(size);
+		impulse.resize(size);
+	}
+
+	uint32_t ContactSolver::AddBody(const glm::vec3& position, const glm::vec3& linearVelocity, const glm::vec3& angularVelocity,
+	                                const float inverseMass, const glm::mat3& inverseInertia)
+	{
+		const auto index = static_cast<uint32_t>(mInverseMasses.size());
+		mPositions.x.push_back(position.x);
+		mPositions.y.push_back(position.y);
+		mPositions.z.push_back(position.z);
+		mLinearVelocities.x.push_back(linearVelocity.x);
+		mLinearVelocities.y.push_back(linearVelocity.y);
+		mLinearVelocities.z.push_back(linearVelocity.z);
+		mAngularVelocities.x.push_back(angularVelocity.x);
+		mAngularVelocities.y.push_back(angularVelocity.y);
+		mAngularVelocities.z.push_back(angularVelocity.z);
+		mInverseMasses.push_back(std::max(inverseMass, 0.0f));
+		mInverseInertias.push_back(inverseMass > 0.0f ? inverseInertia : glm::mat3(0.0f));
+		return index;
+	}
+
+	void ContactSolver::AddManifold(ContactManifold& manifold, const uint32_t a, const uint32_t b, const float friction)
+	{
+		mManifolds.push_back(&manifold);
+		mManifoldBodies.emplace_back(a, b);
+		mManifoldFrictions.push_back(std::max(friction, 0.0f));
+	}
+
+	glm::vec3 ContactSolver::GetLinearVelocity(const uint32_t body) const
+	{
+		return mLinearVelocities.Get(body);
+	}
+
+	glm::vec3 ContactSolver::GetAngularVelocity(const uint32_t body) const
+	{
+		return mAngularVelocities.Get(body);
+	}
+
+	void ContactSolver::Clear()
+	{
+		mPositions.Resize(0);
+		mLinearVelocities.Resize(0);
+		mAngularVelocities.Resize(0);
+		mInverseMasses.clear();
+		mInverseInertias.clear();
+		mManifolds.clear();
+		mManifoldBodies.clear();
+		mManifoldFrictions.clear();
+	}
+
+	void ContactSolver::Solve(const float dt)
+	{
+		if (mManifolds.empty() || dt <= 0.0f) return;
+
+		Color();
+		Prepare(dt);
+		WarmStart();
+		for (unsigned int iteration = 0; iteration < mIterations; iteration++)
+		{
+			for (const auto& [begin, end] : mBatches)
+				SolveBatch(begin, end, false);
+		}
+	}
+
+	void ContactSolver::Relax()
+	{
+		if (mManifolds.empty()) return;
+
+		for (unsigned int iteration = 0; iteration < mRelaxIterations; iteration++)
+		{
+			for (const auto& [begin, end] : mBatches)
+				SolveBatch(begin, end, true);
+		}
+		StoreImpulses();
+	}
+
+	void ContactSolver::Color()
+	{
+		const size_t count = mManifolds.size();
+
+		// Bit c is set once a body has a manifold of color c, bodies that can't move never block a color
+		std::vector<uint32_t> bodyColors(mInverseMasses.size(), 0);
+		std::vector<uint32_t> colors(count);
+		std::vector<size_t> colorStarts(MAX_COLORS + 2, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			const auto [a, b] = mManifoldBodies[i];
+			const bool movableA = mInverseMasses[a] > 0.0f;
+			const bool movableB = mInverseMasses[b] > 0.0f;
+			const uint32_t used = (movableA ? bodyColors[a] : 0) | (movableB ? bodyColors[b] : 0);
+
+			uint32_t color = 0;
+			while (color < MAX_COLORS && (used >> color & 1u)) color++;
+			if (color < MAX_COLORS)
+			{
+				if (movableA) bodyColors[a] |= 1u << color;
+				if (movableB) bodyColors[b] |= 1u << color;
+			}
+			colors[i] = color;
+			colorStarts[color + 1]++;
+		}
+
+		// Counting sort by color, manifolds that fit no color come last
+		for (size_t color = 0; color <= MAX_COLORS; color++)
+			colorStarts[color + 1] += colorStarts[color];
+		mOrder.resize(count);
+		std::vector<size_t> next(colorStarts.begin(), colorStarts.end() - 1);
+		for (size_t i = 0; i < count; i++)
+			mOrder[next[colors[i]]++] = static_cast<uint32_t>(i);
+
+		mBatches.clear();
+		for (size_t color = 0; color < MAX_COLORS; color++)
+		{
+			if (colorStarts[color] < colorStarts[color + 1])
+				mBatches.emplace_back(colorStarts[color], colorStarts[color + 1]);
+		}
+		for (size_t i = colorStarts[MAX_COLORS]; i < count; i++)
+			mBatches.emplace_back(i, i + 1);
+	}
+
+	void ContactSolver::Prepare(const float dt)
+	{
+		const size_t count = mOrder.size();
+		const size_t rowSize = count * MAX_MANIFOLD_POINTS;
+
+		mBodyA.resize(count);
+		mBodyB.resize(count);
+		mInverseMassA.resize(count);
+		mInverseMassB.resize(count);
+		mFriction.resize(count);
+		mNormal.Resize(count);
+		mTangents[0].Resize(count);
+		mTangents[1].Resize(count);
+		mNormalRow.Resize(rowSize);
+		mTangentRows[0].Resize(rowSize);
+		mTangentRows[1].Resize(rowSize);
+		mBias.resize(rowSize);
+		mMassScale.resize(rowSize);
+		mImpulseScale.resize(rowSize);
+
+		// Spring and damper of the contacts, as scales of the rigid impulse
+		const float hertz = std::min(CONTACT_HERTZ, 0.5f / dt);
+		const float omega = 2.0f * glm::pi<float>() * hertz;
+		const float a1 = 2.0f * CONTACT_DAMPING_RATIO + dt * omega;
+		const float a2 = dt * omega * a1;
+		const float a3 = 1.0f / (1.0f + a2);
+		const float biasRate = omega / a1;
+		mLinearA.Resize(count);
+		mAngularA.Resize(count);
+		mLinearB.Resize(count);
+		mAngularB.Resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const ContactManifold& manifold = *mManifolds[mOrder[i]];
+			const auto [a, b] = mManifoldBodies[mOrder[i]];
+			const glm::vec3 positionA = mPositions.Get(a);
+			const glm::vec3 positionB = mPositions.Get(b);
+			const glm::mat3& inertiaA = mInverseInertias[a];
+			const glm::mat3& inertiaB = mInverseInertias[b];
+
+			mBodyA[i] = a;
+			mBodyB[i] = b;
+			mInverseMassA[i] = mInverseMasses[a];
+			mInverseMassB[i] = mInverseMasses[b];
+			mFriction[i] = mManifoldFrictions[mOrder[i]];
+
+			// Tangents only depend on the normal, so impulses kept along them still line up next step
+			const glm::vec3 normal = manifold.normal;
+			const glm::vec3 tangents[2] = { Perpendicular(normal), glm::cross(normal, Perpendicular(normal)) };
+			mNormal.Set(i, normal);
+			mTangents[0].Set(i, tangents[0]);
+			mTangents[1].Set(i, tangents[1]);
+
+			for (size_t slot = 0; slot < MAX_MANIFOLD_POINTS; slot++)
+			{
+				const size_t r = slot * count + i;
+				if (slot >= manifold.pointCount)
+				{
+					for (Row* row : { &mNormalRow, &mTangentRows[0], &mTangentRows[1] })
+					{
+						row->crossA.Set(r, glm::vec3(0.0f));
+						row->crossB.Set(r, glm::vec3(0.0f));
+						row->angularA.Set(r, glm::vec3(0.0f));
+						row->angularB.Set(r, glm::vec3(0.0f));
+						row->mass[r] = 0.0f;
+						row->impulse[r] = 0.0f;
+					}
+					mBias[r] = 0.0f;
+					mMassScale[r] = 1.0f;
+					mImpulseScale[r] = 0.0f;
+					continue;
+				}
+
+				const ContactPoint& point = manifold.points[slot];
+				const glm::vec3 offsetA = point.position - positionA;
+				const glm::vec3 offsetB = point.position - positionB;
+				const auto prepareRow = [&](Row& row, const glm::vec3& direction, const float impulse)
+				{
+					const glm::vec3 crossA = glm::cross(offsetA, direction);
+					const glm::vec3 crossB = glm::cross(offsetB, direction);
+					const glm::vec3 angularA = inertiaA * crossA;
+					const glm::vec3 angularB = inertiaB * crossB;
+					const float k = mInverseMasses[a] + mInverseMasses[b] + glm::dot(crossA, angularA) + glm::dot(crossB, angularB);
+
+					row.crossA.Set(r, crossA);
+					row.crossB.Set(r, crossB);
+					row.angularA.Set(r, angularA);
+					row.angularB.Set(r, angularB);
+					row.mass[r] = k > 0.0f ? 1.0f / k : 0.0f;
+					row.impulse[r] = impulse;
+				};
+				prepareRow(mNormalRow, normal, point.normalImpulse);
+				prepareRow(mTangentRows[0], tangents[0], point.tangentImpulse[0]);
+				prepareRow(mTangentRows[1], tangents[1], point.tangentImpulse[1]);
+
+				// A kept point that has separated lets the bodies close the gap within a step
+				if (point.depth > 0.0f)
+				{
+					mBias[r] = std::min(biasRate * point.depth, MAX_PUSH_VELOCITY);
+					mMassScale[r] = a2 * a3;
+					mImpulseScale[r] = a3;
+				}
+				else
+				{
+					mBias[r] = point.depth / dt;
+					mMassScale[r] = 1.0f;
+					mImpulseScale[r] = 0.0f;
+				}
+			}
+		}
+	}
+
+	void ContactSolver::WarmStart()
+	{
+		const size_t count = mOrder.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint32_t a = mBodyA[i];
+			const uint32_t b = mBodyB[i];
+			glm::vec3 linearA = mLinearVelocities.Get(a), angularA = mAngularVelocities.Get(a);
+			glm::vec3 linearB = mLinearVelocities.Get(b), angularB = mAngularVelocities.Get(b);
+
+			for (size_t slot = 0; slot < MAX_MANIFOLD_POINTS; slot++)
+			{
+				const size_t r = slot * count + i;
+				glm::vec3 impulse = mNormalRow.impulse[r] * mNormal.Get(i);
+				glm::vec3 spinA = mNormalRow.impulse[r] * mNormalRow.angularA.Get(r);
+				glm::vec3 spinB = mNormalRow.impulse[r] * mNormalRow.angularB.Get(r);
+				for (int t = 0; t < 2; t++)
+				{
+					const Row& row = mTangentRows[t];
+					impulse += row.impulse[r] * mTangents[t].Get(i);
+					spinA += row.impulse[r] * row.angularA.Get(r);
+					spinB += row.impulse[r] * row.angularB.Get(r);
+				}
+
+				linearA -= mInverseMassA[i] * impulse;
+				angularA -= spinA;
+				linearB += mInverseMassB[i] * impulse;
+				angularB += spinB;
+			}
+
+			mLinearVelocities.Set(a, linearA);
+			mAngularVelocities.Set(a, angularA);
+			mLinearVelocities.Set(b, linearB);
+			mAngularVelocities.Set(b, angularB);
+		}
+	}
+
+	template <bool FRICTION>
+	void ContactSolver::SolveRow(Row& row, const Vectors& direction, const size_t slot, const size_t begin, const size_t end, const bool relax)
+	{
+		// Lanes of a batch touch different bodies, restrict tells the compiler the arrays don't overlap either
+		const size_t offset = slot * mOrder.size();
+		float* __restrict impulse = row.impulse.data() + offset;
+		const float* __restrict mass = row.mass.data() + offset;
+		const float* __restrict crossAX = row.crossA.x.data() + offset;
+		const float* __restrict crossAY = row.crossA.y.data() + offset;
+		const float* __restrict crossAZ = row.crossA.z.data() + offset;
+		const float* __restrict crossBX = row.crossB.x.data() + offset;
+		const float* __restrict crossBY = row.crossB.y.data() + offset;
+		const float* __restrict crossBZ = row.crossB.z.data() + offset;
+		const float* __restrict angularAX = row.angularA.x.data() + offset;
+		const float* __restrict angularAY = row.angularA.y.data() + offset;
+		const float* __restrict angularAZ = row.angularA.z.data() + offset;
+		const float* __restrict angularBX = row.angularB.x.data() + offset;
+		const float* __restrict angularBY = row.angularB.y.data() + offset;
+		const float* __restrict angularBZ = row.angularB.z.data() + offset;
+		// Normal rows are pushed apart by the bias, friction rows are limited by the normal impulse of the same point
+		const float* __restrict limit = FRICTION ? mNormalRow.impulse.data() + offset : mBias.data() + offset;
+		const float* __restrict friction = mFriction.data();
+		const float* __restrict massScale = mMassScale.data() + offset;
+		const float* __restrict impulseScale = mImpulseScale.data() + offset;
+
+		const float* __restrict directionX = direction.x.data();
+		const float* __restrict directionY = direction.y.data();
+		const float* __restrict directionZ = direction.z.data();
+		const float* __restrict inverseMassA = mInverseMassA.data();
+		const float* __restrict inverseMassB = mInverseMassB.data();
+		float* __restrict linearAX = mLinearA.x.data();
+		float* __restrict linearAY = mLinearA.y.data();
+		float* __restrict linearAZ = mLinearA.z.data();
+		float* __restrict angularVelocityAX = mAngularA.x.data();
+		float* __restrict angularVelocityAY = mAngularA.y.data();
+		float* __restrict angularVelocityAZ = mAngularA.z.data();
+		float* __restrict linearBX = mLinearB.x.data();
+		float* __restrict linearBY = mLinearB.y.data();
+		float* __restrict linearBZ = mLinearB.z.data();
+		float* __restrict angularVelocityBX = mAngularB.x.data();
+		float* __restrict angularVelocityBY = mAngularB.y.data();
+		float* __restrict angularVelocityBZ = mAngularB.z.data();
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC ivdep
+#endif
+		for (size_t i = begin; i < end; i++)
+		{
+			// Velocity of b's contact point relative to a's, along the direction
+			const float relative = (linearBX[i] - linearAX[i]) * directionX[i]
+				+ (linearBY[i] - linearAY[i]) * directionY[i]
+				+ (linearBZ[i] - linearAZ[i]) * directionZ[i]
+				+ angularVelocityBX[i] * crossBX[i] + angularVelocityBY[i] * crossBY[i] + angularVelocityBZ[i] * crossBZ[i]
+				- angularVelocityAX[i] * crossAX[i] - angularVelocityAY[i] * crossAY[i] - angularVelocityAZ[i] * crossAZ[i];
+
+			// Clamping the accumulated impulse instead of each step's lets later iterations take back what earlier ones overshot
+			const float old = impulse[i];
+			float updated;
+			if constexpr (FRICTION)
+			{
+				const float maxFriction = friction[i] * limit[i];
+				updated = std::min(std::max(old - mass[i] * relative, -maxFriction), maxFriction);
+			}
+			else
+			{
+				// Relaxing solves rigidly without pushing apart, removing the velocity the spring added once it has moved the bodies
+				const float bias = relax ? std::min(limit[i], 0.0f) : limit[i];
+				const float scale = relax ? 1.0f : massScale[i];
+				const float keep = relax ? 0.0f : impulseScale[i];
+				updated = std::max(old + scale * mass[i] * (bias - relative) - keep * old, 0.0f);
+			}
+			impulse[i] = updated;
+
+			const float lambda = updated - old;
+			const float linearChangeA = lambda * inverseMassA[i];
+			const float linearChangeB = lambda * inverseMassB[i];
+			linearAX[i] -= linearChangeA * directionX[i];
+			linearAY[i] -= linearChangeA * directionY[i];
+			linearAZ[i] -= linearChangeA * directionZ[i];
+			linearBX[i] += linearChangeB * directionX[i];
+			linearBY[i] += linearChangeB * directionY[i];
+			linearBZ[i] += linearChangeB * directionZ[i];
+			angularVelocityAX[i] -= lambda * angularAX[i];
+			angularVelocityAY[i] -= lambda * angularAY[i];
+			angularVelocityAZ[i] -= lambda * angularAZ[i];
+			angularVelocityBX[i] += lambda * angularBX[i];
+			angularVelocityBY[i] += lambda * angularBY[i];
+			angularVelocityBZ[i] += lambda * angularBZ[i];
+		}
+	}
+
+	void ContactSolver::SolveBatch(const size_t begin, const size_t end, const bool relax)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			mLinearA.Set(i, mLinearVelocities.Get(mBodyA[i]));
+			mAngularA.Set(i, mAngularVelocities.Get(mBodyA[i]));
+			mLinearB.Set(i, mLinearVelocities.Get(mBodyB[i]));
+			mAngularB.Set(i, mAngularVelocities.Get(mBodyB[i]));
+		}
+
+		// Friction first, so the normal impulses, which matter more for stacking, get the last word
+		for (size_t slot = 0; slot < MAX_MANIFOLD_POINTS; slot++)
+		{
+			SolveRow<true>(mTangentRows[0], mTangents[0], slot, begin, end, relax);
+			SolveRow<true>(mTangentRows[1], mTangents[1], slot, begin, end, relax);
+		}
+		for (size_t slot = 0; slot < MAX_MANIFOLD_POINTS; slot++)
+			SolveRow<false>(mNormalRow, mNormal, slot, begin, end, relax);
+
+		// Bodies that can't move are never changed, so lanes sharing one write back the same velocity
+		for (size_t i = begin; i < end; i++)
+		{
+			mLinearVelocities.Set(mBodyA[i], mLinearA.Get(i));
+			mAngularVelocities.Set(mBodyA[i], mAngularA.Get(i));
+			mLinearVelocities.Set(mBodyB[i], mLinearB.Get(i));
+			mAngularVelocities.Set(mBodyB[i], mAngularB.Get(i));
+		}
+	}
+
+	void ContactSolver::StoreImpulses()
+	{
+		const size_t count = mOrder.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			ContactManifold& manifold = *mManifolds[mOrder[i]];
+			for (size_t slot = 0; slot < manifold.pointCount; slot++)
+			{
+				const size_t r = slot * count + i;
+				manifold.points[slot].normalImpulse = mNormalRow.impulse[r];
+				manifold.points[slot].tangentImpulse[0] = mTangentRows[0].impulse[r];
+				manifold.points[slot].tangentImpulse[1] = mTangentRows[1].impulse[r];
+			}
+		}
+	}
+}
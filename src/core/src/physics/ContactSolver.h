@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Narrowphase.h"
+
+// Sequential impulse solver for the manifolds the narrowphase finds, with friction and warm starting
+// Manifolds are split into colors that share no movable body, a color's manifolds are then solved side by side
+// from arrays of each value, so the inner loops vectorise
+namespace Physics
+{
+	// World space inverse inertia of a shape with uniform density, hulls use the inertia of their local bounds
+	glm::mat3 InverseInertia(const ConvexShape& shape, float inverseMass);
+
+	class ContactSolver
+	{
+	public:
+		// Penetration is pushed out by a damped spring instead of a fraction per step, so stacks don't gain energy
+		// The spring is softened for steps too long to resolve it
+		static constexpr float CONTACT_HERTZ = 30.0f;
+		static constexpr float CONTACT_DAMPING_RATIO = 10.0f;
+		// Fastest penetrating bodies are pushed apart, so deep penetration doesn't launch them
+		static constexpr float MAX_PUSH_VELOCITY = 3.0f;
+
+		void SetIterations(unsigned int iterations) { mIterations = iterations; }
+		unsigned int GetIterations() const { return mIterations; }
+		void SetRelaxIterations(unsigned int iterations) { mRelaxIterations = iterations; }
+
+		// Returns the body's index, a body with zero inverse mass is never moved
+		uint32_t AddBody(const glm::vec3& position, const glm::vec3& linearVelocity, const glm::vec3& angularVelocity,
+		                 float inverseMass, const glm::mat3& inverseInertia);
+		// a and b are the indices AddBody returned for the manifold's entities
+		// The manifold has to outlive Relax, its impulses warm start the solver and are written back once relaxed
+		void AddManifold(ContactManifold& manifold, uint32_t a, uint32_t b, float friction);
+
+		// Changes bodies' velocities so their contacts stop approaching and their penetration shrinks
+		// Bodies should be moved with these velocities before calling Relax
+		void Solve(float dt);
+		// Takes back the velocity that pushed penetrating bodies apart, so it isn't kept as energy, and stores impulses in the manifolds
+		void Relax();
+
+		glm::vec3 GetLinearVelocity(uint32_t body) const;
+		glm::vec3 GetAngularVelocity(uint32_t body) const;
+
+		void Clear();
+
+	private:
+		// Colors a manifold can be put in, manifolds that fit none are solved one at a time
+		static constexpr unsigned int MAX_COLORS = 32;
+
+		// Arrays of each component of some vectors
+		struct Vectors
+		{
+			std::vector<float> x, y, z;
+
+			void Resize(size_t size);
+			void Set(size_t i, const glm::vec3& v);
+			glm::vec3 Get(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+		};
+
+		// One direction of every contact point
+		// Points are stored by slot, slot k of the manifold solved at position i is at k * manifold count + i
+		struct Row
+		{
+			// Contact offsets from each body's center, crossed with the direction
+			Vectors crossA, crossB;
+			// Angular velocity change of each body per unit of impulse
+			Vectors angularA, angularB;
+			// Zero for slots past a manifold's point count, so they never apply an impulse
+			std::vector<float> mass;
+			std::vector<float> impulse;
+
+			void Resize(size_t size);
+		};
+
+		unsigned int mIterations = 10;
+		unsigned int mRelaxIterations = 2;
+
+		Vectors mPositions;
+		Vectors mLinearVelocities;
+		Vectors mAngularVelocities;
+		std::vector<float> mInverseMasses;
+		std::vector<glm::mat3> mInverseInertias;
+
+		std::vector<ContactManifold*> mManifolds;
+		std::vector<std::pair<uint32_t, uint32_t>> mManifoldBodies;
+		std::vector<float> mManifoldFrictions;
+
+		// Data of each manifold, in solving order
+		std::vector<uint32_t> mOrder;
+		std::vector<uint32_t> mBodyA, mBodyB;
+		std::vector<float> mInverseMassA, mInverseMassB;
+		std::vector<float> mFriction;
+		Vectors mNormal;
+		Vectors mTangents[2];
+		// Ranges of mOrder that share no movable body
+		std::vector<std::pair<size_t, size_t>> mBatches;
+
+		Row mNormalRow;
+		Row mTangentRows[2];
+		// Normal velocity the contact is pushed apart with, negative when the points are still apart
+		std::vector<float> mBias;
+		// Soften the normal impulse of penetrating points, one and zero otherwise
+		std::vector<float> mMassScale;
+		std::vector<float> mImpulseScale;
+
+		// Velocities of a batch's bodies, by position in mOrder
+		Vectors mLinearA, mAngularA, mLinearB, mAngularB;
+
+		// Sorts manifolds by color into batches
+		void Color();
+		void Prepare(float dt);
+		void WarmStart();
+		// Applies one slot's impulses along a row for a batch's manifolds
+		template <bool FRICTION>
+		void SolveRow(Row& row, const Vectors& direction, size_t slot, size_t begin, size_t end, bool relax);
+		// Relaxing drops the push out of penetrating points but still lets a gap close
+		void SolveBatch(size_t begin, size_t end, bool relax);
+		void StoreImpulses();
+	};
+}
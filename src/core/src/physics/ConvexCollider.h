@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+
+#include "../components/Collider.h"
+namespace Components
+{
+	struct BoxCollider: Collider
+	{
+		// Half the box's size along each of the body's local axes, before the transform's scale
+		glm::vec3 halfExtents = glm::vec3(0.5f);
+	};
+
+	struct ConvexCollider: Collider
+	{
+		// Points of a convex hull in the body's local space, only the extreme ones matter so any point cloud works
+		std::vector<glm::vec3> points;
+	};
+}
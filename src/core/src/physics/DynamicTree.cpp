@@ -1,11 +1,16 @@
 #include "DynamicTree.h"
 
+#include <algorithm>
+#include <queue>
+
+#include "math/Intersect.h"
 #include "utils/Logger.h"
+#include "utils/TaskScheduler.h"
 #include "../core/GlobalTypes.h"
 
 namespace Physics
 {
-    DynamicBBTree::DynamicBBTree(const size_t initialCapacity)
+    DynamicBBTree::DynamicBBTree(const size_t initialCapacity, const bool rebalance) : mRebalance(rebalance)
     {
         rootIndex = NULL_NODE;
         nodeCount = 0;
@@ -15,12 +20,187 @@ namespace Physics
     }
 
 
-    void DynamicBBTree::InsertEntity(Entity entity, BoundingBox box)
+    void DynamicBBTree::Build(const std::vector<std::pair<Entity, BoundingBox>>& allProxies)
+    {
+        // Clear previous contents
+        mNodes.clear();
+        nodeCapacity = 0;
+        nodeCount = 0;
+        rootIndex = NULL_NODE;
+        mFreeList = std::stack<size_t>();
+        nodeIdxToEntityMap.clear();
+        entityToNodeIdxMap.clear();
+
+        // An entity can only own one leaf, so only its first proxy is built
+        std::vector<std::pair<Entity, BoundingBox>> proxies;
+        proxies.reserve(allProxies.size());
+        entityToNodeIdxMap.reserve(allProxies.size());
+        for (const auto& proxy : allProxies)
+        {
+            if (entityToNodeIdxMap.emplace(proxy.first, proxies.size()).second)
+                proxies.push_back(proxy);
+            else
+                LOG(LOG_ERROR) << "Dynamic Tree: Entity " << proxy.first << " added to build more than once, dropping the duplicate.\n";
+        }
+
+        if (proxies.empty())
+        {
+            ExpandCapacity(1);
+            return;
+        }
+
+        const size_t leafCount = proxies.size();
+        ExpandCapacity(leafCount * 2 - 1);
+        nodeCount = leafCount * 2 - 1;
+
+        std::vector<size_t> order(leafCount);
+        std::vector<glm::vec3> centroids(leafCount);
+        for (size_t i = 0; i < leafCount; i++)
+        {
+            order[i] = i;
+            centroids[i] = (proxies[i].second.min + proxies[i].second.max) * 0.5f;
+        }
+
+        std::vector<size_t> leafNodes(leafCount);
+        BuildRange(0, NULL_NODE, order, 0, leafCount, proxies, centroids, leafNodes);
+        rootIndex = 0;
+
+        nodeIdxToEntityMap.reserve(leafCount);
+        for (size_t i = 0; i < leafCount; i++)
+        {
+            entityToNodeIdxMap[proxies[i].first] = leafNodes[i];
+            nodeIdxToEntityMap.emplace(leafNodes[i], proxies[i].first);
+        }
+    }
+
+
+    void DynamicBBTree::BuildRange(const size_t nodeIndex, const size_t parentIndex, std::vector<size_t>& order,
+                                   const size_t begin, const size_t end,
+                                   const std::vector<std::pair<Entity, BoundingBox>>& proxies,
+                                   const std::vector<glm::vec3>& centroids, std::vector<size_t>& leafNodes)
+    {
+        constexpr unsigned int BUILD_BINS = 16;
+        // Subtrees smaller than this aren't worth a task
+        constexpr size_t PARALLEL_PROXY_CUTOFF = 1024;
+
+        Node& node = mNodes[nodeIndex];
+        node.parent = parentIndex;
+
+        if (end - begin == 1)
+        {
+            node.box = proxies[order[begin]].second;
+            node.box.UpdateSurfaceArea();
+            node.height = 0;
+            node.category = DEFAULT_CATEGORY;
+            node.mask = ALL_CATEGORIES;
+            node.left = NULL_NODE;
+            node.right = NULL_NODE;
+            leafNodes[order[begin]] = nodeIndex;
+            return;
+        }
+
+        BoundingBox centroidBox;
+        for (size_t i = begin; i < end; i++)
+            centroidBox.IncludePoint(centroids[order[i]]);
+
+        // Binned SAH over proxy centroids
+        float bestCost = FLT_MAX;
+        unsigned int bestAxis = 0;
+        unsigned int bestSplit = 0;
+        for (unsigned int axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+            if (extent <= 0.0f) continue;
+            const float scale = static_cast<float>(BUILD_BINS) / extent;
+
+            BoundingBox binBoxes[BUILD_BINS];
+            size_t binCounts[BUILD_BINS] = {};
+            for (size_t i = begin; i < end; i++)
+            {
+                const unsigned int bin = std::min(BUILD_BINS - 1,
+                    static_cast<unsigned int>((centroids[order[i]][axis] - centroidBox.min[axis]) * scale));
+                binCounts[bin]++;
+                binBoxes[bin].Merge(proxies[order[i]].second);
+            }
+
+            // Sweep from the right to get the area of every right side
+            float rightArea[BUILD_BINS];
+            BoundingBox rightBox;
+            for (unsigned int i = BUILD_BINS - 1; i > 0; i--)
+            {
+                if (binCounts[i] > 0) rightBox.Merge(binBoxes[i]);
+                rightArea[i] = rightBox.surfaceArea;
+            }
+
+            BoundingBox leftBox;
+            size_t leftCount = 0;
+            for (unsigned int i = 0; i < BUILD_BINS - 1; i++)
+            {
+                if (binCounts[i] > 0) leftBox.Merge(binBoxes[i]);
+                leftCount += binCounts[i];
+                const size_t rightCount = (end - begin) - leftCount;
+                if (leftCount == 0 || rightCount == 0) continue;
+
+                const float cost = leftBox.surfaceArea * static_cast<float>(leftCount) +
+                                   rightArea[i + 1] * static_cast<float>(rightCount);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        size_t mid;
+        if (bestCost < FLT_MAX)
+        {
+            const float scale = static_cast<float>(BUILD_BINS) / (centroidBox.max[bestAxis] - centroidBox.min[bestAxis]);
+            mid = std::partition(order.begin() + begin, order.begin() + end, [&](const size_t proxy)
+            {
+                const unsigned int bin = std::min(BUILD_BINS - 1,
+                    static_cast<unsigned int>((centroids[proxy][bestAxis] - centroidBox.min[bestAxis]) * scale));
+                return bin <= bestSplit;
+            }) - order.begin();
+        }
+        else
+        {
+            // All centroids are in the same spot, so any split is as good as another
+            mid = begin + (end - begin) / 2;
+        }
+
+        const size_t leftIndex = nodeIndex + 1;
+        const size_t rightIndex = nodeIndex + 2 * (mid - begin);
+
+        if (end - begin >= PARALLEL_PROXY_CUTOFF)
+        {
+            Utils::TaskGroup group;
+            group.Run([&, leftIndex, mid] {
+                BuildRange(leftIndex, nodeIndex, order, begin, mid, proxies, centroids, leafNodes);
+            });
+            BuildRange(rightIndex, nodeIndex, order, mid, end, proxies, centroids, leafNodes);
+            group.Wait();
+        }
+        else
+        {
+            BuildRange(leftIndex, nodeIndex, order, begin, mid, proxies, centroids, leafNodes);
+            BuildRange(rightIndex, nodeIndex, order, mid, end, proxies, centroids, leafNodes);
+        }
+
+        node.left = leftIndex;
+        node.right = rightIndex;
+        RefitNode(nodeIndex);
+    }
+
+
+    void DynamicBBTree::InsertEntity(Entity entity, BoundingBox box, const uint32_t category, const uint32_t mask)
     {
         size_t newNodeIndex = AllocateNode();
 
         mNodes[newNodeIndex].box = box;
         mNodes[newNodeIndex].height = 0;
+        mNodes[newNodeIndex].category = category;
+        mNodes[newNodeIndex].mask = mask;
 
         {
             auto inserted = nodeIdxToEntityMap.emplace(newNodeIndex, entity);
@@ -75,6 +255,10 @@ namespace Physics
 
             // Set sibling to oldParent's parent
             mNodes[sibling].parent = grandfather;
+
+            // Shrink boxes and filters of the remaining ancestors
+            for (size_t iter = grandfather; iter != NULL_NODE; iter = mNodes[iter].parent)
+                RefitNode(iter);
         }
         else // If oldParent is root
         {
@@ -90,17 +274,58 @@ namespace Physics
 
     void DynamicBBTree::UpdateEntity(Entity entity, BoundingBox box)
     {
+        const Node& node = GetNode(entity);
+        const uint32_t category = node.category;
+        const uint32_t mask = node.mask;
         RemoveEntity(entity);
-        InsertEntity(entity, box);
+        InsertEntity(entity, box, category, mask);
     }
 
     void DynamicBBTree::UpdateEntity(Entity entity, glm::vec3 transform)
     {
-        BoundingBox box = GetNode(entity).box;
+        const Node& node = GetNode(entity);
+        BoundingBox box = node.box;
+        const uint32_t category = node.category;
+        const uint32_t mask = node.mask;
         box.max += transform;
         box.min += transform;
         RemoveEntity(entity);
-        InsertEntity(entity, box);
+        InsertEntity(entity, box, category, mask);
+    }
+
+
+    void DynamicBBTree::SetFilter(const Entity entity, const uint32_t category, const uint32_t mask)
+    {
+        const auto enIterator = entityToNodeIdxMap.find(entity);
+        if (enIterator == entityToNodeIdxMap.end())
+        {
+            LOG(LOG_ERROR) << "Dynamic Tree: Trying to set filter of entity " << entity << " not in map.\n";
+            return;
+        }
+
+        size_t iter = enIterator->second;
+        mNodes[iter].category = category;
+        mNodes[iter].mask = mask;
+
+        // Propagate the new bits up to the root
+        for (iter = mNodes[iter].parent; iter != NULL_NODE; iter = mNodes[iter].parent)
+            RefitNode(iter);
+    }
+
+
+    void DynamicBBTree::MoveEntity(const Entity entity, DynamicBBTree& destination)
+    {
+        const auto enIterator = entityToNodeIdxMap.find(entity);
+        if (enIterator == entityToNodeIdxMap.end())
+        {
+            LOG(LOG_ERROR) << "Dynamic Tree: Trying to move entity " << entity << " not in map.\n";
+            return;
+        }
+
+        // Copied, inserting can grow the node array if both trees are the same
+        const Node node = mNodes[enIterator->second];
+        destination.InsertEntity(entity, node.box, node.category, node.mask);
+        RemoveEntity(entity);
     }
 
 
@@ -192,14 +417,9 @@ namespace Physics
         size_t iter = mNodes[leafIndex].parent;
         while (iter != NULL_NODE)
         {
-            iter = Balance(iter);
-
-            size_t left = mNodes[iter].left;
-            size_t right = mNodes[iter].right;
-
-
-            mNodes[iter].height = std::max(mNodes[left].height, mNodes[right].height);
-            mNodes[iter].box.Merge(mNodes[left].box, mNodes[right].box);
+            if (mRebalance)
+                iter = Balance(iter);
+            RefitNode(iter);
 
             iter = mNodes[iter].parent;
         }
@@ -300,65 +520,80 @@ namespace Physics
     }
 
 
-    std::vector<Entity> DynamicBBTree::ComputeCollisionPairs()
+    std::vector<Entity> DynamicBBTree::ComputeCollisionPairs() const
     {
         std::vector<Entity> output;
-        std::stack<std::pair<size_t, size_t>> stack;
+        if (rootIndex == NULL_NODE) return output;
 
-        if (nodeCount <= 1) return output;
+        // Nodes whose own subtree still has to be tested against itself
+        std::stack<size_t> stack;
+        stack.push(rootIndex);
 
-        stack.emplace(mNodes[rootIndex].left, mNodes[rootIndex].right);
+        while (!stack.empty())
+        {
+            const size_t nodeIndex = stack.top();
+            stack.pop();
+
+            const auto& node = mNodes[nodeIndex];
+            // No leaf in this subtree can pair with another leaf in it
+            if (IsLeaf(nodeIndex) || (node.category & node.mask) == 0) continue;
+
+            stack.push(node.left);
+            stack.push(node.right);
+            CollideSubtrees(node.left, *this, node.right, output);
+        }
+        return output;
+    }
+
+
+    std::vector<Entity> DynamicBBTree::ComputeCollisionPairs(const DynamicBBTree& other) const
+    {
+        std::vector<Entity> output;
+        if (rootIndex == NULL_NODE || other.rootIndex == NULL_NODE) return output;
+
+        CollideSubtrees(rootIndex, other, other.rootIndex, output);
+        return output;
+    }
+
+
+    void DynamicBBTree::CollideSubtrees(const size_t a, const DynamicBBTree& other, const size_t b, std::vector<Entity>& output) const
+    {
+        std::stack<std::pair<size_t, size_t>> stack;
+        stack.emplace(a, b);
 
         while (!stack.empty())
         {
-            size_t n1_idx = stack.top().first;
-            size_t n2_idx = stack.top().second;
+            const auto [n1_idx, n2_idx] = stack.top();
+            stack.pop();
 
             const auto& n1 = mNodes[n1_idx];
-            const auto& n2 = mNodes[n2_idx];
-            stack.pop();
+            const auto& n2 = other.mNodes[n2_idx];
 
-            if (IsInternal(n1_idx) && IsInternal(n2_idx))
-            {
-                stack.emplace(n1.left, n1.right);
-                stack.emplace(n2.left, n2.right);
+            if ((n1.category & n2.mask) == 0 || (n2.category & n1.mask) == 0) continue;
+            if (!n1.box.IsColliding(n2.box)) continue;
 
-                if (n1.box.IsColliding(n2.box))
-                {
-                    stack.emplace(n1.left, n2.left);
-                    stack.emplace(n1.left, n2.right);
-                    stack.emplace(n1.right, n2.left);
-                    stack.emplace(n1.right, n2.right);
-                }
-            }
-            else if (IsInternal(n1_idx))
+            const bool n1Leaf = IsLeaf(n1_idx);
+            const bool n2Leaf = other.IsLeaf(n2_idx);
+            if (n1Leaf && n2Leaf)
             {
-                stack.emplace(n1.left, n1.right);
-                if (n1.box.IsColliding(n2.box))
-                {
-                    stack.emplace(n1.left, n2_idx);
-                    stack.emplace(n1.right, n2_idx);
-                }
+                output.emplace_back(GetObject(n1_idx));
+                output.emplace_back(other.GetObject(n2_idx));
             }
-            else if (IsInternal(n2_idx))
+            // Descend into the larger subtree
+            else if (n2Leaf || (!n1Leaf && n1.box.surfaceArea >= n2.box.surfaceArea))
             {
-                stack.emplace(n2.left, n2.right);
-                if (n1.box.IsColliding(n2.box))
-                {
-                    stack.emplace(n1_idx, n2.left);
-                    stack.emplace(n1_idx, n2.right);
-                }
+                stack.emplace(n1.left, n2_idx);
+                stack.emplace(n1.right, n2_idx);
             }
-            else if (n1.box.IsColliding(n2.box))
+            else
             {
-                output.emplace_back(GetObject(n1_idx));
-                output.emplace_back(GetObject(n2_idx));
+                stack.emplace(n1_idx, n2.left);
+                stack.emplace(n1_idx, n2.right);
             }
         }
-        return output;
     }
 
-    std::pair<std::vector<BoundingBox>, bool> DynamicBBTree::QueryRayCollisions(const Ray ray) const
+    std::pair<std::vector<BoundingBox>, bool> DynamicBBTree::QueryRayCollisions(const Ray ray, const uint32_t mask) const
     {
         std::stack<size_t> stack;
         std::vector<BoundingBox> boxes;
@@ -376,6 +611,8 @@ namespace Physics
             if (nodeIndex == NULL_NODE) continue;
 
             const auto& node = mNodes[nodeIndex];
+            if ((node.category & mask) == 0) continue;
+
             auto [t, colliding] = ray.IsColliding(node.box);
 
             if (!colliding) continue;
@@ -396,7 +633,7 @@ namespace Physics
         }
         return std::make_pair(boxes, bestEntity != UINT_MAX);
     }
-    std::pair<Entity, bool> DynamicBBTree::QueryRay(const Ray ray) const
+    std::pair<Entity, bool> DynamicBBTree::QueryRay(const Ray ray, const uint32_t mask) const
     {
         std::stack<size_t> stack;
 
@@ -413,6 +650,8 @@ namespace Physics
             if (nodeIndex == NULL_NODE) continue;
 
             const auto& node = mNodes[nodeIndex];
+            if ((node.category & mask) == 0) continue;
+
             auto [t, colliding] = ray.IsColliding(node.box);
 
             if (!colliding) continue;
@@ -436,6 +675,279 @@ namespace Physics
     }
 
 
+    std::pair<Entity, bool> DynamicBBTree::Raycast(const Ray& ray, float tMax,
+                                                   const std::function<std::pair<float, bool>(Entity, float)>& leafTest, const uint32_t mask) const
+    {
+        Entity bestEntity{};
+        bool hit = false;
+
+        if (rootIndex == NULL_NODE) return std::make_pair(bestEntity, hit);
+
+        // Returns the entry distance into a node
+        const auto nodeEntry = [&](const size_t nodeIndex)
+        {
+            if ((mNodes[nodeIndex].category & mask) == 0) return std::make_pair(FLT_MAX, false);
+            return Utils::RayBox(ray, mNodes[nodeIndex].box, tMax);
+        };
+
+        // Stores node index and entry distance
+        std::stack<std::pair<size_t, float>> stack;
+        {
+            const auto [t, colliding] = nodeEntry(rootIndex);
+            if (colliding) stack.emplace(rootIndex, t);
+        }
+
+        while (!stack.empty())
+        {
+            const auto [nodeIndex, tEntry] = stack.top();
+            stack.pop();
+
+            // A closer hit was found after this node was pushed
+            if (tEntry > tMax) continue;
+
+            const auto& node = mNodes[nodeIndex];
+            if (IsLeaf(nodeIndex))
+            {
+                const Entity entity = GetObject(nodeIndex);
+                const auto [t, colliding] = leafTest(entity, tMax);
+                if (colliding && t <= tMax)
+                {
+                    bestEntity = entity;
+                    tMax = t;
+                    hit = true;
+                }
+                continue;
+            }
+
+            auto [tLeft, hitLeft] = nodeEntry(node.left);
+            auto [tRight, hitRight] = nodeEntry(node.right);
+
+            // Push the farther child first so the closer one is visited first
+            if (hitLeft && hitRight)
+            {
+                if (tLeft < tRight)
+                {
+                    stack.emplace(node.right, tRight);
+                    stack.emplace(node.left, tLeft);
+                }
+                else
+                {
+                    stack.emplace(node.left, tLeft);
+                    stack.emplace(node.right, tRight);
+                }
+            }
+            else if (hitLeft) stack.emplace(node.left, tLeft);
+            else if (hitRight) stack.emplace(node.right, tRight);
+        }
+        return std::make_pair(bestEntity, hit);
+    }
+
+
+    std::vector<Entity> DynamicBBTree::QueryBox(const BoundingBox& box, const uint32_t mask) const
+    {
+        std::vector<Entity> output;
+        if (rootIndex == NULL_NODE) return output;
+
+        std::stack<size_t> stack;
+        stack.push(rootIndex);
+        while (!stack.empty())
+        {
+            const size_t nodeIndex = stack.top();
+            stack.pop();
+
+            const auto& node = mNodes[nodeIndex];
+            if ((node.category & mask) == 0 || !node.box.IsColliding(box)) continue;
+
+            if (IsLeaf(nodeIndex))
+            {
+                output.emplace_back(GetObject(nodeIndex));
+            }
+            else
+            {
+                stack.push(node.left);
+                stack.push(node.right);
+            }
+        }
+        return output;
+    }
+
+
+    std::vector<Entity> DynamicBBTree::QueryNearest(const glm::vec3 point, const size_t k, const uint32_t mask) const
+    {
+        std::vector<Entity> output;
+        if (rootIndex == NULL_NODE || k == 0 || (mNodes[rootIndex].category & mask) == 0) return output;
+
+        // Squared distance and node index
+        using DistanceNode = std::pair<float, size_t>;
+
+        // Nodes to visit, closest first
+        std::priority_queue<DistanceNode, std::vector<DistanceNode>, std::greater<>> queue;
+        // Best k leaves found so far, farthest on top so it can be replaced
+        std::priority_queue<DistanceNode> best;
+
+        queue.emplace(mNodes[rootIndex].box.DistanceSquared(point), rootIndex);
+        while (!queue.empty())
+        {
+            const auto [distance, nodeIndex] = queue.top();
+            queue.pop();
+
+            // Every remaining node is farther than all k leaves found
+            if (best.size() == k && distance >= best.top().first) break;
+
+            const auto& node = mNodes[nodeIndex];
+            if (IsLeaf(nodeIndex))
+            {
+                best.emplace(distance, nodeIndex);
+                if (best.size() > k) best.pop();
+                continue;
+            }
+
+            for (const size_t child : { node.left, node.right })
+            {
+                if ((mNodes[child].category & mask) == 0) continue;
+                const float childDistance = mNodes[child].box.DistanceSquared(point);
+                if (best.size() < k || childDistance < best.top().first)
+                    queue.emplace(childDistance, child);
+            }
+        }
+
+        output.resize(best.size());
+        for (size_t i = output.size(); i > 0; i--)
+        {
+            output[i - 1] = GetObject(best.top().second);
+            best.pop();
+        }
+        return output;
+    }
+
+
+    std::vector<Entity> DynamicBBTree::QueryRadius(const glm::vec3 point, const float radius, const uint32_t mask) const
+    {
+        std::vector<Entity> output;
+        if (rootIndex == NULL_NODE) return output;
+
+        const float radiusSquared = radius * radius;
+
+        std::stack<size_t> stack;
+        stack.push(rootIndex);
+        while (!stack.empty())
+        {
+            const size_t nodeIndex = stack.top();
+            stack.pop();
+
+            const auto& node = mNodes[nodeIndex];
+            if ((node.category & mask) == 0 || node.box.DistanceSquared(point) > radiusSquared) continue;
+
+            if (IsLeaf(nodeIndex))
+            {
+                output.emplace_back(GetObject(nodeIndex));
+            }
+            else
+            {
+                stack.push(node.left);
+                stack.push(node.right);
+            }
+        }
+        return output;
+    }
+
+
+    std::pair<CastHit, bool> DynamicBBTree::ShapeCast(const BoundingBox& box, const glm::vec3 displacement, const uint32_t mask) const
+    {
+        const glm::vec3 center = (box.min + box.max) * 0.5f;
+        const glm::vec3 halfExtents = (box.max - box.min) * 0.5f;
+
+        // Sweeping a box against a box is a segment against their minkowski sum
+        return CastTraverse(center, halfExtents, displacement, mask, [&](const BoundingBox& leafBox, const float tMax)
+        {
+            return Utils::SegmentBox(center, displacement,
+                                     BoundingBox(leafBox.min - halfExtents, leafBox.max + halfExtents), tMax);
+        });
+    }
+
+
+    std::pair<CastHit, bool> DynamicBBTree::SphereCast(const glm::vec3 center, const float radius, const glm::vec3 displacement, const uint32_t mask) const
+    {
+        return CastTraverse(center, glm::vec3(radius), displacement, mask, [&](const BoundingBox& leafBox, const float tMax)
+        {
+            return Utils::SweptSphereBox(center, radius, displacement, leafBox, tMax);
+        });
+    }
+
+
+    template <typename LeafTest>
+    std::pair<CastHit, bool> DynamicBBTree::CastTraverse(const glm::vec3 origin, const glm::vec3 halfExtents,
+                                                         const glm::vec3 displacement, const uint32_t mask, LeafTest leafTest) const
+    {
+        CastHit best{ Entity(), 1.0f };
+        bool hit = false;
+
+        if (rootIndex == NULL_NODE) return std::make_pair(best, hit);
+
+        // Box covering the whole sweep, cheap rejection before the segment test
+        BoundingBox sweptBox;
+        sweptBox.Merge(BoundingBox(origin - halfExtents, origin + halfExtents),
+                       BoundingBox(origin + displacement - halfExtents, origin + displacement + halfExtents));
+
+        // Returns the entry time into a node expanded by the shape's extents
+        const auto nodeEntry = [&](const size_t nodeIndex)
+        {
+            const auto& box = mNodes[nodeIndex].box;
+            if ((mNodes[nodeIndex].category & mask) == 0 || !sweptBox.IsColliding(box)) return std::make_pair(FLT_MAX, false);
+            return Utils::SegmentBox(origin, displacement, BoundingBox(box.min - halfExtents, box.max + halfExtents), best.toi);
+        };
+
+        // Stores node index and entry time
+        std::stack<std::pair<size_t, float>> stack;
+        {
+            const auto [t, colliding] = nodeEntry(rootIndex);
+            if (colliding) stack.emplace(rootIndex, t);
+        }
+
+        while (!stack.empty())
+        {
+            const auto [nodeIndex, tEntry] = stack.top();
+            stack.pop();
+
+            // A closer hit was found after this node was pushed
+            if (tEntry > best.toi) continue;
+
+            const auto& node = mNodes[nodeIndex];
+            if (IsLeaf(nodeIndex))
+            {
+                const auto [t, colliding] = leafTest(node.box, best.toi);
+                if (colliding && (!hit || t < best.toi))
+                {
+                    best = CastHit{ GetObject(nodeIndex), t };
+                    hit = true;
+                }
+                continue;
+            }
+
+            auto [tLeft, hitLeft] = nodeEntry(node.left);
+            auto [tRight, hitRight] = nodeEntry(node.right);
+
+            // Push the farther child first so the closer one is visited first
+            if (hitLeft && hitRight)
+            {
+                if (tLeft < tRight)
+                {
+                    stack.emplace(node.right, tRight);
+                    stack.emplace(node.left, tLeft);
+                }
+                else
+                {
+                    stack.emplace(node.left, tLeft);
+                    stack.emplace(node.right, tRight);
+                }
+            }
+            else if (hitLeft) stack.emplace(node.left, tLeft);
+            else if (hitRight) stack.emplace(node.right, tRight);
+        }
+        return std::make_pair(best, hit);
+    }
+
+
     void DynamicBBTree::ExpandCapacity(const size_t newNodeCapacity)
     {
         assert(newNodeCapacity > nodeCapacity);
@@ -508,8 +1020,8 @@ namespace Physics
                 mNodes[node].box.Merge(mNodes[left].box, mNodes[rightRight].box);
                 mNodes[right].box.Merge(mNodes[node].box, mNodes[rightLeft].box);
 
-                mNodes[node].height = std::max(mNodes[left].height, mNodes[rightRight].height);
-                mNodes[right].height = std::max(mNodes[node].height, mNodes[rightLeft].height);
+                mNodes[node].height = 1 + std::max(mNodes[left].height, mNodes[rightRight].height);
+                mNodes[right].height = 1 + std::max(mNodes[node].height, mNodes[rightLeft].height);
             }
             else
             {
@@ -521,9 +1033,11 @@ namespace Physics
                 mNodes[node].box.Merge(mNodes[left].box, mNodes[rightLeft].box);
                 mNodes[right].box.Merge(mNodes[node].box, mNodes[rightRight].box);
 
-                mNodes[node].height = std::max(mNodes[left].height, mNodes[rightLeft].height);
-                mNodes[right].height = std::max(mNodes[node].height, mNodes[rightRight].height);
+                mNodes[node].height = 1 + std::max(mNodes[left].height, mNodes[rightLeft].height);
+                mNodes[right].height = 1 + std::max(mNodes[node].height, mNodes[rightRight].height);
             }
+            RefitNode(node);
+            RefitNode(right);
             return right;
         }
 
@@ -562,8 +1076,8 @@ namespace Physics
                 mNodes[node].box.Merge(mNodes[right].box, mNodes[leftRight].box);
                 mNodes[left].box.Merge(mNodes[node].box, mNodes[leftLeft].box);
 
-                mNodes[node].height = std::max(mNodes[right].height, mNodes[leftRight].height);
-                mNodes[left].height = std::max(mNodes[node].height, mNodes[leftLeft].height);
+                mNodes[node].height = 1 + std::max(mNodes[right].height, mNodes[leftRight].height);
+                mNodes[left].height = 1 + std::max(mNodes[node].height, mNodes[leftLeft].height);
             }
             else
             {
@@ -573,9 +1087,11 @@ namespace Physics
                 mNodes[node].box.Merge(mNodes[right].box, mNodes[leftLeft].box);
                 mNodes[left].box.Merge(mNodes[node].box, mNodes[leftRight].box);
 
-                mNodes[node].height = std::max(mNodes[right].height, mNodes[leftLeft].height);
-                mNodes[left].height = std::max(mNodes[node].height, mNodes[leftRight].height);
+                mNodes[node].height = 1 + std::max(mNodes[right].height, mNodes[leftLeft].height);
+                mNodes[left].height = 1 + std::max(mNodes[node].height, mNodes[leftRight].height);
             }
+            RefitNode(node);
+            RefitNode(left);
 
             return left;
         }
@@ -584,6 +1100,19 @@ namespace Physics
     }
 
 
+    void DynamicBBTree::RefitNode(const size_t nodeIndex)
+    {
+        Node& node = mNodes[nodeIndex];
+        const Node& left = mNodes[node.left];
+        const Node& right = mNodes[node.right];
+
+        node.box.Merge(left.box, right.box);
+        node.height = 1 + std::max(left.height, right.height);
+        node.category = left.category | right.category;
+        node.mask = left.mask | right.mask;
+    }
+
+
     const BoundingBox& DynamicBBTree::GetBoundingBox(const Entity object) const
     {
         const auto enIterator = entityToNodeIdxMap.find(object);
@@ -609,7 +1138,7 @@ namespace Physics
     DynamicBBTree::Node& DynamicBBTree::GetNode(Entity entity)
     {
         const auto enIterator = entityToNodeIdxMap.find(entity);
-        if (enIterator != entityToNodeIdxMap.end())
+        if (enIterator == entityToNodeIdxMap.end())
         {
             LOG(LOG_ERROR) << "Dynamic Tree: Trying to find entity not in map\n";
             return mNodes[NULL_NODE];
@@ -625,5 +1154,7 @@ namespace Physics
         mNodes[nodeIndex].left = NULL_NODE;
         mNodes[nodeIndex].right = NULL_NODE;
         mNodes[nodeIndex].height = NULL_NODE;
+        mNodes[nodeIndex].category = 0;
+        mNodes[nodeIndex].mask = 0;
     }
 }
@@ -1,6 +1,8 @@
 #pragma once
+#include <functional>
 #include <vector>
 #include <stack>
+#include <unordered_map>
 
 #include "math/Ray.h"
 
@@ -8,6 +10,18 @@
 namespace Physics {
 	constexpr size_t NULL_NODE = 0xffffffff;
 
+	// Collision filter bits, two proxies only pair if each one's category is in the other's mask
+	constexpr uint32_t DEFAULT_CATEGORY = 0x1;
+	constexpr uint32_t ALL_CATEGORIES = 0xffffffff;
+
+	// Result of a shape cast
+	struct CastHit
+	{
+		Entity entity;
+		// Fraction of the displacement travelled before first contact, in [0, 1]
+		float toi;
+	};
+
 	// Algorithm adapted from Box2D's dynamic tree
 	class DynamicBBTree
 	{
@@ -15,6 +29,8 @@ namespace Physics {
 		{
 			BoundingBox box;
 			size_t height, parent, left, right;
+			// Internal nodes store the OR of their children's bits
+			uint32_t category, mask;
 		};
 
 	public:
@@ -30,17 +46,49 @@ namespace Physics {
 		// Stack of free nodes
 		std::stack<size_t> mFreeList;
 
-		explicit DynamicBBTree(size_t initialCapacity = 1);
+		// Trees that don't rebalance keep inserted leaves where they land, for leaves that never move
+		explicit DynamicBBTree(size_t initialCapacity = 1, bool rebalance = true);
+
+		// Replaces the contents of the tree with a binned SAH build over all proxies at once
+		// Much faster than inserting one by one, and gives a better tree
+		// Proxies of an entity already in proxies are dropped
+		void Build(const std::vector<std::pair<Entity, BoundingBox>>& proxies);
 
-		void InsertEntity(Entity entity, BoundingBox box);
+		void InsertEntity(Entity entity, BoundingBox box, uint32_t category = DEFAULT_CATEGORY, uint32_t mask = ALL_CATEGORIES);
 		void RemoveEntity(Entity entity);
 		void UpdateEntity(Entity entity, BoundingBox box);
 		void UpdateEntity(Entity entity, glm::vec3 transform);
-
-		// Uses TreeQuery to compute all box pairs
-		std::vector<Entity> ComputeCollisionPairs();
-		std::pair<std::vector<BoundingBox>, bool> QueryRayCollisions(Ray ray) const;
-		std::pair<Entity, bool> QueryRay(Ray ray) const;
+		void SetFilter(Entity entity, uint32_t category, uint32_t mask);
+		// Moves a leaf into another tree, keeping its box and filter
+		void MoveEntity(Entity entity, DynamicBBTree& destination);
+
+		// Computes all overlapping leaf pairs that pass the collision filter
+		// Output holds the two entities of each pair next to each other
+		std::vector<Entity> ComputeCollisionPairs() const;
+		// Computes overlapping pairs between this tree's leaves and other's, this tree's entity comes first
+		std::vector<Entity> ComputeCollisionPairs(const DynamicBBTree& other) const;
+		// Queries only consider leaves whose category is in mask
+		std::pair<std::vector<BoundingBox>, bool> QueryRayCollisions(Ray ray, uint32_t mask = ALL_CATEGORIES) const;
+		std::pair<Entity, bool> QueryRay(Ray ray, uint32_t mask = ALL_CATEGORIES) const;
+
+		// Casts a ray through the leaves closest first, for leaves holding finer shapes than their boxes
+		// leafTest(entity, tMax) returns the distance along the ray where it hits the leaf's shape, or false if it misses before tMax
+		// Returns the leaf with the closest hit
+		std::pair<Entity, bool> Raycast(const Ray& ray, float tMax, const std::function<std::pair<float, bool>(Entity, float)>& leafTest,
+		                                uint32_t mask = ALL_CATEGORIES) const;
+		// Returns all leaves whose bounding box overlaps box
+		std::vector<Entity> QueryBox(const BoundingBox& box, uint32_t mask = ALL_CATEGORIES) const;
+
+		// Returns up to k leaves closest to point, closest first
+		// Distance is measured to each leaf's bounding box
+		std::vector<Entity> QueryNearest(glm::vec3 point, size_t k, uint32_t mask = ALL_CATEGORIES) const;
+		// Returns all leaves whose bounding box is within radius of point
+		std::vector<Entity> QueryRadius(glm::vec3 point, float radius, uint32_t mask = ALL_CATEGORIES) const;
+
+		// Sweeps a shape along displacement and returns the earliest hit leaf
+		// Shapes already overlapping a leaf at the start return a toi of 0
+		std::pair<CastHit, bool> ShapeCast(const BoundingBox& box, glm::vec3 displacement, uint32_t mask = ALL_CATEGORIES) const;
+		std::pair<CastHit, bool> SphereCast(glm::vec3 center, float radius, glm::vec3 displacement, uint32_t mask = ALL_CATEGORIES) const;
 
 		// Returns reference to object's bounding box
 		const BoundingBox& GetBoundingBox(Entity object) const;
@@ -50,6 +98,9 @@ namespace Physics {
 		std::vector<BoundingBox> GetAllBoxes(const bool onlyLeaf) const;
 
 	private:
+		// Rotates subtrees on insertion to keep the tree's height low
+		bool mRebalance;
+
 		Node& GetNode(Entity entity);
 		
 		// Allocates a space for a new node
@@ -58,12 +109,23 @@ namespace Physics {
 		// Frees a space for a new node
 		void FreeNode(size_t nodeIndex);
 
+		// Recursively builds the proxies in order[begin, end) into the subtree rooted at nodeIndex
+		// A subtree of n leaves always takes 2n - 1 nodes, so children indices are known without synchronization
+		void BuildRange(size_t nodeIndex, size_t parentIndex, std::vector<size_t>& order, size_t begin, size_t end,
+		                const std::vector<std::pair<Entity, BoundingBox>>& proxies, const std::vector<glm::vec3>& centroids,
+		                std::vector<size_t>& leafNodes);
+
 		// Expand capacity
 		void ExpandCapacity(size_t newNodeCapacity);
 
 		// Inserts an allocated node into the tree
 		void InsertLeaf(size_t leafIndex);
 
+		// Traverses nodes touched by the swept shape, closest first, pruning with the best time of impact found
+		// Shape is treated as a box of halfExtents around origin for internal nodes, leafTest gives the exact leaf time
+		template <typename LeafTest>
+		std::pair<CastHit, bool> CastTraverse(glm::vec3 origin, glm::vec3 halfExtents, glm::vec3 displacement, uint32_t mask, LeafTest leafTest) const;
+
 		// Returns object given node index
 		Entity GetObject(size_t nodeIndex) const;
 
@@ -76,6 +138,12 @@ namespace Physics {
 		// Balance
 		size_t Balance(size_t node);
 
+		// Recomputes an internal node's box, height and filter from its children
+		void RefitNode(size_t nodeIndex);
+
+		// Appends all overlapping leaf pairs between subtree a of this tree and subtree b of other
+		void CollideSubtrees(size_t a, const DynamicBBTree& other, size_t b, std::vector<Entity>& output) const;
+
 		// Returns true if the node at the given index is a leaf node
 		bool IsLeaf(size_t index) const;
 
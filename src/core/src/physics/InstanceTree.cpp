@@ -0,0 +1,184 @@
+#include "InstanceTree.h"
+
+#include <algorithm>
+
+#include "math/Intersect.h"
+#include "utils/Logger.h"
+
+namespace Physics
+{
+	std::shared_ptr<StaticTree> TreeLibrary::Acquire(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices,
+	                                                 const std::string& cacheDirectory, const BuildOptions& options)
+	{
+		const uint64_t key = StaticTree::HashMesh(vertices, indices, options);
+
+		std::shared_ptr<SharedTree> shared;
+		std::shared_future<std::shared_ptr<SharedTree>> pending;
+		std::promise<std::shared_ptr<SharedTree>> built;
+		{
+			std::unique_lock<std::mutex> lock(entriesMutex);
+			const auto entry = mEntries.find(key);
+			if (entry != mEntries.end() && entry->second.vertexCount == vertices.size() && entry->second.indexCount == indices.size())
+			{
+				if (entry->second.pending.valid())
+					pending = entry->second.pending;
+				else
+					shared = entry->second.shared.lock();
+			}
+
+			if (!shared && !pending.valid())
+			{
+				// Expired entries are replaced by a placeholder, so acquires of the same mesh wait for this build
+				if (mEntries.size() >= mSweepSize)
+				{
+					for (auto it = mEntries.begin(); it != mEntries.end();)
+					{
+						if (!it->second.pending.valid() && it->second.shared.expired()) it = mEntries.erase(it);
+						else ++it;
+					}
+					mSweepSize = std::max<size_t>(64, mEntries.size() * 2);
+				}
+				mEntries[key] = Entry{ built.get_future().share(), {}, vertices.size(), indices.size() };
+			}
+		}
+
+		if (pending.valid())
+			shared = pending.get();
+		if (shared)
+		{
+			indices = shared->indices;
+			// Shares ownership of the whole entry, so the reordered indices live as long as the tree
+			return std::shared_ptr<StaticTree>(shared, &shared->tree);
+		}
+
+		// Built outside the lock, building waits on tasks that may acquire other trees themselves
+		shared = std::make_shared<SharedTree>();
+		if (cacheDirectory.empty())
+			shared->tree.CreateStaticTree(vertices, indices, options);
+		else
+			shared->tree.CreateStaticTree(vertices, indices, cacheDirectory, options);
+		shared->indices = indices;
+		built.set_value(shared);
+
+		{
+			std::unique_lock<std::mutex> lock(entriesMutex);
+			// The entry only holds the tree weakly once built, so it's freed with the last mesh using it
+			const auto entry = mEntries.find(key);
+			if (entry != mEntries.end() && entry->second.vertexCount == vertices.size() && entry->second.indexCount == indices.size())
+			{
+				entry->second.pending = {};
+				entry->second.shared = shared;
+			}
+		}
+		return std::shared_ptr<StaticTree>(shared, &shared->tree);
+	}
+
+
+	size_t TreeLibrary::Count()
+	{
+		std::unique_lock<std::mutex> lock(entriesMutex);
+		size_t count = 0;
+		for (const auto& [key, entry] : mEntries)
+			count += !entry.shared.expired();
+		return count;
+	}
+
+
+	void InstanceTree::AddInstance(const Entity entity, std::shared_ptr<const StaticTree> tree, const glm::mat4& modelMat,
+	                               const uint32_t category, const uint32_t mask)
+	{
+		if (!tree || tree->mNodes.empty())
+		{
+			LOG(LOG_ERROR) << "Can't add instance " << entity << " without a built tree.\n";
+			return;
+		}
+		if (mInstances.count(entity))
+		{
+			LOG(LOG_WARNING) << "Instance " << entity << " already exists, replacing it.\n";
+			RemoveInstance(entity);
+		}
+
+		const BoundingBox bounds = WorldBounds(*tree, modelMat);
+		mInstances[entity] = Instance{ std::move(tree), modelMat, glm::inverse(modelMat) };
+		mTopLevel.InsertEntity(entity, bounds, category, mask);
+	}
+
+
+	void InstanceTree::UpdateInstance(const Entity entity, const glm::mat4& modelMat)
+	{
+		const auto instance = mInstances.find(entity);
+		if (instance == mInstances.end())
+		{
+			LOG(LOG_WARNING) << "Can't update instance " << entity << ", it doesn't exist.\n";
+			return;
+		}
+
+		instance->second.modelMat = modelMat;
+		instance->second.inverseModelMat = glm::inverse(modelMat);
+		mTopLevel.UpdateEntity(entity, WorldBounds(*instance->second.tree, modelMat));
+	}
+
+
+	void InstanceTree::RemoveInstance(const Entity entity)
+	{
+		if (mInstances.erase(entity) == 0) return;
+		mTopLevel.RemoveEntity(entity);
+	}
+
+
+	const Instance* InstanceTree::GetInstance(const Entity entity) const
+	{
+		const auto instance = mInstances.find(entity);
+		return instance == mInstances.end() ? nullptr : &instance->second;
+	}
+
+
+	std::pair<InstanceRayHit, bool> InstanceTree::Raycast(const Ray& ray, const float tMax, const uint32_t mask) const
+	{
+		InstanceRayHit best{ Entity(), RayHit{ tMax, 0, glm::vec2(0.0f) } };
+
+		const auto [entity, hit] = mTopLevel.Raycast(ray, tMax, [&](const Entity leaf, const float tBest)
+		{
+			const Instance& instance = mInstances.at(leaf);
+			// Direction isn't normalized, so distances along the local ray match the world ray
+			const Ray localRay(glm::vec3(instance.inverseModelMat * glm::vec4(ray.origin, 1.0f)),
+			                   glm::vec3(instance.inverseModelMat * glm::vec4(ray.direction, 0.0f)));
+			const auto [triangleHit, hitTriangle] = instance.tree->Raycast(localRay, tBest);
+			if (hitTriangle) best.hit = triangleHit;
+			return std::make_pair(triangleHit.t, hitTriangle);
+		}, mask);
+
+		best.entity = entity;
+		return std::make_pair(best, hit);
+	}
+
+
+	std::vector<InstanceContact> InstanceTree::QueryTree(const StaticTree& tree, const glm::mat4& modelMat, const uint32_t mask) const
+	{
+		std::vector<InstanceContact> output;
+		if (tree.mNodes.empty()) return output;
+
+		for (const Entity entity : mTopLevel.QueryBox(WorldBounds(tree, modelMat), mask))
+		{
+			const Instance& instance = mInstances.at(entity);
+			auto trianglePairs = instance.tree->QueryTree(tree, instance.modelMat, modelMat);
+			if (!trianglePairs.empty())
+				output.push_back(InstanceContact{ entity, std::move(trianglePairs) });
+		}
+		return output;
+	}
+
+
+	std::vector<Entity> InstanceTree::QueryBox(const BoundingBox& box, const uint32_t mask) const
+	{
+		return mTopLevel.QueryBox(box, mask);
+	}
+
+
+	BoundingBox InstanceTree::WorldBounds(const StaticTree& tree, const glm::mat4& modelMat)
+	{
+		const Utils::OrientedBox box = Utils::TransformBox(tree.GetBounds(), modelMat);
+		const glm::vec3 extent = glm::abs(box.halfAxes[0]) + glm::abs(box.halfAxes[1]) + glm::abs(box.halfAxes[2]);
+		return BoundingBox(box.center - extent, box.center + extent);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "DynamicTree.h"
+#include "StaticTree.h"
+
+// Two level acceleration structure for instanced meshes
+// Every instance of a mesh shares one StaticTree in the mesh's local space, and the top level only stores a box and transform per instance
+namespace Physics
+{
+	// Keeps one StaticTree per unique mesh, so meshes loaded from the same data don't each build and store a tree
+	class TreeLibrary
+	{
+	public:
+		TreeLibrary(const TreeLibrary&) = delete;
+		void operator=(const TreeLibrary&) = delete;
+
+		static TreeLibrary& GetInstance()
+		{
+			static TreeLibrary instance;
+			return instance;
+		}
+
+		// Returns the tree of a mesh with the same positions, indices and options, building it if nothing holds one yet
+		// Indices are reordered to match the tree, the same way CreateStaticTree reorders them
+		// Trees are freed once nothing holds them, shared trees shouldn't be refit
+		// Callers acquiring a mesh that is still being built wait for that build instead of building it again
+		std::shared_ptr<StaticTree> Acquire(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices,
+		                                    const std::string& cacheDirectory, const BuildOptions& options = {});
+
+		// Unique meshes with a tree currently held
+		size_t Count();
+
+	private:
+		// Owns a tree together with the indices reordered by its build, so later meshes can be reordered the same way
+		struct SharedTree
+		{
+			StaticTree tree;
+			std::vector<unsigned> indices;
+		};
+
+		struct Entry
+		{
+			// Valid while the tree is being built, later callers of the same mesh wait on it
+			std::shared_future<std::shared_ptr<SharedTree>> pending;
+			std::weak_ptr<SharedTree> shared;
+			// Checked on top of the hash, so a hash collision never hands out another mesh's tree
+			size_t vertexCount;
+			size_t indexCount;
+		};
+
+		std::mutex entriesMutex;
+		std::unordered_map<uint64_t, Entry> mEntries;
+		// Expired entries are swept once the map grows past this, so sweeps stay amortized over acquires
+		size_t mSweepSize = 64;
+
+		TreeLibrary() = default;
+	};
+
+	// Mesh placed in the world
+	struct Instance
+	{
+		std::shared_ptr<const StaticTree> tree;
+		glm::mat4 modelMat;
+		glm::mat4 inverseModelMat;
+	};
+
+	// Closest triangle hit by a ray, and the instance it belongs to
+	struct InstanceRayHit
+	{
+		Entity entity;
+		RayHit hit;
+	};
+
+	// Triangles of an instance found intersecting a mesh
+	struct InstanceContact
+	{
+		Entity entity;
+		// Triangle indices into the instance's and the mesh's index buffers, divided by 3
+		std::vector<std::pair<size_t, size_t>> trianglePairs;
+	};
+
+	class InstanceTree
+	{
+	public:
+		// Tree has to be built already, the instance keeps it alive
+		void AddInstance(Entity entity, std::shared_ptr<const StaticTree> tree, const glm::mat4& modelMat,
+		                 uint32_t category = DEFAULT_CATEGORY, uint32_t mask = ALL_CATEGORIES);
+		void UpdateInstance(Entity entity, const glm::mat4& modelMat);
+		void RemoveInstance(Entity entity);
+
+		// Returns nullptr if the entity isn't an instance
+		const Instance* GetInstance(Entity entity) const;
+		size_t Count() const { return mInstances.size(); }
+
+		// Returns the closest triangle hit by a world space ray closer than tMax
+		// Hit distance is in the same units as the world space ray
+		std::pair<InstanceRayHit, bool> Raycast(const Ray& ray, float tMax = FLT_MAX, uint32_t mask = ALL_CATEGORIES) const;
+
+		// Returns intersecting triangles between every instance and a mesh placed in the world by modelMat
+		std::vector<InstanceContact> QueryTree(const StaticTree& tree, const glm::mat4& modelMat, uint32_t mask = ALL_CATEGORIES) const;
+		// Returns instances whose world bounds overlap box
+		std::vector<Entity> QueryBox(const BoundingBox& box, uint32_t mask = ALL_CATEGORIES) const;
+
+	private:
+		// Leaves are instances, with their mesh's bounds transformed into the world
+		DynamicBBTree mTopLevel;
+		std::unordered_map<Entity, Instance> mInstances;
+
+		// World space box around a tree's bounds placed by modelMat
+		static BoundingBox WorldBounds(const StaticTree& tree, const glm::mat4& modelMat);
+	};
+}
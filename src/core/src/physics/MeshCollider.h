@@ -1,9 +1,13 @@
 #pragma once
+#include <memory>
+
 #include "../components/Collider.h"
+#include "StaticTree.h"
 namespace Components
 {
 	struct MeshCollider: Collider
 	{
-		
+		// Triangle tree of the mesh in its local space, shared with the mesh
+		std::shared_ptr<const Physics::StaticTree> tree;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,858 @@
+#include "Narrowphase.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "utils/TaskScheduler.h"
+
+namespace Physics
+{
+	namespace
+	{
+		// Chooses a face axis over a slightly deeper edge or other face axis, so resting contacts don't flicker between features
+		constexpr float RELATIVE_TOLERANCE = 0.98f;
+		constexpr float ABSOLUTE_TOLERANCE = 0.001f;
+
+		constexpr unsigned int GJK_MAX_ITERATIONS = 64;
+		constexpr unsigned int EPA_MAX_ITERATIONS = 64;
+		constexpr float EPA_TOLERANCE = 1e-4f;
+		// Radians a shape is rocked by to find more points of a new contact
+		constexpr float PERTURBATION_ANGLE = 0.05f;
+
+		// Point of the Minkowski difference a - b, with the points of each shape it came from
+		struct SupportPoint
+		{
+			glm::vec3 v;
+			glm::vec3 a;
+			glm::vec3 b;
+		};
+
+		SupportPoint Support(const ConvexShape& a, const ConvexShape& b, const glm::vec3& direction)
+		{
+			SupportPoint point;
+			point.a = a.Support(direction);
+			point.b = b.Support(-direction);
+			point.v = point.a - point.b;
+			return point;
+		}
+
+		// Any direction perpendicular to v
+		glm::vec3 Perpendicular(const glm::vec3& v)
+		{
+			const glm::vec3 axis = std::abs(v.x) < 0.57f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			return glm::cross(v, axis);
+		}
+
+		// Reduces the simplex to the feature closest to the origin and picks the next search direction
+		// Simplex points are ordered oldest first, returns true once a tetrahedron holds the origin
+		bool DoSimplex(SupportPoint (&simplex)[4], unsigned int& count, glm::vec3& direction);
+
+		bool DoLine(SupportPoint (&simplex)[4], unsigned int& count, glm::vec3& direction)
+		{
+			const glm::vec3 a = simplex[1].v;
+			const glm::vec3 ab = simplex[0].v - a;
+			const glm::vec3 ao = -a;
+			if (glm::dot(ab, ao) > 0.0f)
+			{
+				direction = glm::cross(glm::cross(ab, ao), ab);
+				// Origin lies on the segment
+				if (glm::dot(direction, direction) < FLT_MIN) direction = Perpendicular(ab);
+			}
+			else
+			{
+				simplex[0] = simplex[1];
+				count = 1;
+				direction = ao;
+			}
+			return false;
+		}
+
+		bool DoTriangle(SupportPoint (&simplex)[4], unsigned int& count, glm::vec3& direction)
+		{
+			const glm::vec3 a = simplex[2].v;
+			const glm::vec3 ab = simplex[1].v - a;
+			const glm::vec3 ac = simplex[0].v - a;
+			const glm::vec3 ao = -a;
+			const glm::vec3 abc = glm::cross(ab, ac);
+
+			if (glm::dot(glm::cross(abc, ac), ao) > 0.0f)
+			{
+				if (glm::dot(ac, ao) > 0.0f)
+				{
+					simplex[1] = simplex[2];
+					count = 2;
+					direction = glm::cross(glm::cross(ac, ao), ac);
+					return false;
+				}
+				simplex[0] = simplex[1];
+				simplex[1] = simplex[2];
+				count = 2;
+				return DoLine(simplex, count, direction);
+			}
+			if (glm::dot(glm::cross(ab, abc), ao) > 0.0f)
+			{
+				simplex[0] = simplex[1];
+				simplex[1] = simplex[2];
+				count = 2;
+				return DoLine(simplex, count, direction);
+			}
+
+			if (glm::dot(abc, ao) >= 0.0f)
+			{
+				direction = abc;
+			}
+			else
+			{
+				// Keeps the winding so the next point lands on the side of the origin
+				std::swap(simplex[0], simplex[1]);
+				direction = -abc;
+			}
+			return false;
+		}
+
+		bool DoTetrahedron(SupportPoint (&simplex)[4], unsigned int& count, glm::vec3& direction)
+		{
+			const glm::vec3 a = simplex[3].v;
+			const glm::vec3 ab = simplex[2].v - a;
+			const glm::vec3 ac = simplex[1].v - a;
+			const glm::vec3 ad = simplex[0].v - a;
+			const glm::vec3 ao = -a;
+
+			// Faces touching the newest point, the one opposite it was already checked
+			// Each normal is turned away from the vertex not on its face
+			const auto outward = [](const glm::vec3& normal, const glm::vec3& opposite)
+			{
+				return glm::dot(normal, opposite) > 0.0f ? -normal : normal;
+			};
+			const glm::vec3 abc = outward(glm::cross(ab, ac), ad);
+			const glm::vec3 acd = outward(glm::cross(ac, ad), ab);
+			const glm::vec3 adb = outward(glm::cross(ad, ab), ac);
+
+			if (glm::dot(abc, ao) > 0.0f)
+			{
+				simplex[0] = simplex[1];
+				simplex[1] = simplex[2];
+				simplex[2] = simplex[3];
+				count = 3;
+				return DoTriangle(simplex, count, direction);
+			}
+			if (glm::dot(acd, ao) > 0.0f)
+			{
+				simplex[2] = simplex[3];
+				count = 3;
+				return DoTriangle(simplex, count, direction);
+			}
+			if (glm::dot(adb, ao) > 0.0f)
+			{
+				simplex[1] = simplex[0];
+				simplex[0] = simplex[2];
+				simplex[2] = simplex[3];
+				count = 3;
+				return DoTriangle(simplex, count, direction);
+			}
+			return true;
+		}
+
+		bool DoSimplex(SupportPoint (&simplex)[4], unsigned int& count, glm::vec3& direction)
+		{
+			switch (count)
+			{
+			case 2:
+				return DoLine(simplex, count, direction);
+			case 3:
+				return DoTriangle(simplex, count, direction);
+			default:
+				return DoTetrahedron(simplex, count, direction);
+			}
+		}
+
+		// Returns true and a tetrahedron around the origin if the shapes overlap
+		// Shapes that only touch count as separated
+		bool Gjk(const ConvexShape& a, const ConvexShape& b, SupportPoint (&simplex)[4])
+		{
+			glm::vec3 direction = b.position - a.position;
+			if (glm::dot(direction, direction) < FLT_MIN) direction = glm::vec3(1.0f, 0.0f, 0.0f);
+
+			simplex[0] = Support(a, b, direction);
+			unsigned int count = 1;
+			direction = -simplex[0].v;
+
+			for (unsigned int i = 0; i < GJK_MAX_ITERATIONS; i++)
+			{
+				if (glm::dot(direction, direction) < FLT_MIN) return false;
+
+				const SupportPoint point = Support(a, b, direction);
+				if (glm::dot(point.v, direction) <= 0.0f) return false;
+
+				simplex[count++] = point;
+				if (DoSimplex(simplex, count, direction)) return true;
+			}
+			return false;
+		}
+
+		struct EpaFace
+		{
+			unsigned int vertices[3];
+			glm::vec3 normal;
+			float distance;
+		};
+
+		// Makes a face of the polytope facing away from the origin, returns false if it's degenerate
+		bool MakeFace(const std::vector<SupportPoint>& vertices, const unsigned int v0, const unsigned int v1, const unsigned int v2, EpaFace& face)
+		{
+			glm::vec3 normal = glm::cross(vertices[v1].v - vertices[v0].v, vertices[v2].v - vertices[v0].v);
+			const float length = glm::length(normal);
+			if (length < FLT_EPSILON) return false;
+
+			normal /= length;
+			face = EpaFace{ { v0, v1, v2 }, normal, glm::dot(normal, vertices[v0].v) };
+			if (face.distance < 0.0f)
+			{
+				std::swap(face.vertices[1], face.vertices[2]);
+				face.normal = -face.normal;
+				face.distance = -face.distance;
+			}
+			return true;
+		}
+
+		// Expands GJK's tetrahedron until its face closest to the origin is on the Minkowski difference's surface
+		// Adapted from Van den Bergen, "Proximity Queries and Penetration Depth Computation on 3D Game Objects" (2001)
+		bool Epa(const ConvexShape& a, const ConvexShape& b, const SupportPoint (&simplex)[4], glm::vec3& normal, float& depth,
+		         glm::vec3& pointA, glm::vec3& pointB)
+		{
+			std::vector<SupportPoint> vertices(simplex, simplex + 4);
+			std::vector<EpaFace> faces;
+			faces.reserve(32);
+			const unsigned int tetrahedron[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 3, 2 } };
+			for (const auto& indices : tetrahedron)
+			{
+				EpaFace face;
+				if (!MakeFace(vertices, indices[0], indices[1], indices[2], face)) return false;
+				faces.push_back(face);
+			}
+
+			std::vector<std::pair<unsigned int, unsigned int>> horizon;
+			size_t closest = 0;
+			for (unsigned int iteration = 0; iteration < EPA_MAX_ITERATIONS; iteration++)
+			{
+				closest = 0;
+				for (size_t i = 1; i < faces.size(); i++)
+					if (faces[i].distance < faces[closest].distance) closest = i;
+
+				const SupportPoint point = Support(a, b, faces[closest].normal);
+				if (glm::dot(point.v, faces[closest].normal) - faces[closest].distance < EPA_TOLERANCE) break;
+
+				// Removes faces the new point sees, the edges they share with faces it doesn't see form the hole's border
+				horizon.clear();
+				const unsigned int newVertex = static_cast<unsigned int>(vertices.size());
+				vertices.push_back(point);
+				for (size_t i = 0; i < faces.size();)
+				{
+					if (glm::dot(faces[i].normal, point.v - vertices[faces[i].vertices[0]].v) <= 0.0f)
+					{
+						i++;
+						continue;
+					}
+					for (unsigned int edge = 0; edge < 3; edge++)
+					{
+						const auto current = std::make_pair(faces[i].vertices[edge], faces[i].vertices[(edge + 1) % 3]);
+						const auto shared = std::find(horizon.begin(), horizon.end(), std::make_pair(current.second, current.first));
+						if (shared != horizon.end()) horizon.erase(shared);
+						else horizon.push_back(current);
+					}
+					faces[i] = faces.back();
+					faces.pop_back();
+				}
+
+				for (const auto& [v0, v1] : horizon)
+				{
+					EpaFace face;
+					if (MakeFace(vertices, v0, v1, newVertex, face)) faces.push_back(face);
+				}
+				if (faces.empty()) return false;
+			}
+
+			closest = 0;
+			for (size_t i = 1; i < faces.size(); i++)
+				if (faces[i].distance < faces[closest].distance) closest = i;
+			const EpaFace& face = faces[closest];
+			normal = face.normal;
+			depth = face.distance;
+
+			// Barycentric coordinates of the origin projected onto the face give the matching points on each shape
+			const glm::vec3 projection = face.normal * face.distance;
+			const SupportPoint& p0 = vertices[face.vertices[0]];
+			const SupportPoint& p1 = vertices[face.vertices[1]];
+			const SupportPoint& p2 = vertices[face.vertices[2]];
+			const glm::vec3 e0 = p1.v - p0.v;
+			const glm::vec3 e1 = p2.v - p0.v;
+			const glm::vec3 e2 = projection - p0.v;
+			const float d00 = glm::dot(e0, e0);
+			const float d01 = glm::dot(e0, e1);
+			const float d11 = glm::dot(e1, e1);
+			const float d20 = glm::dot(e2, e0);
+			const float d21 = glm::dot(e2, e1);
+			const float denominator = d00 * d11 - d01 * d01;
+			float v = 0.0f;
+			float w = 0.0f;
+			if (std::abs(denominator) > FLT_MIN)
+			{
+				v = (d11 * d20 - d01 * d21) / denominator;
+				w = (d00 * d21 - d01 * d20) / denominator;
+			}
+			const float u = 1.0f - v - w;
+			pointA = p0.a * u + p1.a * v + p2.a * w;
+			pointB = p0.b * u + p1.b * v + p2.b * w;
+			return true;
+		}
+
+		// Keeps the MAX_MANIFOLD_POINTS points that cover the largest area, starting with the deepest
+		void ReducePoints(ContactPoint* points, unsigned int& count, const glm::vec3& normal)
+		{
+			if (count <= MAX_MANIFOLD_POINTS) return;
+
+			ContactPoint kept[MAX_MANIFOLD_POINTS];
+			bool used[16] = {};
+
+			unsigned int first = 0;
+			for (unsigned int i = 1; i < count; i++)
+				if (points[i].depth > points[first].depth) first = i;
+			kept[0] = points[first];
+			used[first] = true;
+
+			// Farthest from the first
+			unsigned int second = first;
+			float best = -1.0f;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const glm::vec3 offset = points[i].position - kept[0].position;
+				const float distance = glm::dot(offset, offset);
+				if (!used[i] && distance > best)
+				{
+					best = distance;
+					second = i;
+				}
+			}
+			kept[1] = points[second];
+			used[second] = true;
+
+			// Largest triangle with the first two, then the largest on the other side of their edge
+			const auto area = [&](const unsigned int i)
+			{
+				return glm::dot(glm::cross(kept[0].position - points[i].position, kept[1].position - points[i].position), normal);
+			};
+			unsigned int third = first;
+			best = -1.0f;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!used[i] && std::abs(area(i)) > best)
+				{
+					best = std::abs(area(i));
+					third = i;
+				}
+			}
+			kept[2] = points[third];
+			used[third] = true;
+			const float side = area(third) >= 0.0f ? -1.0f : 1.0f;
+
+			unsigned int keptCount = 3;
+			unsigned int fourth = first;
+			best = 0.0f;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!used[i] && area(i) * side > best)
+				{
+					best = area(i) * side;
+					fourth = i;
+				}
+			}
+			if (fourth != first)
+				kept[keptCount++] = points[fourth];
+
+			std::copy(kept, kept + keptCount, points);
+			count = keptCount;
+		}
+
+		// Clips a polygon to the side of a plane where dot(normal, p) <= offset
+		// Points made by clipping get feature ids from the plane and the edge they cut
+		unsigned int ClipPolygon(const glm::vec3* input, const uint32_t* inputIds, const unsigned int inputCount, const glm::vec3& normal,
+		                         const float offset, const uint32_t plane, glm::vec3* output, uint32_t* outputIds)
+		{
+			unsigned int outputCount = 0;
+			for (unsigned int i = 0; i < inputCount; i++)
+			{
+				const unsigned int j = (i + 1) % inputCount;
+				const float di = glm::dot(normal, input[i]) - offset;
+				const float dj = glm::dot(normal, input[j]) - offset;
+
+				if (di <= 0.0f)
+				{
+					output[outputCount] = input[i];
+					outputIds[outputCount++] = inputIds[i];
+				}
+				if ((di <= 0.0f) != (dj <= 0.0f))
+				{
+					output[outputCount] = input[i] + (input[j] - input[i]) * (di / (di - dj));
+					outputIds[outputCount++] = 0x100u | (plane << 6) | ((inputIds[i] & 7u) << 3) | (inputIds[j] & 7u);
+				}
+			}
+			return outputCount;
+		}
+	}
+
+
+	glm::vec3 ConvexShape::Support(const glm::vec3& direction) const
+	{
+		const glm::vec3 localDirection = glm::transpose(rotation) * direction;
+		if (type == ShapeType::BOX)
+		{
+			const glm::vec3 corner(localDirection.x >= 0.0f ? halfExtents.x : -halfExtents.x,
+			                       localDirection.y >= 0.0f ? halfExtents.y : -halfExtents.y,
+			                       localDirection.z >= 0.0f ? halfExtents.z : -halfExtents.z);
+			return ToWorld(corner);
+		}
+
+		// Scale is applied before rotation, so the farthest point is found along the scaled direction
+		const glm::vec3 scaledDirection = localDirection * scale;
+		size_t best = 0;
+		float bestDistance = -FLT_MAX;
+		for (size_t i = 0; i < pointCount; i++)
+		{
+			const float distance = glm::dot(points[i], scaledDirection);
+			if (distance > bestDistance)
+			{
+				bestDistance = distance;
+				best = i;
+			}
+		}
+		return ToWorld(points[best] * scale);
+	}
+
+	BoundingBox ConvexShape::GetBounds() const
+	{
+		if (type == ShapeType::BOX)
+		{
+			const glm::mat3 absolute(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+			const glm::vec3 extent = absolute * halfExtents;
+			return BoundingBox(position - extent, position + extent);
+		}
+
+		glm::vec3 min, max;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			glm::vec3 direction(0.0f);
+			direction[axis] = 1.0f;
+			max[axis] = Support(direction)[axis];
+			min[axis] = Support(-direction)[axis];
+		}
+		return BoundingBox(min, max);
+	}
+
+
+	bool CollideBoxes(const ConvexShape& a, const ConvexShape& b, ContactManifold& manifold)
+	{
+		// Adapted from Real-Time Collision Detection (Ericson), 4.4.1, keeping how far apart the boxes are along each axis
+		float r[3][3];
+		float absR[3][3];
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				r[i][j] = glm::dot(a.rotation[i], b.rotation[j]);
+				// Epsilon keeps near parallel edge axes from passing as separating
+				absR[i][j] = std::abs(r[i][j]) + 1e-6f;
+			}
+		}
+		const glm::vec3 offset = b.position - a.position;
+		const glm::vec3 t(glm::dot(offset, a.rotation[0]), glm::dot(offset, a.rotation[1]), glm::dot(offset, a.rotation[2]));
+		const glm::vec3& ea = a.halfExtents;
+		const glm::vec3& eb = b.halfExtents;
+
+		float faceA = -FLT_MAX;
+		unsigned int axisA = 0;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			const float separation = std::abs(t[i]) - (ea[i] + eb[0] * absR[i][0] + eb[1] * absR[i][1] + eb[2] * absR[i][2]);
+			if (separation > 0.0f) return false;
+			if (separation > faceA)
+			{
+				faceA = separation;
+				axisA = i;
+			}
+		}
+
+		float faceB = -FLT_MAX;
+		unsigned int axisB = 0;
+		for (unsigned int j = 0; j < 3; j++)
+		{
+			const float distance = std::abs(t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j]);
+			const float separation = distance - (ea[0] * absR[0][j] + ea[1] * absR[1][j] + ea[2] * absR[2][j] + eb[j]);
+			if (separation > 0.0f) return false;
+			if (separation > faceB)
+			{
+				faceB = separation;
+				axisB = j;
+			}
+		}
+
+		float edge = -FLT_MAX;
+		unsigned int edgeA = 0;
+		unsigned int edgeB = 0;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			const unsigned int i1 = (i + 1) % 3;
+			const unsigned int i2 = (i + 2) % 3;
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				const unsigned int j1 = (j + 1) % 3;
+				const unsigned int j2 = (j + 2) % 3;
+
+				// Parallel edges give no axis, the face axes cover them
+				const float length = std::sqrt(std::max(1.0f - r[i][j] * r[i][j], 0.0f));
+				if (length < 1e-4f) continue;
+
+				const float radiusA = ea[i1] * absR[i2][j] + ea[i2] * absR[i1][j];
+				const float radiusB = eb[j1] * absR[i][j2] + eb[j2] * absR[i][j1];
+				const float distance = std::abs(t[i2] * r[i1][j] - t[i1] * r[i2][j]);
+				const float separation = (distance - radiusA - radiusB) / length;
+				if (separation > 0.0f) return false;
+				if (separation > edge)
+				{
+					edge = separation;
+					edgeA = i;
+					edgeB = j;
+				}
+			}
+		}
+
+		manifold.pointCount = 0;
+
+		const bool referenceIsA = faceB <= RELATIVE_TOLERANCE * faceA + ABSOLUTE_TOLERANCE;
+		const float face = referenceIsA ? faceA : faceB;
+		if (edge > RELATIVE_TOLERANCE * face + ABSOLUTE_TOLERANCE)
+		{
+			glm::vec3 normal = glm::normalize(glm::cross(a.rotation[edgeA], b.rotation[edgeB]));
+			if (glm::dot(normal, offset) < 0.0f) normal = -normal;
+
+			// Edge of each box farthest into the other
+			glm::vec3 pointA = a.position;
+			glm::vec3 pointB = b.position;
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				if (k != edgeA) pointA += a.rotation[k] * (glm::dot(a.rotation[k], normal) >= 0.0f ? ea[k] : -ea[k]);
+				if (k != edgeB) pointB += b.rotation[k] * (glm::dot(b.rotation[k], normal) >= 0.0f ? -eb[k] : eb[k]);
+			}
+
+			// Closest points between the two edge lines, clamped to the edges
+			const glm::vec3& directionA = a.rotation[edgeA];
+			const glm::vec3& directionB = b.rotation[edgeB];
+			const glm::vec3 between = pointA - pointB;
+			const float d = glm::dot(directionA, directionB);
+			const float denominator = 1.0f - d * d;
+			const float e = glm::dot(directionA, between);
+			const float f = glm::dot(directionB, between);
+			const float s = std::clamp(denominator > FLT_EPSILON ? (d * f - e) / denominator : 0.0f, -ea[edgeA], ea[edgeA]);
+			const float u = std::clamp(d * s + f, -eb[edgeB], eb[edgeB]);
+			pointA += directionA * s;
+			pointB += directionB * u;
+
+			ContactPoint& point = manifold.points[manifold.pointCount++];
+			point.position = (pointA + pointB) * 0.5f;
+			point.depth = -edge;
+			point.localA = a.ToLocal(pointA);
+			point.localB = b.ToLocal(pointB);
+			point.feature = 0x1000000u | (edgeA << 2) | edgeB;
+			manifold.normal = normal;
+			return true;
+		}
+
+		// Clips the face of the other box that faces the reference face against the reference face's sides
+		const ConvexShape& reference = referenceIsA ? a : b;
+		const ConvexShape& incident = referenceIsA ? b : a;
+		const unsigned int referenceAxis = referenceIsA ? axisA : axisB;
+		const glm::vec3 towardIncident = incident.position - reference.position;
+		const float referenceSign = glm::dot(towardIncident, reference.rotation[referenceAxis]) >= 0.0f ? 1.0f : -1.0f;
+		const glm::vec3 referenceNormal = reference.rotation[referenceAxis] * referenceSign;
+
+		unsigned int incidentAxis = 0;
+		float mostAligned = -1.0f;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			const float aligned = std::abs(glm::dot(incident.rotation[k], referenceNormal));
+			if (aligned > mostAligned)
+			{
+				mostAligned = aligned;
+				incidentAxis = k;
+			}
+		}
+		const float incidentSign = glm::dot(incident.rotation[incidentAxis], referenceNormal) > 0.0f ? -1.0f : 1.0f;
+
+		const unsigned int i1 = (incidentAxis + 1) % 3;
+		const unsigned int i2 = (incidentAxis + 2) % 3;
+		const glm::vec3 incidentCenter = incident.position + incident.rotation[incidentAxis] * (incident.halfExtents[incidentAxis] * incidentSign);
+		const glm::vec3 side1 = incident.rotation[i1] * incident.halfExtents[i1];
+		const glm::vec3 side2 = incident.rotation[i2] * incident.halfExtents[i2];
+
+		// Clipping against four planes can add one point per plane
+		glm::vec3 polygon[2][8] = { { incidentCenter + side1 + side2, incidentCenter - side1 + side2, incidentCenter - side1 - side2, incidentCenter + side1 - side2 } };
+		uint32_t ids[2][8] = { { 0, 1, 2, 3 } };
+		unsigned int count = 4;
+		unsigned int current = 0;
+		const unsigned int r1 = (referenceAxis + 1) % 3;
+		const unsigned int r2 = (referenceAxis + 2) % 3;
+		const unsigned int sideAxes[4] = { r1, r1, r2, r2 };
+		for (unsigned int plane = 0; plane < 4 && count > 0; plane++)
+		{
+			const glm::vec3 sideNormal = reference.rotation[sideAxes[plane]] * (plane % 2 == 0 ? 1.0f : -1.0f);
+			const float sideOffset = glm::dot(sideNormal, reference.position) + reference.halfExtents[sideAxes[plane]];
+			count = ClipPolygon(polygon[current], ids[current], count, sideNormal, sideOffset, plane, polygon[1 - current], ids[1 - current]);
+			current = 1 - current;
+		}
+
+		const glm::vec3 referenceCenter = reference.position + referenceNormal * reference.halfExtents[referenceAxis];
+		const uint32_t faceFeature = (referenceIsA ? 0u : 0x100000u) | ((referenceAxis * 2 + (referenceSign > 0.0f)) << 16) | ((incidentAxis * 2 + (incidentSign > 0.0f)) << 12);
+		ContactPoint points[8];
+		unsigned int pointCount = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const float separation = glm::dot(referenceNormal, polygon[current][i] - referenceCenter);
+			if (separation > 0.0f) continue;
+
+			const glm::vec3 onIncident = polygon[current][i];
+			const glm::vec3 onReference = onIncident - referenceNormal * separation;
+			ContactPoint& point = points[pointCount++];
+			point.position = (onIncident + onReference) * 0.5f;
+			point.depth = -separation;
+			point.localA = a.ToLocal(referenceIsA ? onReference : onIncident);
+			point.localB = b.ToLocal(referenceIsA ? onIncident : onReference);
+			point.feature = faceFeature | (ids[current][i] & 0xFFFu);
+		}
+		if (pointCount == 0) return false;
+
+		manifold.normal = referenceIsA ? referenceNormal : -referenceNormal;
+		ReducePoints(points, pointCount, manifold.normal);
+		std::copy(points, points + pointCount, manifold.points);
+		manifold.pointCount = pointCount;
+		return true;
+	}
+
+
+	bool CollideConvex(const ConvexShape& a, const ConvexShape& b, ContactManifold& manifold)
+	{
+		SupportPoint simplex[4];
+		if (!Gjk(a, b, simplex)) return false;
+
+		// Minkowski difference normal points from a to b
+		glm::vec3 normal;
+		float depth;
+		glm::vec3 pointA;
+		glm::vec3 pointB;
+		if (!Epa(a, b, simplex, normal, depth, pointA, pointB)) return false;
+
+		ContactPoint& point = manifold.points[0];
+		point.position = (pointA + pointB) * 0.5f;
+		point.depth = depth;
+		point.localA = a.ToLocal(pointA);
+		point.localB = b.ToLocal(pointB);
+		point.feature = 0;
+		manifold.normal = normal;
+		manifold.pointCount = 1;
+		return true;
+	}
+
+
+	void Narrowphase::Update(const std::vector<Entity>& pairs, const std::unordered_map<Entity, ConvexShape>& shapes)
+	{
+		// Entities are ordered so a pair has the same key and manifold direction every update
+		mShapePairs.clear();
+		mEntityPairs.clear();
+		for (size_t i = 0; i + 1 < pairs.size(); i += 2)
+		{
+			const Entity a = std::min(pairs[i], pairs[i + 1]);
+			const Entity b = std::max(pairs[i], pairs[i + 1]);
+			const auto shapeA = shapes.find(a);
+			const auto shapeB = shapes.find(b);
+			if (shapeA == shapes.end() || shapeB == shapes.end()) continue;
+
+			mShapePairs.emplace_back(&shapeA->second, &shapeB->second);
+			mEntityPairs.emplace_back(a, b);
+		}
+
+		// One buffer per batch, joined in order afterwards so the result doesn't depend on thread timing
+		const size_t batchCount = (mShapePairs.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+		if (mBatches.size() < batchCount)
+			mBatches.resize(batchCount);
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, batchCount, 1, [&](const size_t begin, const size_t end)
+		{
+			for (size_t batch = begin; batch < end; batch++)
+			{
+				std::vector<ContactManifold>& output = mBatches[batch];
+				output.clear();
+				const size_t last = std::min((batch + 1) * BATCH_SIZE, mShapePairs.size());
+				for (size_t i = batch * BATCH_SIZE; i < last; i++)
+				{
+					const auto [a, b] = mEntityPairs[i];
+					const auto previous = mPairs.find(PairKey(a, b));
+
+					ContactManifold manifold;
+					manifold.a = a;
+					manifold.b = b;
+					if (Collide(*mShapePairs[i].first, *mShapePairs[i].second, previous == mPairs.end() ? nullptr : &mManifolds[previous->second], manifold))
+						output.push_back(manifold);
+				}
+			}
+		});
+
+		size_t total = 0;
+		for (size_t batch = 0; batch < batchCount; batch++)
+			total += mBatches[batch].size();
+		mNextManifolds.clear();
+		mNextManifolds.reserve(total);
+		for (size_t batch = 0; batch < batchCount; batch++)
+			mNextManifolds.insert(mNextManifolds.end(), mBatches[batch].begin(), mBatches[batch].end());
+
+		mManifolds.swap(mNextManifolds);
+		mPairs.clear();
+		mPairs.reserve(mManifolds.size());
+		for (size_t i = 0; i < mManifolds.size(); i++)
+			mPairs.emplace(PairKey(mManifolds[i].a, mManifolds[i].b), i);
+	}
+
+
+	void Narrowphase::Clear()
+	{
+		mManifolds.clear();
+		mPairs.clear();
+	}
+
+
+	uint64_t Narrowphase::PairKey(const Entity a, const Entity b)
+	{
+		return static_cast<uint64_t>(a) << 32 | b;
+	}
+
+
+	bool Narrowphase::Collide(const ConvexShape& a, const ConvexShape& b, const ContactManifold* previous, ContactManifold& manifold) const
+	{
+		if (a.type == ShapeType::BOX && b.type == ShapeType::BOX)
+		{
+			if (!CollideBoxes(a, b, manifold)) return false;
+
+			// Points made by the same features are the same contact as last update
+			// Nearly aligned boxes can swap which features clip a point, so a point at the same place counts too
+			for (unsigned int i = 0; i < manifold.pointCount; i++)
+			{
+				ContactPoint& point = manifold.points[i];
+				point.normalImpulse = 0.0f;
+				point.tangentImpulse[0] = point.tangentImpulse[1] = 0.0f;
+				if (!previous) continue;
+
+				const ContactPoint* match = nullptr;
+				float closest = BREAKING_DISTANCE * BREAKING_DISTANCE;
+				for (unsigned int j = 0; j < previous->pointCount; j++)
+				{
+					if (previous->points[j].feature == point.feature)
+					{
+						match = &previous->points[j];
+						break;
+					}
+					const glm::vec3 offset = previous->points[j].localA - point.localA;
+					if (glm::dot(offset, offset) < closest)
+					{
+						closest = glm::dot(offset, offset);
+						match = &previous->points[j];
+					}
+				}
+				if (!match) continue;
+
+				point.normalImpulse = match->normalImpulse;
+				point.tangentImpulse[0] = match->tangentImpulse[0];
+				point.tangentImpulse[1] = match->tangentImpulse[1];
+			}
+			return true;
+		}
+
+		if (!CollideConvex(a, b, manifold)) return false;
+
+		ContactPoint found = manifold.points[0];
+		found.normalImpulse = 0.0f;
+		found.tangentImpulse[0] = found.tangentImpulse[1] = 0.0f;
+
+		// Points from earlier updates are moved with their bodies and kept while they're still touching where they were
+		ContactPoint points[MAX_MANIFOLD_POINTS + 5];
+		unsigned int count = 0;
+		if (previous && glm::dot(previous->normal, manifold.normal) > 0.95f)
+		{
+			for (unsigned int i = 0; i < previous->pointCount; i++)
+			{
+				ContactPoint point = previous->points[i];
+				const glm::vec3 pointA = a.ToWorld(point.localA);
+				const glm::vec3 pointB = b.ToWorld(point.localB);
+				const glm::vec3 between = pointA - pointB;
+				const float depth = glm::dot(between, manifold.normal);
+				const glm::vec3 drift = between - manifold.normal * depth;
+				if (depth < -BREAKING_DISTANCE || glm::dot(drift, drift) > BREAKING_DISTANCE * BREAKING_DISTANCE) continue;
+
+				// The new point replaces a kept one at the same place, taking over its impulses
+				const glm::vec3 fromFound = point.localA - found.localA;
+				if (glm::dot(fromFound, fromFound) < BREAKING_DISTANCE * BREAKING_DISTANCE)
+				{
+					found.normalImpulse = point.normalImpulse;
+					found.tangentImpulse[0] = point.tangentImpulse[0];
+					found.tangentImpulse[1] = point.tangentImpulse[1];
+					continue;
+				}
+
+				point.position = (pointA + pointB) * 0.5f;
+				point.depth = depth;
+				points[count++] = point;
+			}
+		}
+		points[count++] = found;
+
+		// A new contact only has its deepest point, rocking b slightly finds the rest of a resting face
+		// Adapted from Bullet's perturbed persistent manifolds
+		if (!previous)
+		{
+			const glm::vec3 pointOnA = a.ToWorld(found.localA);
+			const glm::vec3 tangent = glm::normalize(Perpendicular(manifold.normal));
+			const glm::vec3 axes[4] = { tangent, -tangent, glm::cross(manifold.normal, tangent), -glm::cross(manifold.normal, tangent) };
+			for (const glm::vec3& axis : axes)
+			{
+				ConvexShape rocked = b;
+				rocked.rotation = glm::mat3_cast(glm::angleAxis(PERTURBATION_ANGLE, axis)) * b.rotation;
+				ContactManifold perturbed;
+				if (!CollideConvex(a, rocked, perturbed)) continue;
+
+				// The same point of b without the rocking, measured against the plane through the deepest point
+				ContactPoint point = perturbed.points[0];
+				const glm::vec3 pointB = b.ToWorld(point.localB);
+				point.depth = glm::dot(pointOnA - pointB, manifold.normal);
+				if (point.depth < -BREAKING_DISTANCE) continue;
+
+				bool duplicate = false;
+				for (unsigned int i = 0; i < count && !duplicate; i++)
+				{
+					const glm::vec3 offset = point.localB - points[i].localB;
+					duplicate = glm::dot(offset, offset) < BREAKING_DISTANCE * BREAKING_DISTANCE;
+				}
+				if (duplicate) continue;
+
+				const glm::vec3 pointA = pointB + manifold.normal * point.depth;
+				point.position = (pointA + pointB) * 0.5f;
+				point.localA = a.ToLocal(pointA);
+				point.normalImpulse = 0.0f;
+				point.tangentImpulse[0] = point.tangentImpulse[1] = 0.0f;
+				points[count++] = point;
+			}
+		}
+
+		ReducePoints(points, count, manifold.normal);
+		std::copy(points, points + count, manifold.points);
+		manifold.pointCount = count;
+		return true;
+	}
+}
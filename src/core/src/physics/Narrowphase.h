@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+#include "core/GlobalTypes.h"
+
+// Contact generation between convex shapes, for pairs the broadphase found overlapping
+// Boxes are clipped against each other after a separating axis test, other shapes use GJK and EPA
+namespace Physics
+{
+	// Most points a manifold keeps, enough for a box resting on a face
+	constexpr unsigned int MAX_MANIFOLD_POINTS = 4;
+
+	enum class ShapeType
+	{
+		BOX,
+		HULL
+	};
+
+	// Convex collider placed in the world
+	struct ConvexShape
+	{
+		ShapeType type = ShapeType::BOX;
+		// Boxes only, already scaled
+		glm::vec3 halfExtents{};
+		// Hulls only, in local space before scale, have to outlive the shape
+		const glm::vec3* points = nullptr;
+		size_t pointCount = 0;
+
+		glm::vec3 position{};
+		glm::mat3 rotation{ 1.0f };
+		glm::vec3 scale{ 1.0f };
+
+		// Point of the shape farthest along direction
+		glm::vec3 Support(const glm::vec3& direction) const;
+		// World space box around the shape
+		BoundingBox GetBounds() const;
+		glm::vec3 ToWorld(const glm::vec3& local) const { return position + rotation * local; }
+		glm::vec3 ToLocal(const glm::vec3& world) const { return glm::transpose(rotation) * (world - position); }
+	};
+
+	struct ContactPoint
+	{
+		// Halfway between the two surfaces
+		glm::vec3 position;
+		// Overlap along the manifold normal, positive when penetrating
+		float depth;
+		// Deepest points of each shape, in each body's local space, so kept points can be updated as bodies move
+		glm::vec3 localA;
+		glm::vec3 localB;
+		// Identifies the features that made the point, so it can be matched next frame
+		uint32_t feature;
+
+		// Impulses the solver applied, kept while the point persists so it can warm start
+		float normalImpulse;
+		float tangentImpulse[2];
+	};
+
+	struct ContactManifold
+	{
+		Entity a, b;
+		// Points from a to b
+		glm::vec3 normal;
+		ContactPoint points[MAX_MANIFOLD_POINTS];
+		unsigned int pointCount;
+	};
+
+	// Writes the contact between two boxes into manifold, returns false if they're separated
+	bool CollideBoxes(const ConvexShape& a, const ConvexShape& b, ContactManifold& manifold);
+	// Finds the deepest point between two convex shapes, returns false if they're separated
+	// Only one point is found, Narrowphase keeps the ones found in earlier frames to build up a manifold
+	bool CollideConvex(const ConvexShape& a, const ConvexShape& b, ContactManifold& manifold);
+
+	// Keeps contact manifolds between frames, carrying solver impulses over to points that persist
+	class Narrowphase
+	{
+	public:
+		// Pairs pushed to a task together
+		static constexpr size_t BATCH_SIZE = 64;
+		// Kept points farther apart than this, along the normal or sideways, are dropped
+		static constexpr float BREAKING_DISTANCE = 0.02f;
+
+		// Finds manifolds for pairs stored one after another, the way ComputeCollisionPairs returns them
+		// Pairs whose entities don't both have a shape are skipped
+		void Update(const std::vector<Entity>& pairs, const std::unordered_map<Entity, ConvexShape>& shapes);
+
+		const std::vector<ContactManifold>& GetManifolds() const { return mManifolds; }
+		// Manifolds are handed back after solving, so impulses are kept for the next update
+		std::vector<ContactManifold>& GetManifolds() { return mManifolds; }
+
+		void Clear();
+
+	private:
+		std::vector<ContactManifold> mManifolds;
+		// Index of each pair's manifold in mManifolds
+		std::unordered_map<uint64_t, size_t> mPairs;
+
+		// Scratch buffers kept between updates, so a step doesn't allocate once they're large enough
+		std::vector<std::pair<const ConvexShape*, const ConvexShape*>> mShapePairs;
+		std::vector<std::pair<Entity, Entity>> mEntityPairs;
+		// Manifolds found by each batch of pairs
+		std::vector<std::vector<ContactManifold>> mBatches;
+		// Becomes mManifolds after the update, swapped with the last update's manifolds
+		std::vector<ContactManifold> mNextManifolds;
+
+		static uint64_t PairKey(Entity a, Entity b);
+		// Finds the contact of one pair, using the manifold from the last update if there was one
+		bool Collide(const ConvexShape& a, const ConvexShape& b, const ContactManifold* previous, ContactManifold& manifold) const;
+	};
+}
@@ -0,0 +1,728 @@
+#include "PhysicsSystem.h"
+
+#include <limits>
+
+extern World world;
+
+PhysicsSystem::PhysicsSystem()
+{
+    tree = Physics::DynamicBBTree{ 1 };
+    sleepingTree = Physics::DynamicBBTree{ 1 };
+    kinematicTree = Physics::DynamicBBTree{ 1 };
+    // Static bodies never move, so their tree is never rebalanced
+    staticTree = Physics::DynamicBBTree{ 1, false };
+}
+
+void PhysicsSystem::AddRigidbody(Mesh& object)
+{
+	Components::Rigidbody newRb{};
+	newRb.position = object.transform.worldPos;
+	newRb.previousPosition = newRb.position;
+
+	world.AddComponent(object.mEntityID, newRb);
+	AddToTree(object);
+}
+
+void PhysicsSystem::AddRigidbody(Model& object)
+{
+	Components::Rigidbody newRb{};
+	newRb.position = object.transform.worldPos;
+	newRb.previousPosition = newRb.position;
+
+	world.AddComponent(object.mEntityID, newRb);
+	AddToTree(object);
+}
+
+void PhysicsSystem::AddToTree(Mesh& object, const Physics::BodyType type)
+{
+	LOG(LOG_INFO) << "Adding mesh with entity ID " << object.mEntityID << " to tree\n";
+	GetTree(type).InsertEntity(object.mEntityID, object.CalcBoundingBox());
+	mBodyTypes[object.mEntityID] = type;
+	if (type == Physics::BodyType::DYNAMIC)
+		AddAwakeBody(object.mEntityID);
+}
+
+void PhysicsSystem::AddToTree(Model& object, const Physics::BodyType type)
+{
+	LOG(LOG_INFO) << "Adding model with entity ID " << object.mEntityID << " to tree\n";
+	GetTree(type).InsertEntity(object.mEntityID, object.CalcBoundingBox());
+	mBodyTypes[object.mEntityID] = type;
+	if (type == Physics::BodyType::DYNAMIC)
+		AddAwakeBody(object.mEntityID);
+}
+
+void PhysicsSystem::BuildTree(const std::vector<std::pair<Entity, BoundingBox>>& proxies, const Physics::BodyType type)
+{
+	LOG(LOG_INFO) << "Building tree with " << proxies.size() << " entities\n";
+
+	// Forget bodies that were in the tree being replaced
+	for (auto it = mBodyTypes.begin(); it != mBodyTypes.end();)
+	{
+		if (it->second == type) it = mBodyTypes.erase(it);
+		else ++it;
+	}
+
+	if (type == Physics::BodyType::DYNAMIC)
+	{
+		// Sleeping bodies are replaced too
+		for (const auto& [entity, island] : mSleepingIslandOf)
+		{
+			if (mEntities.count(entity))
+				world.GetComponent<Components::Rigidbody>(entity).sleeping = false;
+		}
+		sleepingTree = Physics::DynamicBBTree{ 1 };
+		mSleepingIslands.clear();
+		mSleepingIslandOf.clear();
+		mTouchedSleepingBodies.clear();
+
+		for (size_t i = 0; i < mAwakeBodies.size(); i++)
+			StoreBody(i);
+		mBodies.Clear();
+		mAwakeBodies.clear();
+		mAwakeIndices.clear();
+		mAwakeBounds.clear();
+	}
+
+	GetTree(type).Build(proxies);
+	for (const auto& [entity, box] : proxies)
+	{
+		mBodyTypes[entity] = type;
+		if (type == Physics::BodyType::DYNAMIC)
+			AddAwakeBody(entity);
+	}
+}
+
+void PhysicsSystem::SetBodyType(const Entity entity, const Physics::BodyType type)
+{
+	const auto iterator = mBodyTypes.find(entity);
+	if (iterator == mBodyTypes.end())
+	{
+		LOG(LOG_ERROR) << "Physics System: Trying to set body type of entity " << entity << " not in a tree.\n";
+		return;
+	}
+	if (iterator->second == type) return;
+
+	// Sleeping bodies are in neither tree a body type has
+	WakeUp(entity);
+	if (iterator->second == Physics::BodyType::DYNAMIC)
+		RemoveAwakeBody(entity);
+	else if (type == Physics::BodyType::DYNAMIC)
+		AddAwakeBody(entity);
+
+	GetTree(iterator->second).MoveEntity(entity, GetTree(type));
+	iterator->second = type;
+}
+
+Physics::BodyType PhysicsSystem::GetBodyType(const Entity entity) const
+{
+	const auto iterator = mBodyTypes.find(entity);
+	assert(iterator != mBodyTypes.end() && "Trying to get body type of entity not in a tree");
+	return iterator->second;
+}
+
+std::vector<Entity> PhysicsSystem::ComputeCollisionPairs() const
+{
+	// Static and kinematic bodies don't respond to collisions, so they're never paired with each other
+	auto output = tree.ComputeCollisionPairs();
+
+	const auto kinematicPairs = tree.ComputeCollisionPairs(kinematicTree);
+	output.insert(output.end(), kinematicPairs.begin(), kinematicPairs.end());
+
+	const auto staticPairs = tree.ComputeCollisionPairs(staticTree);
+	output.insert(output.end(), staticPairs.begin(), staticPairs.end());
+
+	return output;
+}
+
+void PhysicsSystem::AddMeshCollider(Mesh& object)
+{
+	if (!object.mTree)
+		object.InitTree();
+
+	Components::MeshCollider collider{};
+	collider.tree = object.mTree;
+	mMeshColliders[object.mEntityID] = collider;
+}
+
+void PhysicsSystem::AddBoxCollider(const Entity entity, const glm::vec3& halfExtents)
+{
+	if (mConvexColliders.erase(entity))
+		LOG(LOG_WARNING) << "Physics System: Replacing convex collider of entity " << entity << " with a box.\n";
+
+	Components::BoxCollider collider{};
+	collider.halfExtents = halfExtents;
+	mBoxColliders[entity] = collider;
+	UpdateLocalBounds(entity);
+}
+
+void PhysicsSystem::AddConvexCollider(const Entity entity, std::vector<glm::vec3> points)
+{
+	if (points.empty())
+	{
+		LOG(LOG_ERROR) << "Physics System: Convex collider of entity " << entity << " needs at least one point.\n";
+		return;
+	}
+	if (mBoxColliders.erase(entity))
+		LOG(LOG_WARNING) << "Physics System: Replacing box collider of entity " << entity << " with a convex hull.\n";
+
+	Components::ConvexCollider collider{};
+	collider.points = std::move(points);
+	mConvexColliders[entity] = std::move(collider);
+	UpdateLocalBounds(entity);
+}
+
+bool PhysicsSystem::GetConvexShape(const Entity entity, Physics::ConvexShape& shape) const
+{
+	const auto box = mBoxColliders.find(entity);
+	const auto convex = mConvexColliders.find(entity);
+	if (box == mBoxColliders.end() && convex == mConvexColliders.end()) return false;
+
+	// Awake bodies' transforms are only placed once per update, the store has where they are this step
+	const auto& transform = world.GetComponent<Components::Transform>(entity);
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+	{
+		shape.position = mBodies.positions.Get(awake->second);
+		shape.rotation = glm::mat3_cast(mBodies.GetOrientation(awake->second));
+	}
+	else
+	{
+		shape.position = transform.worldPos;
+		shape.rotation = glm::mat3_cast(transform.rotation);
+	}
+	shape.scale = transform.scale;
+	if (box != mBoxColliders.end())
+	{
+		shape.type = Physics::ShapeType::BOX;
+		shape.halfExtents = box->second.halfExtents * glm::abs(transform.scale);
+	}
+	else
+	{
+		shape.type = Physics::ShapeType::HULL;
+		shape.points = convex->second.points.data();
+		shape.pointCount = convex->second.points.size();
+	}
+	return true;
+}
+
+void PhysicsSystem::SetFriction(const Entity entity, const float friction)
+{
+	Components::Collider* collider = nullptr;
+	if (const auto box = mBoxColliders.find(entity); box != mBoxColliders.end())
+		collider = &box->second;
+	else if (const auto convex = mConvexColliders.find(entity); convex != mConvexColliders.end())
+		collider = &convex->second;
+
+	if (!collider)
+	{
+		LOG(LOG_ERROR) << "Physics System: Trying to set friction of entity " << entity << " without a box or convex collider.\n";
+		return;
+	}
+	collider->friction = std::max(friction, 0.0f);
+}
+
+float PhysicsSystem::GetFriction(const Entity entity) const
+{
+	if (const auto box = mBoxColliders.find(entity); box != mBoxColliders.end())
+		return box->second.friction;
+	if (const auto convex = mConvexColliders.find(entity); convex != mConvexColliders.end())
+		return convex->second.friction;
+	return Components::Collider{}.friction;
+}
+
+void PhysicsSystem::Update(float dt)
+{
+	mAccumulator += std::max(dt, 0.0f);
+
+	unsigned int steps = 0;
+	while (mAccumulator >= mFixedStep && steps < mMaxSubsteps)
+	{
+		Step(mFixedStep);
+		mAccumulator -= mFixedStep;
+		steps++;
+	}
+
+	// Falling behind, the simulation runs slower than real time instead of taking longer every frame
+	if (mAccumulator >= mFixedStep)
+		mAccumulator = std::fmod(mAccumulator, mFixedStep);
+
+	Interpolate(GetInterpolationAlpha());
+}
+
+void PhysicsSystem::SetStepRate(const float stepsPerSecond)
+{
+	if (stepsPerSecond <= 0.0f)
+	{
+		LOG(LOG_ERROR) << "Physics System: Step rate has to be positive.\n";
+		return;
+	}
+
+	// Keeps the fraction of a step carried over the same
+	const float alpha = GetInterpolationAlpha();
+	mFixedStep = 1.0f / stepsPerSecond;
+	mAccumulator = alpha * mFixedStep;
+}
+
+void PhysicsSystem::Step(const float dt)
+{
+	WakeTouchedIslands();
+	IntegrateVelocities(dt);
+	ResolveCollisions();
+	SolveContacts(dt);
+	IntegratePositions(dt);
+	RelaxContacts();
+	UpdateIslands(dt);
+}
+
+void PhysicsSystem::Interpolate(const float alpha)
+{
+	// Sleeping bodies were left at their last position when they fell asleep
+	for (size_t i = 0; i < mAwakeBodies.size(); i++)
+	{
+		if (!mEntities.count(mAwakeBodies[i])) continue;
+
+		auto& transform = world.GetComponent<Components::Transform>(mAwakeBodies[i]);
+		transform.worldPos = glm::mix(mBodies.previousPositions.Get(i), mBodies.positions.Get(i), alpha);
+		transform.rotation = mBodies.GetOrientation(i);
+	}
+}
+
+void PhysicsSystem::Clean()
+{
+
+}
+
+void PhysicsSystem::ResolveCollisions()
+{
+	auto broadCollisions = ComputeCollisionPairs();
+
+	// Sleeping bodies go through the narrowphase with whatever could wake them, they only wake on actual contact
+	if (!mSleepingIslands.empty())
+	{
+		const auto sleepingPairs = tree.ComputeCollisionPairs(sleepingTree);
+		broadCollisions.insert(broadCollisions.end(), sleepingPairs.begin(), sleepingPairs.end());
+
+		const auto kinematicPairs = kinematicTree.ComputeCollisionPairs(sleepingTree);
+		for (size_t i = 0; i + 1 < kinematicPairs.size(); i += 2)
+		{
+			const Entity kinematic = kinematicPairs[i];
+			if (!mEntities.count(kinematic)) continue;
+
+			const auto& rb = world.GetComponent<Components::Rigidbody>(kinematic);
+			if (rb.linearVelocity == glm::vec3(0.0f) && rb.angularVelocity == glm::vec3(0.0f)) continue;
+			broadCollisions.push_back(kinematic);
+			broadCollisions.push_back(kinematicPairs[i + 1]);
+		}
+	}
+
+	// Narrowphase, broadphase pairs are stored one after another
+	mMeshContacts.clear();
+	for (size_t i = 0; i + 1 < broadCollisions.size(); i += 2)
+	{
+		const Entity a = broadCollisions[i];
+		const Entity b = broadCollisions[i + 1];
+
+		const auto colliderA = mMeshColliders.find(a);
+		const auto colliderB = mMeshColliders.find(b);
+		if (colliderA == mMeshColliders.end() || colliderB == mMeshColliders.end()) continue;
+
+		auto& transformA = world.GetComponent<Components::Transform>(a);
+		auto& transformB = world.GetComponent<Components::Transform>(b);
+		PlaceTransform(a, transformA);
+		PlaceTransform(b, transformB);
+
+		auto trianglePairs = colliderA->second.tree->QueryTree(*colliderB->second.tree, transformA.modelMat, transformB.modelMat);
+		if (!trianglePairs.empty())
+			mMeshContacts.push_back(Physics::MeshContact{ a, b, std::move(trianglePairs) });
+	}
+
+	// Shapes are placed once up front, so the parallel narrowphase only reads them
+	mShapes.clear();
+	for (const Entity entity : broadCollisions)
+	{
+		if (mShapes.count(entity)) continue;
+		Physics::ConvexShape shape;
+		if (GetConvexShape(entity, shape))
+			mShapes.emplace(entity, shape);
+	}
+	mNarrowphase.Update(broadCollisions, mShapes);
+
+	if (mSleepingIslands.empty()) return;
+	// Dynamic bodies without a rigidbody never move, so resting on one doesn't wake a body
+	const auto moves = [&](const Entity entity)
+	{
+		return mAwakeIndices.count(entity) || GetBodyType(entity) == Physics::BodyType::KINEMATIC;
+	};
+	const auto touch = [&](const Entity a, const Entity b)
+	{
+		if (mSleepingIslandOf.count(a) && moves(b))
+			mTouchedSleepingBodies.push_back(a);
+		if (mSleepingIslandOf.count(b) && moves(a))
+			mTouchedSleepingBodies.push_back(b);
+	};
+	for (const auto& manifold : mNarrowphase.GetManifolds())
+	{
+		if (manifold.pointCount > 0)
+			touch(manifold.a, manifold.b);
+	}
+	for (const auto& contact : mMeshContacts)
+		touch(contact.a, contact.b);
+}
+
+void PhysicsSystem::SolveContacts(const float dt)
+{
+	mContactSolver.Clear();
+	mSolverBodies.clear();
+	auto& manifolds = mNarrowphase.GetManifolds();
+	if (manifolds.empty()) return;
+
+	const auto addBody = [&](const Entity entity)
+	{
+		const auto found = mSolverBodies.find(entity);
+		if (found != mSolverBodies.end()) return found->second;
+
+		// Static, sleeping and bodies without a rigidbody are never moved, kinematic ones still push with their velocity
+		const auto& shape = mShapes.at(entity);
+		glm::vec3 linearVelocity(0.0f), angularVelocity(0.0f);
+		float inverseMass = 0.0f;
+		glm::mat3 inverseInertia(0.0f);
+		const Physics::BodyType type = GetBodyType(entity);
+		const auto awake = mAwakeIndices.find(entity);
+		if (awake != mAwakeIndices.end())
+		{
+			const size_t body = awake->second;
+			linearVelocity = mBodies.linearVelocities.Get(body);
+			angularVelocity = mBodies.angularVelocities.Get(body);
+			inverseMass = mBodies.inverseMasses[body];
+			inverseInertia = Physics::InverseInertia(shape, inverseMass);
+		}
+		else if (type == Physics::BodyType::KINEMATIC && mEntities.count(entity))
+		{
+			const auto& rb = world.GetComponent<Components::Rigidbody>(entity);
+			linearVelocity = rb.linearVelocity;
+			angularVelocity = rb.angularVelocity;
+		}
+
+		const uint32_t index = mContactSolver.AddBody(shape.position, linearVelocity, angularVelocity, inverseMass, inverseInertia);
+		mSolverBodies.emplace(entity, index);
+		return index;
+	};
+
+	for (auto& manifold : manifolds)
+	{
+		// Kinematic bodies touching sleeping ones only wake them
+		if (!mAwakeIndices.count(manifold.a) && !mAwakeIndices.count(manifold.b)) continue;
+
+		const uint32_t a = addBody(manifold.a);
+		const uint32_t b = addBody(manifold.b);
+		const float friction = std::sqrt(GetFriction(manifold.a) * GetFriction(manifold.b));
+		mContactSolver.AddManifold(manifold, a, b, friction);
+	}
+	mContactSolver.Solve(dt);
+	StoreSolverVelocities();
+}
+
+void PhysicsSystem::RelaxContacts()
+{
+	if (mSolverBodies.empty()) return;
+
+	mContactSolver.Relax();
+	StoreSolverVelocities();
+}
+
+void PhysicsSystem::StoreSolverVelocities()
+{
+	for (const auto& [entity, index] : mSolverBodies)
+	{
+		const auto awake = mAwakeIndices.find(entity);
+		if (awake == mAwakeIndices.end()) continue;
+
+		mBodies.linearVelocities.Set(awake->second, mContactSolver.GetLinearVelocity(index));
+		mBodies.angularVelocities.Set(awake->second, mContactSolver.GetAngularVelocity(index));
+	}
+}
+
+Physics::DynamicBBTree& PhysicsSystem::GetTree(const Physics::BodyType type)
+{
+	switch (type)
+	{
+	case Physics::BodyType::STATIC:
+		return staticTree;
+	case Physics::BodyType::KINEMATIC:
+		return kinematicTree;
+	default:
+		return tree;
+	}
+}
+
+void PhysicsSystem::IntegrateVelocities(float dt)
+{
+	// Only awake dynamic bodies are moved by the simulation
+	mBodies.IntegrateVelocities(dt, glm::vec3(0, GRAVITY, 0), std::pow(0.9f, dt));
+}
+
+void PhysicsSystem::IntegratePositions(float dt)
+{
+	mBodies.IntegratePositions(dt);
+
+	// Rotating changes a collider's bounds, so they're recomputed from the cached local ones instead of moved
+	for (size_t i = 0; i < mAwakeBodies.size(); i++)
+	{
+		const glm::vec3 position = mBodies.positions.Get(i);
+		const LocalBounds& bounds = mAwakeBounds[i];
+		if (!bounds.hasShape)
+		{
+			tree.UpdateEntity(mAwakeBodies[i], position - mBodies.previousPositions.Get(i));
+			continue;
+		}
+
+		const glm::mat3 rotation = glm::mat3_cast(mBodies.GetOrientation(i));
+		const glm::mat3 absolute(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+		const glm::vec3 center = position + rotation * bounds.center;
+		const glm::vec3 extent = absolute * bounds.extent;
+		tree.UpdateEntity(mAwakeBodies[i], BoundingBox(center - extent, center + extent));
+	}
+}
+
+void PhysicsSystem::AddAwakeBody(const Entity entity)
+{
+	// Dynamic bodies without a rigidbody are left where they are, like static ones
+	if (mAwakeIndices.count(entity) || !mEntities.count(entity)) return;
+
+	auto& rb = world.GetComponent<Components::Rigidbody>(entity);
+	const auto& transform = world.GetComponent<Components::Transform>(entity);
+	mAwakeIndices.emplace(entity, mBodies.Add(rb.position, transform.rotation, rb.linearVelocity, rb.angularVelocity, rb.forceAccumulator, rb.inverseMass));
+	mAwakeBodies.push_back(entity);
+	mAwakeBounds.push_back(GetLocalBounds(entity, transform.scale));
+	rb.ClearAccumulator();
+	rb.sleeping = false;
+}
+
+void PhysicsSystem::RemoveAwakeBody(const Entity entity)
+{
+	const auto found = mAwakeIndices.find(entity);
+	if (found == mAwakeIndices.end()) return;
+
+	// Moves the last body into the gap, like the store does
+	const size_t index = found->second;
+	StoreBody(index);
+	mAwakeIndices.erase(found);
+	if (index + 1 != mAwakeBodies.size())
+	{
+		mAwakeBodies[index] = mAwakeBodies.back();
+		mAwakeBounds[index] = mAwakeBounds.back();
+		mAwakeIndices[mAwakeBodies[index]] = index;
+	}
+	mAwakeBodies.pop_back();
+	mAwakeBounds.pop_back();
+	mBodies.Remove(index);
+}
+
+void PhysicsSystem::StoreBody(const size_t index)
+{
+	const Entity entity = mAwakeBodies[index];
+	if (!mEntities.count(entity)) return;
+
+	auto& rb = world.GetComponent<Components::Rigidbody>(entity);
+	rb.position = mBodies.positions.Get(index);
+	rb.previousPosition = mBodies.previousPositions.Get(index);
+	rb.linearVelocity = mBodies.linearVelocities.Get(index);
+	rb.angularVelocity = mBodies.angularVelocities.Get(index);
+	rb.forceAccumulator = mBodies.forces.Get(index);
+
+	auto& transform = world.GetComponent<Components::Transform>(entity);
+	transform.worldPos = rb.position;
+	transform.rotation = mBodies.GetOrientation(index);
+}
+
+void PhysicsSystem::PlaceTransform(const Entity entity, Components::Transform& transform) const
+{
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+	{
+		transform.worldPos = mBodies.positions.Get(awake->second);
+		transform.rotation = mBodies.GetOrientation(awake->second);
+	}
+	transform.CalculateModelMat();
+}
+
+PhysicsSystem::LocalBounds PhysicsSystem::GetLocalBounds(const Entity entity, const glm::vec3& scale) const
+{
+	LocalBounds bounds{};
+	if (const auto box = mBoxColliders.find(entity); box != mBoxColliders.end())
+	{
+		bounds.extent = box->second.halfExtents * glm::abs(scale);
+		bounds.hasShape = true;
+	}
+	else if (const auto convex = mConvexColliders.find(entity); convex != mConvexColliders.end())
+	{
+		glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+		for (const glm::vec3& point : convex->second.points)
+		{
+			min = glm::min(min, point * scale);
+			max = glm::max(max, point * scale);
+		}
+		bounds.center = 0.5f * (min + max);
+		bounds.extent = 0.5f * (max - min);
+		bounds.hasShape = true;
+	}
+	return bounds;
+}
+
+void PhysicsSystem::UpdateLocalBounds(const Entity entity)
+{
+	const auto awake = mAwakeIndices.find(entity);
+	if (awake == mAwakeIndices.end()) return;
+	mAwakeBounds[awake->second] = GetLocalBounds(entity, world.GetComponent<Components::Transform>(entity).scale);
+}
+
+void PhysicsSystem::AddForce(const Entity entity, const glm::vec3& force)
+{
+	WakeUp(entity);
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+		mBodies.forces.Set(awake->second, mBodies.forces.Get(awake->second) + force);
+	else if (mEntities.count(entity))
+		world.GetComponent<Components::Rigidbody>(entity).AddForce(force);
+}
+
+void PhysicsSystem::SetLinearVelocity(const Entity entity, const glm::vec3& velocity)
+{
+	WakeUp(entity);
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+		mBodies.linearVelocities.Set(awake->second, velocity);
+	else if (mEntities.count(entity))
+		world.GetComponent<Components::Rigidbody>(entity).linearVelocity = velocity;
+}
+
+void PhysicsSystem::SetAngularVelocity(const Entity entity, const glm::vec3& velocity)
+{
+	WakeUp(entity);
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+		mBodies.angularVelocities.Set(awake->second, velocity);
+	else if (mEntities.count(entity))
+		world.GetComponent<Components::Rigidbody>(entity).angularVelocity = velocity;
+}
+
+glm::vec3 PhysicsSystem::GetLinearVelocity(const Entity entity) const
+{
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+		return mBodies.linearVelocities.Get(awake->second);
+	if (mEntities.count(entity))
+		return world.GetComponent<Components::Rigidbody>(entity).linearVelocity;
+	return glm::vec3(0.0f);
+}
+
+glm::vec3 PhysicsSystem::GetAngularVelocity(const Entity entity) const
+{
+	if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+		return mBodies.angularVelocities.Get(awake->second);
+	if (mEntities.count(entity))
+		return world.GetComponent<Components::Rigidbody>(entity).angularVelocity;
+	return glm::vec3(0.0f);
+}
+
+void PhysicsSystem::WakeUp(const Entity entity)
+{
+	const auto found = mSleepingIslandOf.find(entity);
+	if (found == mSleepingIslandOf.end())
+	{
+		// Awake bodies start counting towards sleep again
+		if (const auto awake = mAwakeIndices.find(entity); awake != mAwakeIndices.end())
+			mBodies.sleepTimes[awake->second] = 0.0f;
+		return;
+	}
+
+	const auto island = mSleepingIslands.find(found->second);
+	for (const Entity body : island->second)
+	{
+		sleepingTree.MoveEntity(body, tree);
+		mSleepingIslandOf.erase(body);
+		AddAwakeBody(body);
+	}
+	mSleepingIslands.erase(island);
+}
+
+void PhysicsSystem::WakeTouchedIslands()
+{
+	// Woken at the start of a step, so the whole island's contacts are found together
+	for (const Entity entity : mTouchedSleepingBodies)
+		WakeUp(entity);
+	mTouchedSleepingBodies.clear();
+}
+
+void PhysicsSystem::UpdateIslands(const float dt)
+{
+	const size_t count = mAwakeBodies.size();
+	if (count == 0) return;
+
+	mIslandParents.resize(count);
+	for (size_t i = 0; i < count; i++)
+		mIslandParents[i] = i;
+
+	const auto find = [&](size_t i)
+	{
+		while (mIslandParents[i] != i)
+		{
+			// Path halving
+			mIslandParents[i] = mIslandParents[mIslandParents[i]];
+			i = mIslandParents[i];
+		}
+		return i;
+	};
+	// Static and kinematic bodies aren't in mAwakeIndices, so bodies resting on the same ground stay apart
+	const auto join = [&](const Entity a, const Entity b)
+	{
+		const auto foundA = mAwakeIndices.find(a);
+		const auto foundB = mAwakeIndices.find(b);
+		if (foundA == mAwakeIndices.end() || foundB == mAwakeIndices.end()) return;
+		mIslandParents[find(foundA->second)] = find(foundB->second);
+	};
+
+	for (const auto& manifold : mNarrowphase.GetManifolds())
+		join(manifold.a, manifold.b);
+	for (const auto& contact : mMeshContacts)
+		join(contact.a, contact.b);
+
+	// Islands can sleep once their most recently moving body has been slow long enough
+	std::vector<float> islandSleepTimes(count, std::numeric_limits<float>::max());
+	for (size_t i = 0; i < count; i++)
+	{
+		float& sleepTime = mBodies.sleepTimes[i];
+		if (glm::length(mBodies.linearVelocities.Get(i)) > SLEEP_LINEAR_VELOCITY || glm::length(mBodies.angularVelocities.Get(i)) > SLEEP_ANGULAR_VELOCITY)
+			sleepTime = 0.0f;
+		else
+			sleepTime += dt;
+
+		const size_t root = find(i);
+		islandSleepTimes[root] = std::min(islandSleepTimes[root], sleepTime);
+	}
+
+	// Sleeping islands are numbered by their root, bodies are moved once every island is found
+	std::unordered_map<size_t, uint32_t> islandIds;
+	std::vector<Entity> fallingAsleep;
+	for (size_t i = 0; i < count; i++)
+	{
+		const size_t root = find(i);
+		if (islandSleepTimes[root] < TIME_TO_SLEEP) continue;
+
+		auto [island, added] = islandIds.try_emplace(root, mNextIsland);
+		if (added) mNextIsland++;
+
+		const Entity entity = mAwakeBodies[i];
+		mSleepingIslands[island->second].push_back(entity);
+		mSleepingIslandOf.emplace(entity, island->second);
+		fallingAsleep.push_back(entity);
+	}
+
+	for (const Entity entity : fallingAsleep)
+	{
+		// Interpolation stops where the body fell asleep
+		const size_t index = mAwakeIndices.at(entity);
+		mBodies.linearVelocities.Set(index, glm::vec3(0.0f));
+		mBodies.angularVelocities.Set(index, glm::vec3(0.0f));
+		mBodies.previousPositions.Set(index, mBodies.positions.Get(index));
+
+		tree.MoveEntity(entity, sleepingTree);
+		RemoveAwakeBody(entity);
+		if (mEntities.count(entity))
+			world.GetComponent<Components::Rigidbody>(entity).sleeping = true;
+	}
+}
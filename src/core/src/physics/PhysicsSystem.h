@@ -2,7 +2,12 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "BodyStore.h"
+#include "ContactSolver.h"
+#include "ConvexCollider.h"
 #include "DynamicTree.h"
+#include "MeshCollider.h"
+#include "Narrowphase.h"
 
 #include "../core/World.h"
 
@@ -11,22 +16,104 @@
 
 #define GRAVITY -9.81
 
+namespace Physics
+{
+	// Decides which broadphase tree a body lives in and what it can collide with
+	enum class BodyType
+	{
+		// Never moves, only tested against dynamic bodies
+		STATIC,
+		// Moved by the user, only tested against dynamic bodies
+		KINEMATIC,
+		// Moved by the simulation, tested against everything
+		DYNAMIC
+	};
+
+	// Triangles of two meshes found intersecting in the narrowphase
+	struct MeshContact
+	{
+		Entity a, b;
+		// Triangle indices into a's and b's index buffers, divided by 3
+		std::vector<std::pair<size_t, size_t>> trianglePairs;
+	};
+}
+
 // http://graphics.stanford.edu/papers/rigid_bodies-sig03/
 class PhysicsSystem : public System
 {
 public:
+    // Awake dynamic bodies
     Physics::DynamicBBTree tree;
+	// Dynamic bodies that fell asleep, only tested against moving bodies to wake them
+	Physics::DynamicBBTree sleepingTree;
+    // Kinematic and static bodies are kept apart so they are never tested against themselves
+    Physics::DynamicBBTree kinematicTree;
+    Physics::DynamicBBTree staticTree;
 
     explicit PhysicsSystem();
 
 	void AddRigidbody(Mesh& object);
 	void AddRigidbody(Model& object);
 
-	void AddToTree(Mesh& object);
-	void AddToTree(Model& object);
-
+	void AddToTree(Mesh& object, Physics::BodyType type = Physics::BodyType::DYNAMIC);
+	void AddToTree(Model& object, Physics::BodyType type = Physics::BodyType::DYNAMIC);
+	// Bulk builds a body type's tree, replacing bodies of that type already in it
+	void BuildTree(const std::vector<std::pair<Entity, BoundingBox>>& proxies, Physics::BodyType type);
+
+	// Moves a body into the tree of another body type
+	void SetBodyType(Entity entity, Physics::BodyType type);
+	Physics::BodyType GetBodyType(Entity entity) const;
+
+	// Returns dynamic-dynamic, dynamic-kinematic and dynamic-static overlapping pairs, sleeping bodies are left out
+	std::vector<Entity> ComputeCollisionPairs() const;
+
+	// Uses the mesh's triangles for narrowphase collision, building its tree if it hasn't been built
+	void AddMeshCollider(Mesh& object);
+	// Mesh pairs with intersecting triangles found during the last update
+	const std::vector<Physics::MeshContact>& GetMeshContacts() const { return mMeshContacts; }
+
+	// Box in the body's local space, scaled with its transform
+	void AddBoxCollider(Entity entity, const glm::vec3& halfExtents);
+	// Convex hull of points in the body's local space, scaled with its transform
+	void AddConvexCollider(Entity entity, std::vector<glm::vec3> points);
+	// Contacts between box and convex colliders found during the last step, with the impulses that resolved them
+	const std::vector<Physics::ContactManifold>& GetContactManifolds() const { return mNarrowphase.GetManifolds(); }
+	// Sets the friction of an entity's box or convex collider
+	void SetFriction(Entity entity, float friction);
+	// More iterations make tall stacks stiffer, each one costs about as much as the first
+	void SetSolverIterations(unsigned int iterations) { mContactSolver.SetIterations(std::max(iterations, 1u)); }
+
+	// Advances the simulation by dt seconds in fixed steps, leftover time carries over to the next update
+	// Dynamic bodies' transforms are interpolated between the last two steps, so motion is smooth at any frame rate
     void Update(float dt);
 
+	// Bodies slower than these for TIME_TO_SLEEP seconds fall asleep, once every body they touch can too
+	static constexpr float SLEEP_LINEAR_VELOCITY = 0.05f;
+	static constexpr float SLEEP_ANGULAR_VELOCITY = 0.05f;
+	static constexpr float TIME_TO_SLEEP = 0.5f;
+
+	// Wakes a body and every body asleep with it
+	void WakeUp(Entity entity);
+	bool IsSleeping(Entity entity) const { return mSleepingIslandOf.count(entity) != 0; }
+	// Number of dynamic bodies the simulation steps
+	size_t GetAwakeBodyCount() const { return mAwakeBodies.size(); }
+
+	// Awake bodies are stepped from the system's own copy of their rigidbodies, so forces and velocities go through here
+	// Setting them wakes the body
+	void AddForce(Entity entity, const glm::vec3& force);
+	void SetLinearVelocity(Entity entity, const glm::vec3& velocity);
+	void SetAngularVelocity(Entity entity, const glm::vec3& velocity);
+	glm::vec3 GetLinearVelocity(Entity entity) const;
+	glm::vec3 GetAngularVelocity(Entity entity) const;
+
+	// Steps per simulated second, independent of the frame rate
+	void SetStepRate(float stepsPerSecond);
+	float GetFixedStep() const { return mFixedStep; }
+	// Steps an update can take, time past that is dropped so a slow frame can't make the next one slower
+	void SetMaxSubsteps(unsigned int maxSubsteps) { mMaxSubsteps = std::max(maxSubsteps, 1u); }
+	// How far rendered transforms are between the previous and the latest step, from 0 to 1
+	float GetInterpolationAlpha() const { return mAccumulator / mFixedStep; }
+
     void Clean() override;
 private:
     /*
@@ -46,80 +133,86 @@ private:
 		Update position
      */
     void ResolveCollisions();
-
-	// Iterates through all rigidbodies updating position and linearVelocity based on dt
-	void Integrate(float dt);
-};
-
-inline PhysicsSystem::PhysicsSystem()
-{
-    tree = Physics::DynamicBBTree{ 1 };
-}
-
-inline void PhysicsSystem::AddRigidbody(Mesh& object)
-{
-	Components::Rigidbody newRb{};
-	newRb.position = object.transform.worldPos;
-
-	world.AddComponent(object.mEntityID, newRb);
-	AddToTree(object);
-}
-
-inline void PhysicsSystem::AddRigidbody(Model& object)
-{
-	Components::Rigidbody newRb{};
-	newRb.position = object.transform.worldPos;
-
-	world.AddComponent(object.mEntityID, newRb);
-	AddToTree(object);
-}
-
-inline void PhysicsSystem::AddToTree(Mesh& object)
-{
-	LOG(LOG_INFO) << "Adding mesh with entity ID " << object.mEntityID << " to tree\n";
-	tree.InsertEntity(object.mEntityID, object.CalcBoundingBox());
-}
-
-inline void PhysicsSystem::AddToTree(Model& object)
-{
-	LOG(LOG_INFO) << "Adding model with entity ID " << object.mEntityID << " to tree\n";
-	tree.InsertEntity(object.mEntityID, object.CalcBoundingBox());
-}
-
-inline void PhysicsSystem::Update(float dt)
-{
-	Integrate(dt);
-}
-
-inline void PhysicsSystem::Clean()
-{
-
-}
-
-inline void PhysicsSystem::ResolveCollisions()
-{
-	const auto broadCollisions = tree.ComputeCollisionPairs();
-}
-
-inline void PhysicsSystem::Integrate(float dt)
-{
-	for (const auto entity : mEntities)
+	// Applies contact impulses to the bodies of the manifolds found by ResolveCollisions
+	void SolveContacts(float dt);
+	// Removes the velocity SolveContacts used to push bodies apart, once it has moved them
+	void RelaxContacts();
+	// Copies velocities the contact solver found to dynamic bodies
+	void StoreSolverVelocities();
+
+	// Advances every body by one fixed step
+	void Step(float dt);
+	// Places dynamic bodies' transforms between their previous and current positions
+	void Interpolate(float alpha);
+
+	// Adds forces and gravity to awake bodies' velocities
+	void IntegrateVelocities(float dt);
+	// Moves and spins awake bodies by their velocities, and moves them in the tree
+	void IntegratePositions(float dt);
+
+	// Wakes the islands of sleeping bodies the last step found in contact with an awake dynamic body or a moving kinematic one
+	void WakeTouchedIslands();
+	// Groups awake bodies touching each other into islands, islands whose bodies have all been slow long enough fall asleep
+	void UpdateIslands(float dt);
+	// Copies a dynamic body's rigidbody into mBodies, bodies without one aren't simulated
+	void AddAwakeBody(Entity entity);
+	// Writes a body back to its rigidbody and takes it out of mBodies
+	void RemoveAwakeBody(Entity entity);
+	// Copies an awake body's state to its rigidbody and transform
+	void StoreBody(size_t index);
+	// Places a transform where the body is this step and computes its model matrix
+	void PlaceTransform(Entity entity, Components::Transform& transform) const;
+
+	Physics::DynamicBBTree& GetTree(Physics::BodyType type);
+
+	std::unordered_map<Entity, Physics::BodyType> mBodyTypes;
+
+	// State of dynamic bodies that aren't asleep, the only ones stepped
+	// Kept between steps, rigidbodies are only written when a body leaves and transforms once per update
+	Physics::BodyStore mBodies;
+	// Entity of each body in mBodies
+	std::vector<Entity> mAwakeBodies;
+	// Index of each awake body in mBodies and mAwakeBodies
+	std::unordered_map<Entity, size_t> mAwakeIndices;
+
+	// Collider bounds in a body's space, scaled by its transform when it woke or its collider was added
+	struct LocalBounds
 	{
-		auto& rb = world.GetComponent<Components::Rigidbody>(entity);
-
-		glm::vec3 posOld = rb.position;
-		rb.position += rb.linearVelocity * dt;
-
-		glm::vec3 acceleration = rb.forceAccumulator * rb.inverseMass;
-		acceleration += glm::vec3(0, GRAVITY, 0);
-
-		rb.linearVelocity += acceleration * dt;
-		rb.linearVelocity *= pow(0.9,dt);
-
-		rb.ClearAccumulator();
-
-		auto& transform = world.GetComponent<Components::Transform>(entity);
-		transform.worldPos = rb.position;
-		tree.UpdateEntity(entity, rb.position - posOld);
-	}
-}
+		glm::vec3 center{ 0.0f };
+		glm::vec3 extent{ 0.0f };
+		// Bodies without a box or convex collider keep their tree box and move it
+		bool hasShape = false;
+	};
+	std::vector<LocalBounds> mAwakeBounds;
+	LocalBounds GetLocalBounds(Entity entity, const glm::vec3& scale) const;
+	void UpdateLocalBounds(Entity entity);
+	// Bodies of each sleeping island, woken together
+	std::unordered_map<uint32_t, std::vector<Entity>> mSleepingIslands;
+	std::unordered_map<Entity, uint32_t> mSleepingIslandOf;
+	// Sleeping bodies with contact points found during the last step, they stay put until their island wakes next step
+	std::vector<Entity> mTouchedSleepingBodies;
+	uint32_t mNextIsland = 0;
+	// Union-find parent of each awake body, by index in mAwakeBodies
+	std::vector<size_t> mIslandParents;
+
+	float mFixedStep = 1.0f / 60.0f;
+	unsigned int mMaxSubsteps = 8;
+	// Time not simulated yet, less than one step after each update
+	float mAccumulator = 0.0f;
+
+	std::unordered_map<Entity, Components::MeshCollider> mMeshColliders;
+	std::vector<Physics::MeshContact> mMeshContacts;
+
+	std::unordered_map<Entity, Components::BoxCollider> mBoxColliders;
+	std::unordered_map<Entity, Components::ConvexCollider> mConvexColliders;
+	Physics::Narrowphase mNarrowphase;
+	// Shapes of the bodies in broadphase pairs during the current step
+	std::unordered_map<Entity, Physics::ConvexShape> mShapes;
+	Physics::ContactSolver mContactSolver;
+	// Index of each body in mContactSolver
+	std::unordered_map<Entity, uint32_t> mSolverBodies;
+
+	// Places an entity's box or convex collider in the world, returns false if it has neither
+	bool GetConvexShape(Entity entity, Physics::ConvexShape& shape) const;
+	float GetFriction(Entity entity) const;
+};
@@ -0,0 +1,330 @@
+#include "SignedDistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "utils/Logger.h"
+#include "utils/TaskScheduler.h"
+#include "utils/Timer.h"
+
+namespace Physics
+{
+	void SignedDistanceField::Bake(const StaticTree& tree, const float voxelSize, const float bandWidth)
+	{
+		mBricks.clear();
+		mSamples.clear();
+
+		if (tree.mNodes.empty())
+		{
+			LOG(LOG_ERROR) << "Signed distance field: Can't bake a mesh without a tree.\n";
+			return;
+		}
+		if (voxelSize <= 0.0f || bandWidth <= 0.0f)
+		{
+			LOG(LOG_ERROR) << "Signed distance field: Voxel size and band width have to be positive.\n";
+			return;
+		}
+
+		Utils::Timer t("Signed distance field bake");
+
+		// Grid covers the band around the mesh, plus a sample so the outermost cells are outside the band
+		const BoundingBox bounds = tree.GetBounds();
+		const glm::vec3 padding(bandWidth + voxelSize);
+		mOrigin = bounds.min - padding;
+		mVoxelSize = voxelSize;
+		mBandWidth = bandWidth;
+		mSampleCount = glm::uvec3(glm::ceil((bounds.max + padding - mOrigin) / voxelSize)) + 1u;
+		mBrickCount = (mSampleCount + BRICK_SIZE - 1u) / BRICK_SIZE;
+
+		const size_t brickCount = static_cast<size_t>(mBrickCount.x) * mBrickCount.y * mBrickCount.z;
+		if (brickCount >= FAR_INSIDE)
+		{
+			LOG(LOG_ERROR) << "Signed distance field: " << brickCount << " bricks is more than the brick table can reference.\n";
+			return;
+		}
+
+		const auto brickCoordinates = [this](const size_t brick)
+		{
+			return glm::uvec3(brick % mBrickCount.x, brick / mBrickCount.x % mBrickCount.y, brick / (static_cast<size_t>(mBrickCount.x) * mBrickCount.y));
+		};
+		const auto samplePosition = [this](const glm::uvec3& sample)
+		{
+			return mOrigin + glm::vec3(sample) * mVoxelSize;
+		};
+
+		// Bricks whose samples are all farther than the band from the surface don't need samples
+		const float brickRadius = 0.5f * std::sqrt(3.0f) * static_cast<float>(BRICK_SIZE - 1) * voxelSize;
+		std::vector<glm::vec3> brickCenters(brickCount);
+		for (size_t brick = 0; brick < brickCount; brick++)
+			brickCenters[brick] = samplePosition(brickCoordinates(brick) * BRICK_SIZE) + glm::vec3(0.5f * static_cast<float>(BRICK_SIZE - 1) * voxelSize);
+		const auto nearest = tree.ClosestPoints(brickCenters, brickRadius + bandWidth);
+
+		mBricks.resize(brickCount);
+		std::vector<size_t> sampleBricks;
+		std::vector<size_t> farBricks;
+		std::vector<glm::vec3> farCenters;
+		for (size_t brick = 0; brick < brickCount; brick++)
+		{
+			if (nearest[brick].second)
+			{
+				mBricks[brick] = static_cast<uint32_t>(sampleBricks.size());
+				sampleBricks.push_back(brick);
+			}
+			else
+			{
+				farBricks.push_back(brick);
+				farCenters.push_back(brickCenters[brick]);
+			}
+		}
+
+		// Signs come from winding numbers, which stay correct for meshes with holes
+		const auto farWindings = tree.WindingNumbers(farCenters);
+		for (size_t i = 0; i < farBricks.size(); i++)
+			mBricks[farBricks[i]] = std::abs(farWindings[i]) >= 0.5f ? FAR_INSIDE : FAR_OUTSIDE;
+
+		mSamples.resize(sampleBricks.size() * BRICK_VOLUME);
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, sampleBricks.size(), 1, [&](const size_t begin, const size_t end)
+		{
+			std::vector<glm::vec3> positions(BRICK_VOLUME);
+			for (size_t i = begin; i < end; i++)
+			{
+				const glm::uvec3 base = brickCoordinates(sampleBricks[i]) * BRICK_SIZE;
+				for (unsigned int sample = 0; sample < BRICK_VOLUME; sample++)
+					positions[sample] = samplePosition(base + glm::uvec3(sample % BRICK_SIZE, sample / BRICK_SIZE % BRICK_SIZE, sample / (BRICK_SIZE * BRICK_SIZE)));
+
+				const auto distances = tree.ClosestPoints(positions, bandWidth);
+				const auto windings = tree.WindingNumbers(positions);
+
+				int8_t* samples = &mSamples[i * BRICK_VOLUME];
+				for (unsigned int sample = 0; sample < BRICK_VOLUME; sample++)
+				{
+					const float distance = distances[sample].second ? distances[sample].first.distance : bandWidth;
+					const float sign = std::abs(windings[sample]) >= 0.5f ? -1.0f : 1.0f;
+					samples[sample] = static_cast<int8_t>(std::lround(std::clamp(sign * distance / bandWidth, -1.0f, 1.0f) * QUANTIZED_MAX));
+				}
+			}
+		});
+
+		LOG(LOG_INFO) << "Baked signed distance field with " << sampleBricks.size() << " of " << brickCount << " bricks near the surface in "
+			<< std::to_string(t.GetElapsed()) << "s.\n";
+	}
+
+
+	void SignedDistanceField::Bake(const StaticTree& tree, const float voxelSize, const float bandWidth, const std::string& cacheDirectory)
+	{
+		// FNV-1a over the tree's mesh and the bake settings
+		uint64_t key = 14695981039346656037ull;
+		const auto hashBytes = [&key](const void* data, const size_t size)
+		{
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				key ^= bytes[i];
+				key *= 1099511628211ull;
+			}
+		};
+		const uint64_t treeKey = tree.GetKey();
+		hashBytes(&treeKey, sizeof(uint64_t));
+		hashBytes(&CACHE_VERSION, sizeof(uint32_t));
+		hashBytes(&voxelSize, sizeof(float));
+		hashBytes(&bandWidth, sizeof(float));
+
+		std::stringstream filename;
+		filename << std::hex << std::setw(16) << std::setfill('0') << key << ".sdf";
+		const std::string filepath = (std::filesystem::path(cacheDirectory) / filename.str()).string();
+
+		Utils::Timer t("Signed distance field cache");
+		if (treeKey != 0 && ReadCache(filepath, key))
+		{
+			LOG(LOG_INFO) << "Loaded signed distance field with " << mSamples.size() / BRICK_VOLUME << " bricks from cache in " << std::to_string(t.GetElapsed()) << "s.\n";
+			return;
+		}
+
+		Bake(tree, voxelSize, bandWidth);
+		if (IsBaked())
+			WriteCache(filepath, key);
+	}
+
+
+	float SignedDistanceField::Sample(const glm::vec3& point) const
+	{
+		glm::vec3 f;
+		float c[8];
+		if (!GetCell(point, f, c)) return mBandWidth;
+
+		const float x00 = c[0] + (c[1] - c[0]) * f.x;
+		const float x10 = c[2] + (c[3] - c[2]) * f.x;
+		const float x01 = c[4] + (c[5] - c[4]) * f.x;
+		const float x11 = c[6] + (c[7] - c[6]) * f.x;
+		const float y0 = x00 + (x10 - x00) * f.y;
+		const float y1 = x01 + (x11 - x01) * f.y;
+		return y0 + (y1 - y0) * f.z;
+	}
+
+
+	glm::vec3 SignedDistanceField::Gradient(const glm::vec3& point) const
+	{
+		glm::vec3 f;
+		float c[8];
+		if (!GetCell(point, f, c)) return glm::vec3(0.0f);
+
+		// Derivatives of the trilinear interpolation along each axis
+		const auto bilinear = [](const float a, const float b, const float c, const float d, const float u, const float v)
+		{
+			const float ab = a + (b - a) * u;
+			const float cd = c + (d - c) * u;
+			return ab + (cd - ab) * v;
+		};
+		const glm::vec3 gradient(
+			bilinear(c[1] - c[0], c[3] - c[2], c[5] - c[4], c[7] - c[6], f.y, f.z),
+			bilinear(c[2] - c[0], c[3] - c[1], c[6] - c[4], c[7] - c[5], f.x, f.z),
+			bilinear(c[4] - c[0], c[5] - c[1], c[6] - c[2], c[7] - c[3], f.x, f.y));
+
+		const float length = glm::length(gradient);
+		if (length <= 0.0f) return glm::vec3(0.0f);
+		return gradient / length;
+	}
+
+
+	size_t SignedDistanceField::GetMemoryUsage() const
+	{
+		return mBricks.size() * sizeof(uint32_t) + mSamples.size() * sizeof(int8_t);
+	}
+
+
+	bool SignedDistanceField::ReadCache(const std::string& filepath, const uint64_t key)
+	{
+		std::ifstream is(filepath, std::ios::binary);
+		if (!is) return false;
+
+		CacheHeader header{};
+		is.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+		if (!is || std::memcmp(header.magic, "SDFC", 4) != 0 || header.version != CACHE_VERSION || header.key != key)
+		{
+			LOG(LOG_WARNING) << "Signed distance field cache " << filepath << " is out of date, baking again.\n";
+			return false;
+		}
+
+		// The brick table has to cover the grid, and it and the samples have to fill the rest of the file, before anything is allocated
+		const std::streampos start = is.tellg();
+		is.seekg(0, std::ios::end);
+		const std::streampos end = is.tellg();
+		is.seekg(start);
+
+		bool valid = static_cast<bool>(is) && start >= 0 && end >= start && header.voxelSize > 0.0f && header.bandWidth > 0.0f;
+		const uint64_t remaining = valid ? static_cast<uint64_t>(end - start) : 0;
+		uint64_t brickTableSize = 1;
+		for (unsigned int d = 0; d < 3 && valid; d++)
+		{
+			valid = header.sampleCount[d] > 0 && header.brickCount[d] == (static_cast<uint64_t>(header.sampleCount[d]) + BRICK_SIZE - 1) / BRICK_SIZE;
+			brickTableSize *= header.brickCount[d];
+			valid = valid && brickTableSize <= remaining / sizeof(uint32_t);
+		}
+		valid = valid && header.sampleBrickCount <= brickTableSize && header.sampleBrickCount * BRICK_VOLUME == remaining - brickTableSize * sizeof(uint32_t);
+		if (!valid)
+		{
+			LOG(LOG_WARNING) << "Signed distance field cache " << filepath << " is corrupt, baking again.\n";
+			return false;
+		}
+
+		std::vector<uint32_t> bricks(brickTableSize);
+		std::vector<int8_t> samples(header.sampleBrickCount * BRICK_VOLUME);
+		is.read(reinterpret_cast<char*>(bricks.data()), static_cast<std::streamsize>(bricks.size() * sizeof(uint32_t)));
+		is.read(reinterpret_cast<char*>(samples.data()), static_cast<std::streamsize>(samples.size() * sizeof(int8_t)));
+		// Bricks either point at samples the file holds or have none
+		const bool bricksValid = std::all_of(bricks.begin(), bricks.end(), [&](const uint32_t entry)
+		{
+			return entry < header.sampleBrickCount || entry == FAR_OUTSIDE || entry == FAR_INSIDE;
+		});
+		if (!is || !bricksValid)
+		{
+			LOG(LOG_WARNING) << "Signed distance field cache " << filepath << " is truncated or corrupt, baking again.\n";
+			return false;
+		}
+
+		mOrigin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+		mVoxelSize = header.voxelSize;
+		mBandWidth = header.bandWidth;
+		mSampleCount = glm::uvec3(header.sampleCount[0], header.sampleCount[1], header.sampleCount[2]);
+		mBrickCount = glm::uvec3(header.brickCount[0], header.brickCount[1], header.brickCount[2]);
+		mBricks.swap(bricks);
+		mSamples.swap(samples);
+		return true;
+	}
+
+
+	void SignedDistanceField::WriteCache(const std::string& filepath, const uint64_t key) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(filepath).parent_path(), error);
+
+		// Written under another name first, so a crash never leaves a partial file behind
+		const std::string tempPath = filepath + ".tmp";
+		{
+			std::ofstream os(tempPath, std::ios::binary | std::ios::trunc);
+
+			CacheHeader header{};
+			std::memcpy(header.magic, "SDFC", 4);
+			header.version = CACHE_VERSION;
+			header.key = key;
+			for (unsigned int d = 0; d < 3; d++)
+			{
+				header.origin[d] = mOrigin[d];
+				header.sampleCount[d] = mSampleCount[d];
+				header.brickCount[d] = mBrickCount[d];
+			}
+			header.voxelSize = mVoxelSize;
+			header.bandWidth = mBandWidth;
+			header.sampleBrickCount = mSamples.size() / BRICK_VOLUME;
+
+			os.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+			os.write(reinterpret_cast<const char*>(mBricks.data()), static_cast<std::streamsize>(mBricks.size() * sizeof(uint32_t)));
+			os.write(reinterpret_cast<const char*>(mSamples.data()), static_cast<std::streamsize>(mSamples.size() * sizeof(int8_t)));
+			if (!os)
+			{
+				LOG(LOG_WARNING) << "Failed to write signed distance field cache " << filepath << "\n";
+				os.close();
+				std::filesystem::remove(tempPath, error);
+				return;
+			}
+		}
+		std::filesystem::rename(tempPath, filepath, error);
+		if (error)
+			LOG(LOG_WARNING) << "Failed to write signed distance field cache " << filepath << "\n";
+	}
+
+
+	float SignedDistanceField::Fetch(const glm::uvec3& sample) const
+	{
+		const glm::uvec3 brick = sample / BRICK_SIZE;
+		const uint32_t entry = mBricks[(static_cast<size_t>(brick.z) * mBrickCount.y + brick.y) * mBrickCount.x + brick.x];
+		if (entry == FAR_OUTSIDE) return mBandWidth;
+		if (entry == FAR_INSIDE) return -mBandWidth;
+
+		const glm::uvec3 local = sample % BRICK_SIZE;
+		const int8_t value = mSamples[static_cast<size_t>(entry) * BRICK_VOLUME + (local.z * BRICK_SIZE + local.y) * BRICK_SIZE + local.x];
+		return static_cast<float>(value) * (mBandWidth / QUANTIZED_MAX);
+	}
+
+
+	bool SignedDistanceField::GetCell(const glm::vec3& point, glm::vec3& fraction, float (&corners)[8]) const
+	{
+		if (mBricks.empty()) return false;
+
+		const glm::vec3 position = (point - mOrigin) / mVoxelSize;
+		const glm::vec3 last = glm::vec3(mSampleCount - 1u);
+		if (glm::any(glm::lessThan(position, glm::vec3(0.0f))) || glm::any(glm::greaterThan(position, last))) return false;
+
+		// Points on the last sample use the cell before it
+		const glm::uvec3 cell = glm::min(glm::uvec3(position), mSampleCount - 2u);
+		fraction = position - glm::vec3(cell);
+		for (unsigned int corner = 0; corner < 8; corner++)
+			corners[corner] = Fetch(cell + glm::uvec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+		return true;
+	}
+}
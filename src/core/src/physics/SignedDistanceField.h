@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "StaticTree.h"
+
+// Signed distance to a mesh sampled on a sparse grid, so colliding against a complex static mesh is a lookup instead of a tree traversal
+// Only bricks of samples near the surface are stored, the rest only keep whether they're inside
+namespace Physics
+{
+	class SignedDistanceField
+	{
+	public:
+		// Samples per brick along each axis
+		static constexpr unsigned int BRICK_SIZE = 8;
+		static constexpr unsigned int BRICK_VOLUME = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+		SignedDistanceField() = default;
+
+		// Samples the mesh held by tree every voxelSize in its local space
+		// Distances are stored within bandWidth of the surface, farther ones are clamped to it
+		void Bake(const StaticTree& tree, float voxelSize, float bandWidth);
+		// Same as Bake, but reuses a field saved in cacheDirectory by an earlier bake of the same mesh and settings
+		// Newly baked fields are saved there
+		void Bake(const StaticTree& tree, float voxelSize, float bandWidth, const std::string& cacheDirectory);
+
+		bool IsBaked() const { return !mBricks.empty(); }
+
+		// Trilinearly interpolated distance to the surface, negative inside the mesh
+		// Points outside the grid are treated as outside the band
+		float Sample(const glm::vec3& point) const;
+		// Direction the distance grows fastest in, which points out of the mesh near its surface
+		// Zero where the distance is flat, such as far from the surface
+		glm::vec3 Gradient(const glm::vec3& point) const;
+
+		float GetVoxelSize() const { return mVoxelSize; }
+		float GetBandWidth() const { return mBandWidth; }
+		// Bytes used by the brick table and samples
+		size_t GetMemoryUsage() const;
+
+	private:
+		// Brick table values of bricks without samples
+		static constexpr uint32_t FAR_OUTSIDE = UINT32_MAX;
+		static constexpr uint32_t FAR_INSIDE = UINT32_MAX - 1;
+		// Quantized samples use [-QUANTIZED_MAX, QUANTIZED_MAX] for [-bandWidth, bandWidth]
+		static constexpr float QUANTIZED_MAX = 127.0f;
+
+		static constexpr uint32_t CACHE_VERSION = 2;
+
+		// Written at the start of cache files
+		struct CacheHeader
+		{
+			char magic[4];
+			uint32_t version;
+			// Hash of the mesh and bake settings the field was baked from
+			uint64_t key;
+			float origin[3];
+			float voxelSize;
+			float bandWidth;
+			uint32_t sampleCount[3];
+			uint32_t brickCount[3];
+			uint64_t sampleBrickCount;
+		};
+
+		// Position of sample 0, 0, 0
+		glm::vec3 mOrigin{};
+		float mVoxelSize = 0.0f;
+		float mBandWidth = 0.0f;
+		glm::uvec3 mSampleCount{};
+		glm::uvec3 mBrickCount{};
+
+		// Per brick, either the brick's offset into mSamples in bricks or FAR_OUTSIDE or FAR_INSIDE
+		std::vector<uint32_t> mBricks;
+		// Distances divided by bandWidth and quantized, bricks of samples ordered x first
+		std::vector<int8_t> mSamples;
+
+		// Returns false if the file doesn't exist or doesn't match the key
+		bool ReadCache(const std::string& filepath, uint64_t key);
+		void WriteCache(const std::string& filepath, uint64_t key) const;
+
+		// Distance stored at a sample, coordinates have to be inside the grid
+		float Fetch(const glm::uvec3& sample) const;
+		// Finds the cell holding point and its 8 corner distances, returns false if point is outside the grid
+		bool GetCell(const glm::vec3& point, glm::vec3& fraction, float (&corners)[8]) const;
+	};
+}
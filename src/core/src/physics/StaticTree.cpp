@@ -1,219 +1,2047 @@
 #include "StaticTree.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define STATIC_TREE_SSE2
+#endif
+
+#include "math/Intersect.h"
 #include "utils/Logger.h"
+#include "utils/RadixSort.h"
 #include "utils/Timer.h"
+#include <glm/gtc/constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "../core/GlobalTypes.h"
 
 
-namespace Physics {
-    void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices)
+namespace Physics {
+    void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, const BuildOptions& options)
+	{
+		LOG(LOG_INFO) << "Creating static tree with " << indices.size() / 3 << " triangles.\n";
+		ClearData();
+
+		size_t leafNodeAmount = indices.size() / 3;
+		if (leafNodeAmount == 0)
+		{
+			LOG(LOG_WARNING) << "Static tree: Mesh has no triangles.\n";
+			return;
+		}
+
+		mOptions = options;
+		mOptions.binCount = std::clamp(mOptions.binCount, 2u, BuildOptions::MAX_BINS);
+		mOptions.maxLeafSize = std::max(mOptions.maxLeafSize, 1u);
+		mOptions.spatialSplitBudget = std::max(mOptions.spatialSplitBudget, 0.0f);
+		mKey = HashMesh(vertices, indices, options);
+		mKeyReady = true;
+
+		// Spatial splits can add a leaf for each duplicated triangle
+		size_t maxReferences = leafNodeAmount;
+		if (mOptions.method == BuildMethod::SBVH)
+			maxReferences += static_cast<size_t>(static_cast<double>(leafNodeAmount) * mOptions.spatialSplitBudget);
+
+		if (maxReferences * 2 + 1 > UINT32_MAX)
+		{
+			LOG(LOG_ERROR) << "Static tree: " << maxReferences << " triangles is more than 32-bit node indices can reference.\n";
+			return;
+		}
+
+		Utils::Timer t("StaticTree");
+
+		// Includes leaf nodes and internal nodes
+		mNodes.resize(maxReferences * 2 + 1);
+		mMeshTriangleCount = leafNodeAmount;
+
+		// Transfer vertice and indice information into triangle vector
+		mCentroids.resize(leafNodeAmount);
+		mTriIdx.resize(leafNodeAmount);
+		mTriangles.resize(leafNodeAmount);
+		for (size_t i = 0; i < leafNodeAmount; i++)
+		{
+			mTriIdx[i] = i;
+
+			Triangle& tri = mTriangles[i];
+			tri.v1 = vertices[indices[i * 3]].position;
+			tri.v2 = vertices[indices[i * 3 + 1]].position;
+			tri.v3 = vertices[indices[i * 3 + 2]].position;
+
+			mCentroids[i] = (tri.v1 + tri.v2 + tri.v3) * 0.33333f;
+		}
+
+		BVHNode& root = mNodes[0];
+		root.first = 0;
+		root.triCount = static_cast<uint32_t>(leafNodeAmount);
+		mNodesUsed = 1;
+
+		if (mOptions.method == BuildMethod::LBVH)
+		{
+			// 10 bits per axis runs out of precision once cells hold many triangles
+			if (leafNodeAmount < (1u << 20))
+				BuildLinear<uint32_t>();
+			else
+				BuildLinear<uint64_t>();
+		}
+		else if (mOptions.method == BuildMethod::SBVH)
+		{
+			std::vector<Reference> references(leafNodeAmount);
+			BoundingBox rootBox;
+			for (size_t i = 0; i < leafNodeAmount; i++)
+			{
+				const Triangle& tri = mTriangles[i];
+				Reference& reference = references[i];
+				reference.box.IncludePoint(tri.v1);
+				reference.box.IncludePoint(tri.v2);
+				reference.box.IncludePoint(tri.v3);
+				reference.triangle = static_cast<uint32_t>(i);
+				rootBox.IncludePoint(reference.box.min);
+				rootBox.IncludePoint(reference.box.max);
+			}
+			rootBox.UpdateSurfaceArea();
+			mRootArea = rootBox.surfaceArea;
+			mSpatialBudget = maxReferences - leafNodeAmount;
+			mReferenceOutput.reserve(maxReferences);
+
+			SubdivideSpatial(0, std::move(references));
+			mTriIdx.swap(mReferenceOutput);
+			mReferenceOutput = std::vector<size_t>();
+		}
+		else
+			Subdivide(0);
+
+		// Put triangles in leaf order so traversal reads them contiguously, and match the mesh's indices to them
+		// A triangle split by spatial splits is in several leaves, the mesh's indices follow its first one
+		const size_t referenceCount = mTriIdx.size();
+		std::vector<Triangle> sortedTriangles(referenceCount);
+		std::vector<unsigned> sortedIndices;
+		sortedIndices.reserve(leafNodeAmount * 3);
+		std::vector<uint32_t> meshOrder(leafNodeAmount, UINT32_MAX);
+		if (referenceCount != leafNodeAmount)
+			mTriangleIds.resize(referenceCount);
+		for (size_t i = 0; i < referenceCount; i++)
+		{
+			const size_t triangle = mTriIdx[i];
+			if (meshOrder[triangle] == UINT32_MAX)
+			{
+				meshOrder[triangle] = static_cast<uint32_t>(sortedIndices.size() / 3);
+				for (size_t j = 0; j < 3; j++)
+					sortedIndices.push_back(indices[triangle * 3 + j]);
+			}
+			sortedTriangles[i] = mTriangles[triangle];
+			if (!mTriangleIds.empty())
+				mTriangleIds[i] = meshOrder[triangle];
+		}
+		// Triangles clipped away entirely aren't in the tree, but stay in the mesh
+		for (size_t triangle = 0; triangle < leafNodeAmount; triangle++)
+		{
+			if (meshOrder[triangle] != UINT32_MAX) continue;
+			for (size_t j = 0; j < 3; j++)
+				sortedIndices.push_back(indices[triangle * 3 + j]);
+		}
+		mTriangles.swap(sortedTriangles);
+		// Keeps any trailing indices that don't make up a full triangle
+		std::copy(sortedIndices.begin(), sortedIndices.end(), indices.begin());
+
+		// Build data is no longer needed
+		mTriIdx = std::vector<size_t>();
+		mCentroids = std::vector<glm::vec3>();
+		mNodes.resize(mNodesUsed);
+		mNodes.shrink_to_fit();
+
+		mBuildCost = ComputeCost();
+		Collapse();
+
+		LOG(LOG_INFO) << "Static tree finished with " << mNodesUsed << " nodes used in " << std::to_string(t.GetElapsed()) << "s.\n";
+	}
+
+
+	void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, const std::string& cacheDirectory, const BuildOptions& options)
+	{
+		const uint64_t key = HashMesh(vertices, indices, options);
+
+		std::stringstream filename;
+		filename << std::hex << std::setw(16) << std::setfill('0') << key << ".bvh";
+		const std::string filepath = (std::filesystem::path(cacheDirectory) / filename.str()).string();
+
+		Utils::Timer t("StaticTree cache");
+		if (ReadCache(filepath, key, indices, options))
+		{
+			LOG(LOG_INFO) << "Loaded static tree with " << mTriangles.size() << " triangles from cache in " << std::to_string(t.GetElapsed()) << "s.\n";
+			return;
+		}
+
+		CreateStaticTree(vertices, indices, options);
+		if (!mNodes.empty())
+			WriteCache(filepath, key, indices);
+	}
+
+
+	BuildOptions StaticTree::Autotune(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, std::vector<Ray> sampleRays)
+	{
+		constexpr size_t SAMPLE_RAY_COUNT = 4096;
+		// Casting the sample rays more than once evens out timing noise
+		constexpr unsigned int TIMING_RUNS = 2;
+
+		// Covers flat leaves with many bins for scanned meshes, and larger leaves for CAD meshes with long thin triangles
+		const BuildOptions candidates[] = {
+			{ 8, 1, 0.5f },
+			{ 8, 4, 1.0f },
+			{ 16, 4, 1.0f },
+			{ 16, 8, 1.0f },
+			{ 32, 2, 0.5f },
+			{ 32, 4, 1.0f },
+			{ 8, 8, 2.0f },
+			{ 8, 4, 1.0f, BuildMethod::LBVH },
+			{ 16, 4, 1.0f, BuildMethod::SBVH },
+		};
+
+		if (sampleRays.empty())
+		{
+			BoundingBox box;
+			for (const unsigned index : indices)
+				box.IncludePoint(vertices[index].position);
+			const glm::vec3 center = (box.min + box.max) * 0.5f;
+			const float radius = glm::length(box.max - box.min);
+
+			// Rays start on a sphere around the mesh and aim at points inside its bounds
+			std::mt19937 generator(0);
+			std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+			sampleRays.reserve(SAMPLE_RAY_COUNT);
+			for (size_t i = 0; i < SAMPLE_RAY_COUNT; i++)
+			{
+				const glm::vec3 direction = glm::normalize(glm::vec3(distribution(generator), distribution(generator), distribution(generator)) - 0.5f + 1e-4f);
+				const glm::vec3 target = box.min + (box.max - box.min) * glm::vec3(distribution(generator), distribution(generator), distribution(generator));
+				const glm::vec3 origin = center + direction * radius;
+				sampleRays.emplace_back(origin, target - origin);
+			}
+		}
+
+		BuildOptions bestOptions = candidates[0];
+		double bestTime = DBL_MAX;
+		for (const BuildOptions& options : candidates)
+		{
+			StaticTree candidate;
+			std::vector<unsigned> candidateIndices = indices;
+			candidate.CreateStaticTree(vertices, candidateIndices, options);
+
+			double time = DBL_MAX;
+			size_t hits = 0;
+			for (unsigned int run = 0; run < TIMING_RUNS; run++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				hits = 0;
+				for (const Ray& ray : sampleRays)
+					hits += candidate.Raycast(ray).second;
+				time = std::min(time, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			}
+
+			LOG(LOG_INFO) << "Static tree autotune: " << options.binCount << " bins, max leaf size " << options.maxLeafSize << ", traversal cost "
+				<< options.traversalCost << " took " << time << "s for " << sampleRays.size() << " rays (" << hits << " hits).\n";
+
+			if (time < bestTime)
+			{
+				bestTime = time;
+				bestOptions = options;
+			}
+		}
+
+		LOG(LOG_INFO) << "Static tree autotune picked " << bestOptions.binCount << " bins, max leaf size " << bestOptions.maxLeafSize << ", traversal cost " << bestOptions.traversalCost << ".\n";
+		CreateStaticTree(vertices, indices, bestOptions);
+		return bestOptions;
+	}
+
+
+	namespace
+	{
+		// FNV-1a over 8 byte words, with a shift so high bits reach the low ones
+		// Meshes are hashed every time a shared tree is looked up, so hashing a byte at a time was too slow
+		struct WordHash
+		{
+			uint64_t hash = 14695981039346656037ull;
+
+			void Word(const uint64_t word)
+			{
+				hash ^= word;
+				hash *= 1099511628211ull;
+				hash ^= hash >> 32;
+			}
+
+			void Bytes(const void* data, const size_t size)
+			{
+				const auto* bytes = static_cast<const unsigned char*>(data);
+				size_t i = 0;
+				for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+				{
+					uint64_t word;
+					std::memcpy(&word, bytes + i, sizeof(uint64_t));
+					Word(word);
+				}
+				if (i == size) return;
+
+				uint64_t word = 0;
+				std::memcpy(&word, bytes + i, size - i);
+				Word(word);
+			}
+
+			// Cache version and node size are hashed too, so trees saved in another format aren't loaded
+			void Options(const BuildOptions& options, const uint32_t version, const size_t nodeSize)
+			{
+				const uint32_t settings[] = { version, options.binCount, options.maxLeafSize, static_cast<uint32_t>(options.method), static_cast<uint32_t>(nodeSize) };
+				Bytes(settings, sizeof(settings));
+				Bytes(&options.traversalCost, sizeof(float));
+				Bytes(&options.spatialSplitBudget, sizeof(float));
+			}
+		};
+	}
+
+
+	uint64_t StaticTree::HashMesh(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices, const BuildOptions& options)
+	{
+		WordHash hash;
+		hash.Options(options, CACHE_VERSION, sizeof(BVHNode));
+
+		// Only positions affect the tree
+		for (const MeshPt& vertex : vertices)
+		{
+			uint64_t xy;
+			std::memcpy(&xy, &vertex.position.x, sizeof(uint64_t));
+			uint32_t z;
+			std::memcpy(&z, &vertex.position.z, sizeof(uint32_t));
+			hash.Word(xy);
+			hash.Word(z);
+		}
+		hash.Word(indices.size());
+		hash.Word(HashTriangles(indices));
+		return hash.hash;
+	}
+
+
+	uint64_t StaticTree::HashTriangles(const std::vector<unsigned>& indices)
+	{
+		// Building moves whole triangles and keeps indices that don't make up one at the end
+		uint64_t sum = 0;
+		size_t i = 0;
+		for (; i + 3 <= indices.size(); i += 3)
+		{
+			// SplitMix64 finalizer, so nearby triangles don't cancel out in the sum
+			uint64_t hash = (static_cast<uint64_t>(indices[i]) << 32 | indices[i + 1]) ^ static_cast<uint64_t>(indices[i + 2]) * 0x9e3779b97f4a7c15ull;
+			hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+			hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+			sum += hash ^ (hash >> 31);
+		}
+		for (; i < indices.size(); i++)
+			sum = sum * 31 + indices[i];
+		return sum;
+	}
+
+
+	uint64_t StaticTree::GetKey() const
+	{
+		if (mKeyReady) return mKey;
+
+		std::unique_lock<std::mutex> lock(keyMutex);
+		if (mKeyReady) return mKey;
+
+		// The refit mesh isn't kept, so the tree's own triangles are hashed in leaf order
+		WordHash hash;
+		hash.Options(mOptions, CACHE_VERSION, sizeof(BVHNode));
+		hash.Bytes(mTriangles.data(), mTriangles.size() * sizeof(Triangle));
+		hash.Bytes(mTriangleIds.data(), mTriangleIds.size() * sizeof(uint32_t));
+
+		mKey = mNodes.empty() ? 0 : hash.hash;
+		mKeyReady = true;
+		return mKey;
+	}
+
+
+	bool StaticTree::Read(std::istream& is, const uint64_t key, std::vector<unsigned>& indices, const BuildOptions& options)
+	{
+		CacheHeader header{};
+		is.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+		if (!is || std::memcmp(header.magic, "BVHC", 4) != 0 || header.version != CACHE_VERSION || header.key != key || header.indexCount != indices.size())
+			return false;
+
+		// Counts are checked against each other and the bytes left before anything is allocated, files can hold more after the tree
+		const std::streampos start = is.tellg();
+		is.seekg(0, std::ios::end);
+		const std::streampos end = is.tellg();
+		is.seekg(start);
+		if (start < 0 || end < start || !is) return false;
+
+		const uint64_t remaining = static_cast<uint64_t>(end - start);
+		const uint64_t meshTriangleCount = header.indexCount / 3;
+		// Trees without spatial splits hold each mesh triangle once and don't store ids
+		const bool hasIds = header.triangleIdCount != 0;
+		if (header.nodeCount == 0 || header.triangleCount == 0 || header.nodeCount > remaining / sizeof(BVHNode)
+			|| header.triangleCount > remaining / sizeof(Triangle) || header.nodeCount > header.triangleCount * 2
+			|| (hasIds ? header.triangleIdCount != header.triangleCount : header.triangleCount != meshTriangleCount))
+			return false;
+		if (header.nodeCount * sizeof(BVHNode) + header.triangleCount * sizeof(Triangle) + header.triangleIdCount * sizeof(uint32_t)
+			+ header.indexCount * sizeof(unsigned) > remaining)
+			return false;
+
+		ClearData();
+		mMeshTriangleCount = meshTriangleCount;
+		// Read straight into the final arrays, the layout matches memory
+		mNodes.resize(header.nodeCount);
+		mTriangles.resize(header.triangleCount);
+		mTriangleIds.resize(header.triangleIdCount);
+		std::vector<unsigned> savedIndices(header.indexCount);
+		is.read(reinterpret_cast<char*>(mNodes.data()), static_cast<std::streamsize>(mNodes.size() * sizeof(BVHNode)));
+		is.read(reinterpret_cast<char*>(mTriangles.data()), static_cast<std::streamsize>(mTriangles.size() * sizeof(Triangle)));
+		is.read(reinterpret_cast<char*>(mTriangleIds.data()), static_cast<std::streamsize>(mTriangleIds.size() * sizeof(uint32_t)));
+		is.read(reinterpret_cast<char*>(savedIndices.data()), static_cast<std::streamsize>(savedIndices.size() * sizeof(unsigned)));
+		if (!is || !IsValid())
+		{
+			ClearData();
+			return false;
+		}
+
+		indices.swap(savedIndices);
+		mNodesUsed = mNodes.size();
+		mOptions = options;
+		mKey = key;
+		mKeyReady = true;
+		mBuildCost = ComputeCost();
+		Collapse();
+		return true;
+	}
+
+
+	bool StaticTree::IsValid() const
+	{
+		// Children are always added after their parent, so this also rules out loops
+		for (size_t i = 0; i < mNodes.size(); i++)
+		{
+			const BVHNode& node = mNodes[i];
+			if (node.triCount > 0 ? static_cast<uint64_t>(node.first) + node.triCount > mTriangles.size()
+			                      : node.first <= i || static_cast<uint64_t>(node.first) + 1 >= mNodes.size())
+				return false;
+		}
+		for (const uint32_t id : mTriangleIds)
+		{
+			if (id >= mMeshTriangleCount) return false;
+		}
+		return true;
+	}
+
+
+	bool StaticTree::Write(std::ostream& os, const uint64_t key, const std::vector<unsigned>& indices) const
+	{
+		CacheHeader header{};
+		std::memcpy(header.magic, "BVHC", 4);
+		header.version = CACHE_VERSION;
+		header.key = key;
+		header.nodeCount = mNodes.size();
+		header.triangleCount = mTriangles.size();
+		header.triangleIdCount = mTriangleIds.size();
+		header.indexCount = indices.size();
+
+		os.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		os.write(reinterpret_cast<const char*>(mNodes.data()), static_cast<std::streamsize>(mNodes.size() * sizeof(BVHNode)));
+		os.write(reinterpret_cast<const char*>(mTriangles.data()), static_cast<std::streamsize>(mTriangles.size() * sizeof(Triangle)));
+		os.write(reinterpret_cast<const char*>(mTriangleIds.data()), static_cast<std::streamsize>(mTriangleIds.size() * sizeof(uint32_t)));
+		os.write(reinterpret_cast<const char*>(indices.data()), static_cast<std::streamsize>(indices.size() * sizeof(unsigned)));
+		return static_cast<bool>(os);
+	}
+
+
+	bool StaticTree::ReadCache(const std::string& filepath, const uint64_t key, std::vector<unsigned>& indices, const BuildOptions& options)
+	{
+		std::ifstream is(filepath, std::ios::binary);
+		if (!is) return false;
+
+		// The saved indices have to be the mesh's triangles reordered, or they could point past its vertices
+		std::vector<unsigned> savedIndices(indices.size());
+		if (!Read(is, key, savedIndices, options) || HashTriangles(savedIndices) != HashTriangles(indices))
+		{
+			LOG(LOG_WARNING) << "Static tree cache " << filepath << " is out of date or corrupt, rebuilding.\n";
+			ClearData();
+			return false;
+		}
+		indices.swap(savedIndices);
+		return true;
+	}
+
+
+	void StaticTree::WriteCache(const std::string& filepath, const uint64_t key, const std::vector<unsigned>& indices) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(filepath).parent_path(), error);
+
+		// Written under another name first, so a crash never leaves a partial file behind
+		const std::string tempPath = filepath + ".tmp";
+		{
+			std::ofstream os(tempPath, std::ios::binary | std::ios::trunc);
+			if (!Write(os, key, indices))
+			{
+				LOG(LOG_WARNING) << "Failed to write static tree cache " << filepath << "\n";
+				os.close();
+				std::filesystem::remove(tempPath, error);
+				return;
+			}
+		}
+		std::filesystem::rename(tempPath, filepath, error);
+		if (error)
+			LOG(LOG_WARNING) << "Failed to write static tree cache " << filepath << "\n";
+	}
+
+
+	bool StaticTree::Refit(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, const float maxCostGrowth)
+	{
+		// Triangles handled by a single task
+		constexpr size_t REFIT_GRAIN_SIZE = 4096;
+
+		if (mNodes.empty() || indices.size() / 3 != mMeshTriangleCount)
+		{
+			LOG(LOG_ERROR) << "Static tree: Refitting with " << indices.size() / 3 << " triangles, but the tree was built with " << mMeshTriangleCount << ".\n";
+			return false;
+		}
+
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, mTriangles.size(), REFIT_GRAIN_SIZE, [&](const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const size_t triangle = GetTriangleId(i);
+				Triangle& tri = mTriangles[i];
+				tri.v1 = vertices[indices[triangle * 3]].position;
+				tri.v2 = vertices[indices[triangle * 3 + 1]].position;
+				tri.v3 = vertices[indices[triangle * 3 + 2]].position;
+			}
+		});
+
+		mKeyReady = false;
+		mWindingReady = false;
+
+		// Refitting keeps the old splits, which get worse the more the mesh deforms
+		const float cost = RefitNode(0, 0) / mNodes[0].GetBox().surfaceArea;
+		if (cost <= mBuildCost * maxCostGrowth)
+		{
+			RefitWide();
+			return false;
+		}
+
+		LOG(LOG_INFO) << "Static tree cost grew from " << mBuildCost << " to " << cost << " after refitting, rebuilding.\n";
+		CreateStaticTree(vertices, indices, mOptions);
+		return true;
+	}
+
+
+	std::vector<std::pair<size_t, size_t>> StaticTree::QueryTree(const StaticTree& other, const glm::mat4& modelMat, const glm::mat4& otherModelMat) const
+	{
+		// Node pairs to split before handing them out to threads
+		const size_t TASKS_PER_THREAD = 4;
+
+		std::vector<std::pair<size_t, size_t>> output;
+		if (mNodesUsed == 0 || other.mNodesUsed == 0) return output;
+
+		// Everything is tested in this tree's local space, so only the other tree's boxes become oriented boxes
+		const glm::mat4 relative = glm::inverse(modelMat) * otherModelMat;
+		const Utils::SeparatingAxes axes{ glm::mat3(relative) };
+
+		const auto overlapping = [&](const size_t mine, const size_t theirs)
+		{
+			return Utils::BoxOrientedBox(mNodes[mine].GetBox(), Utils::TransformBox(other.mNodes[theirs].GetBox(), relative), axes);
+		};
+
+		// Appends colliding node pairs to next, and triangle pairs to pairOutput once both nodes are leaves
+		const auto visit = [&](const size_t mine, const size_t theirs, std::vector<std::pair<size_t, size_t>>& next, std::vector<std::pair<size_t, size_t>>& pairOutput)
+		{
+			const BVHNode& myNode = mNodes[mine];
+			const BVHNode& theirNode = other.mNodes[theirs];
+
+			if (IsLeaf(mine) && other.IsLeaf(theirs))
+			{
+				for (size_t j = theirNode.first; j < theirNode.first + theirNode.triCount; ++j)
+				{
+					const Triangle& theirTri = other.GetTriangle(j);
+					const glm::vec3 b[3] = {
+						glm::vec3(relative * glm::vec4(theirTri.v1, 1.0f)),
+						glm::vec3(relative * glm::vec4(theirTri.v2, 1.0f)),
+						glm::vec3(relative * glm::vec4(theirTri.v3, 1.0f))
+					};
+					for (size_t i = myNode.first; i < myNode.first + myNode.triCount; ++i)
+					{
+						const Triangle& myTri = GetTriangle(i);
+						const glm::vec3 a[3] = { myTri.v1, myTri.v2, myTri.v3 };
+						if (Utils::TriangleTriangle(a, b))
+							pairOutput.emplace_back(GetTriangleId(i), other.GetTriangleId(j));
+					}
+				}
+				return;
+			}
+
+			// Leaves are paired with the children of the other node
+			const size_t myChildCount = IsLeaf(mine) ? 1 : 2;
+			const size_t theirChildCount = other.IsLeaf(theirs) ? 1 : 2;
+			for (size_t i = 0; i < myChildCount; ++i)
+			{
+				const size_t myChild = IsLeaf(mine) ? mine : myNode.first + i;
+				for (size_t j = 0; j < theirChildCount; ++j)
+				{
+					const size_t theirChild = other.IsLeaf(theirs) ? theirs : theirNode.first + j;
+					if (overlapping(myChild, theirChild))
+						next.emplace_back(myChild, theirChild);
+				}
+			}
+		};
+
+		if (!overlapping(0, 0)) return output;
+
+		// Expand breadth first until there are enough independent node pairs to keep every thread busy
+		Utils::TaskScheduler& scheduler = Utils::TaskScheduler::GetInstance();
+		const size_t targetTasks = scheduler.ThreadCount() * TASKS_PER_THREAD;
+
+		std::vector<std::pair<size_t, size_t>> frontier{ { 0, 0 } };
+		while (!frontier.empty() && frontier.size() < targetTasks)
+		{
+			std::vector<std::pair<size_t, size_t>> next;
+			for (const auto& [mine, theirs] : frontier)
+				visit(mine, theirs, next, output);
+			frontier.swap(next);
+		}
+
+		// Each task finishes its node pairs depth first, using its own stack and output
+		std::mutex outputMutex;
+		scheduler.ParallelFor(0, frontier.size(), 1, [&](const size_t begin, const size_t end)
+		{
+			std::vector<std::pair<size_t, size_t>> localOutput;
+			std::vector<std::pair<size_t, size_t>> stack(frontier.begin() + begin, frontier.begin() + end);
+			while (!stack.empty())
+			{
+				const auto [mine, theirs] = stack.back();
+				stack.pop_back();
+				visit(mine, theirs, stack, localOutput);
+			}
+
+			std::unique_lock<std::mutex> lock(outputMutex);
+			output.insert(output.end(), localOutput.begin(), localOutput.end());
+		});
+
+		// Task completion order varies between runs
+		std::sort(output.begin(), output.end());
+		// Triangles duplicated by spatial splits can be found in more than one leaf
+		output.erase(std::unique(output.begin(), output.end()), output.end());
+		return output;
+	}
+
+
+	std::vector<BoundingBox> StaticTree::QueryTree(const BoundingBox& box)
+	{
+		std::vector<BoundingBox> output;
+		std::stack<size_t> stack;
+
+		stack.emplace(0);
+
+		while (!stack.empty())
+		{
+			size_t nodeID = stack.top();
+			stack.pop();
+
+			const BoundingBox nodeBox = mNodes[nodeID].GetBox();
+			if (box.IsColliding(nodeBox))
+			{
+				if (IsLeaf(nodeID))
+				{
+					output.emplace_back(nodeBox);
+				}
+				else
+				{
+					stack.emplace(mNodes[nodeID].first);
+					stack.emplace(mNodes[nodeID].first + 1);
+				}
+			}
+		}
+		return output;
+	}
+
+
+	std::pair<RayHit, bool> StaticTree::Raycast(const Ray& ray, const float tMax) const
+	{
+		if (!mWideNodes.empty()) return RaycastWide(ray, tMax);
+
+		RayHit best{ tMax, 0, glm::vec2(0.0f) };
+		bool hit = false;
+
+		if (mNodesUsed == 0) return std::make_pair(best, hit);
+
+		// Stores node index and entry distance
+		std::stack<std::pair<size_t, float>> stack;
+		{
+			const auto [t, colliding] = Utils::RayBox(ray, mNodes[0].GetBox(), best.t);
+			if (colliding) stack.emplace(0, t);
+		}
+
+		while (!stack.empty())
+		{
+			const auto [nodeIndex, tEntry] = stack.top();
+			stack.pop();
+
+			// A closer triangle was found after this node was pushed
+			if (tEntry > best.t) continue;
+
+			const BVHNode& node = mNodes[nodeIndex];
+			if (IsLeaf(nodeIndex))
+			{
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					float t;
+					glm::vec2 barycentrics;
+					if (Utils::RayTriangle(ray, tri.v1, tri.v2, tri.v3, best.t, t, barycentrics))
+					{
+						best = RayHit{ t, GetTriangleId(i), barycentrics };
+						hit = true;
+					}
+				}
+				continue;
+			}
+
+			const size_t left = node.first;
+			const size_t right = node.first + 1;
+			const auto [tLeft, hitLeft] = Utils::RayBox(ray, mNodes[left].GetBox(), best.t);
+			const auto [tRight, hitRight] = Utils::RayBox(ray, mNodes[right].GetBox(), best.t);
+
+			// Push the farther child first so the closer one is visited first
+			if (hitLeft && hitRight)
+			{
+				if (tLeft < tRight)
+				{
+					stack.emplace(right, tRight);
+					stack.emplace(left, tLeft);
+				}
+				else
+				{
+					stack.emplace(left, tLeft);
+					stack.emplace(right, tRight);
+				}
+			}
+			else if (hitLeft) stack.emplace(left, tLeft);
+			else if (hitRight) stack.emplace(right, tRight);
+		}
+		return std::make_pair(best, hit);
+	}
+
+
+	std::pair<RayHit, bool> StaticTree::RaycastWide(const Ray& ray, const float tMax) const
+	{
+		RayHit best{ tMax, 0, glm::vec2(0.0f) };
+		bool hit = false;
+
+		// Stores wide node index or leaf, and entry distance
+		std::vector<std::pair<uint32_t, float>> stack;
+		stack.reserve(64);
+		{
+			const auto [t, colliding] = Utils::RayBox(ray, mNodes[0].GetBox(), best.t);
+			if (colliding) stack.emplace_back(0, t);
+		}
+
+		while (!stack.empty())
+		{
+			const auto [child, tEntry] = stack.back();
+			stack.pop_back();
+
+			// A closer triangle was found after this node was pushed
+			if (tEntry > best.t) continue;
+
+			if (child & WIDE_LEAF)
+			{
+				const BVHNode& node = mNodes[child & ~WIDE_LEAF];
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					float t;
+					glm::vec2 barycentrics;
+					if (Utils::RayTriangle(ray, tri.v1, tri.v2, tri.v3, best.t, t, barycentrics))
+					{
+						best = RayHit{ t, GetTriangleId(i), barycentrics };
+						hit = true;
+					}
+				}
+				continue;
+			}
+
+			const WideNode& node = mWideNodes[child];
+			float tChildren[4];
+			const unsigned int mask = IntersectChildren(node, ray, best.t, tChildren);
+
+			// Hit children sorted farthest first, so the closest one ends up on top of the stack
+			std::pair<uint32_t, float> hits[4];
+			unsigned int hitCount = 0;
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				if (!(mask & (1u << i)) || node.children[i] == WIDE_EMPTY) continue;
+
+				unsigned int position = hitCount++;
+				for (; position > 0 && hits[position - 1].second < tChildren[i]; position--)
+					hits[position] = hits[position - 1];
+				hits[position] = std::make_pair(node.children[i], tChildren[i]);
+			}
+			stack.insert(stack.end(), hits, hits + hitCount);
+		}
+		return std::make_pair(best, hit);
+	}
+
+
+	std::vector<size_t> StaticTree::QueryTriangles(const BoundingBox& box) const
+	{
+		std::vector<size_t> output;
+		if (mNodesUsed == 0) return output;
+
+		// Tree too large to collapse, the binary nodes are walked with leaves flagged the same way
+		if (mWideNodes.empty())
+		{
+			std::vector<size_t> nodes{ 0 };
+			while (!nodes.empty())
+			{
+				const size_t nodeIndex = nodes.back();
+				nodes.pop_back();
+				if (!box.IsColliding(mNodes[nodeIndex].GetBox())) continue;
+
+				if (IsInternal(nodeIndex))
+				{
+					nodes.push_back(mNodes[nodeIndex].first);
+					nodes.push_back(mNodes[nodeIndex].first + 1);
+					continue;
+				}
+				const BVHNode& node = mNodes[nodeIndex];
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					const glm::vec3 triangleMin = glm::min(glm::min(tri.v1, tri.v2), tri.v3);
+					const glm::vec3 triangleMax = glm::max(glm::max(tri.v1, tri.v2), tri.v3);
+					if (glm::all(glm::lessThanEqual(triangleMin, box.max)) && glm::all(glm::greaterThanEqual(triangleMax, box.min)))
+						output.push_back(GetTriangleId(i));
+				}
+			}
+			return output;
+		}
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		if (box.IsColliding(mNodes[0].GetBox())) stack.push_back(0);
+
+		while (!stack.empty())
+		{
+			const uint32_t child = stack.back();
+			stack.pop_back();
+
+			if (child & WIDE_LEAF)
+			{
+				const BVHNode& node = mNodes[child & ~WIDE_LEAF];
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					const glm::vec3 triangleMin = glm::min(glm::min(tri.v1, tri.v2), tri.v3);
+					const glm::vec3 triangleMax = glm::max(glm::max(tri.v1, tri.v2), tri.v3);
+					if (glm::all(glm::lessThanEqual(triangleMin, box.max)) && glm::all(glm::greaterThanEqual(triangleMax, box.min)))
+						output.push_back(GetTriangleId(i));
+				}
+				continue;
+			}
+
+			const WideNode& node = mWideNodes[child];
+			const unsigned int mask = OverlapChildren(node, box);
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				if ((mask & (1u << i)) && node.children[i] != WIDE_EMPTY)
+					stack.push_back(node.children[i]);
+			}
+		}
+
+		// Spatial splits can store a triangle in more than one leaf
+		if (!mTriangleIds.empty())
+		{
+			std::sort(output.begin(), output.end());
+			output.erase(std::unique(output.begin(), output.end()), output.end());
+		}
+		return output;
+	}
+
+
+	std::vector<RayHit> StaticTree::RaycastAll(const Ray& ray, const float tMax) const
+	{
+		std::vector<RayHit> output;
+		if (mNodesUsed == 0) return output;
+
+		std::stack<size_t> stack;
+		stack.push(0);
+		while (!stack.empty())
+		{
+			const size_t nodeIndex = stack.top();
+			stack.pop();
+
+			const BVHNode& node = mNodes[nodeIndex];
+			if (!Utils::RayBox(ray, node.GetBox(), tMax).second) continue;
+
+			if (IsLeaf(nodeIndex))
+			{
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					float t;
+					glm::vec2 barycentrics;
+					if (Utils::RayTriangle(ray, tri.v1, tri.v2, tri.v3, tMax, t, barycentrics))
+						output.push_back(RayHit{ t, GetTriangleId(i), barycentrics });
+				}
+				continue;
+			}
+
+			stack.push(node.first);
+			stack.push(node.first + 1);
+		}
+
+		// Spatial splits can store a triangle in more than one leaf
+		std::sort(output.begin(), output.end(), [](const RayHit& a, const RayHit& b)
+		{
+			return a.t < b.t || (a.t == b.t && a.triangle < b.triangle);
+		});
+		if (!mTriangleIds.empty())
+		{
+			output.erase(std::unique(output.begin(), output.end(), [](const RayHit& a, const RayHit& b)
+			{
+				return a.triangle == b.triangle;
+			}), output.end());
+		}
+		return output;
+	}
+
+
+	std::pair<ClosestHit, bool> StaticTree::ClosestPoint(const glm::vec3& point, const float maxDistance) const
+	{
+		std::vector<std::pair<float, uint32_t>> stack;
+		return ClosestPoint(point, maxDistance, stack);
+	}
+
+	std::vector<std::pair<ClosestHit, bool>> StaticTree::ClosestPoints(const glm::vec3* points, const size_t count, const float maxDistance) const
+	{
+		std::vector<std::pair<ClosestHit, bool>> output(count);
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, count, 256, [&](const size_t begin, const size_t end)
+		{
+			std::vector<std::pair<float, uint32_t>> stack;
+			for (size_t i = begin; i < end; ++i)
+				output[i] = ClosestPoint(points[i], maxDistance, stack);
+		});
+		return output;
+	}
+
+	std::vector<std::pair<ClosestHit, bool>> StaticTree::ClosestPoints(const std::vector<glm::vec3>& points, const float maxDistance) const
+	{
+		return ClosestPoints(points.data(), points.size(), maxDistance);
+	}
+
+	std::pair<ClosestHit, bool> StaticTree::ClosestPoint(const glm::vec3& point, const float maxDistance, std::vector<std::pair<float, uint32_t>>& stack) const
+	{
+		ClosestHit best{ point, 0, maxDistance };
+		bool found = false;
+
+		if (mNodesUsed == 0) return std::make_pair(best, found);
+
+		float bestSquared = maxDistance < std::sqrt(FLT_MAX) ? maxDistance * maxDistance : FLT_MAX;
+		stack.clear();
+		stack.emplace_back(NodeDistanceSquared(0, point), 0);
+
+		while (!stack.empty())
+		{
+			const auto [distanceSquared, nodeIndex] = stack.back();
+			stack.pop_back();
+
+			// A closer triangle was found after this node was pushed
+			if (distanceSquared > bestSquared) continue;
+
+			const BVHNode& node = mNodes[nodeIndex];
+			if (IsLeaf(nodeIndex))
+			{
+				for (size_t i = node.first; i < node.first + node.triCount; ++i)
+				{
+					const Triangle& tri = GetTriangle(i);
+					const glm::vec3 closest = Utils::ClosestPointTriangle(point, tri.v1, tri.v2, tri.v3);
+					const glm::vec3 offset = closest - point;
+					const float triangleSquared = glm::dot(offset, offset);
+					if (triangleSquared <= bestSquared)
+					{
+						bestSquared = triangleSquared;
+						best.point = closest;
+						best.triangle = GetTriangleId(i);
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			const uint32_t left = node.first;
+			const uint32_t right = node.first + 1;
+			const float leftSquared = NodeDistanceSquared(left, point);
+			const float rightSquared = NodeDistanceSquared(right, point);
+
+			// Push the farther child first so the closer one is visited first
+			const bool leftCloser = leftSquared <= rightSquared;
+			const std::pair<float, uint32_t> nearChild = leftCloser ? std::make_pair(leftSquared, left) : std::make_pair(rightSquared, right);
+			const std::pair<float, uint32_t> farChild = leftCloser ? std::make_pair(rightSquared, right) : std::make_pair(leftSquared, left);
+			if (farChild.first <= bestSquared) stack.push_back(farChild);
+			if (nearChild.first <= bestSquared) stack.push_back(nearChild);
+		}
+
+		if (found) best.distance = std::sqrt(bestSquared);
+		return std::make_pair(best, found);
+	}
+
+	float StaticTree::NodeDistanceSquared(const size_t nodeIndex, const glm::vec3& point) const
+	{
+		// Same as BoundingBox::DistanceSquared, without building a box and its surface area
+		const BVHNode& node = mNodes[nodeIndex];
+		const glm::vec3 offset = glm::max(node.min - point, glm::vec3(0.0f)) + glm::max(point - node.max, glm::vec3(0.0f));
+		return glm::dot(offset, offset);
+	}
+
+
+	float StaticTree::WindingNumber(const glm::vec3& point, const float accuracy) const
+	{
+		if (mNodesUsed == 0) return 0.0f;
+		PrepareWinding();
+
+		const float accuracySquared = accuracy * accuracy;
+		double solidAngle = 0.0;
+
+		std::stack<size_t> stack;
+		stack.push(0);
+		while (!stack.empty())
+		{
+			const size_t nodeIndex = stack.top();
+			stack.pop();
+
+			// Far enough away, the node's triangles act as one dipole
+			const WindingNode& winding = mWindingNodes[nodeIndex];
+			const glm::vec3 offset = winding.center - point;
+			const float distanceSquared = glm::dot(offset, offset);
+			if (distanceSquared > accuracySquared * winding.radius * winding.radius)
+			{
+				solidAngle += glm::dot(offset, winding.normal) / (distanceSquared * std::sqrt(distanceSquared));
+				continue;
+			}
+
+			const BVHNode& node = mNodes[nodeIndex];
+			if (IsInternal(nodeIndex))
+			{
+				stack.push(node.first);
+				stack.push(node.first + 1);
+				continue;
+			}
+
+			// Exact solid angle of each triangle
+			// Adapted from Van Oosterom and Strackee, "The Solid Angle of a Plane Triangle" (1983)
+			for (size_t i = node.first; i < node.first + node.triCount; ++i)
+			{
+				if (!mWindingOwners.empty() && !mWindingOwners[i]) continue;
+
+				const Triangle& tri = GetTriangle(i);
+				const glm::vec3 a = tri.v1 - point;
+				const glm::vec3 b = tri.v2 - point;
+				const glm::vec3 c = tri.v3 - point;
+				const float lengthA = glm::length(a);
+				const float lengthB = glm::length(b);
+				const float lengthC = glm::length(c);
+				const float numerator = glm::dot(a, glm::cross(b, c));
+				const float denominator = lengthA * lengthB * lengthC + glm::dot(a, b) * lengthC + glm::dot(b, c) * lengthA + glm::dot(c, a) * lengthB;
+				solidAngle += 2.0 * std::atan2(numerator, denominator);
+			}
+		}
+		return static_cast<float>(solidAngle / (4.0 * glm::pi<double>()));
+	}
+
+	std::vector<float> StaticTree::WindingNumbers(const glm::vec3* points, const size_t count, const float accuracy) const
+	{
+		std::vector<float> output(count);
+		if (mNodesUsed == 0) return output;
+
+		// Built before splitting up, so threads don't wait on each other to build it
+		PrepareWinding();
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, count, 256, [&](const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				output[i] = WindingNumber(points[i], accuracy);
+		});
+		return output;
+	}
+
+	std::vector<float> StaticTree::WindingNumbers(const std::vector<glm::vec3>& points, const float accuracy) const
+	{
+		return WindingNumbers(points.data(), points.size(), accuracy);
+	}
+
+	bool StaticTree::Contains(const glm::vec3& point) const
+	{
+		// Meshes wound inside out have negative winding numbers
+		return std::abs(WindingNumber(point)) >= 0.5f;
+	}
+
+
+	BoundingBox StaticTree::GetBounds() const
+	{
+		if (mNodes.empty()) return BoundingBox(glm::vec3(0.0f), glm::vec3(0.0f));
+		return mNodes[0].GetBox();
+	}
+
+
+	size_t StaticTree::GetMemoryUsage() const
+	{
+		return mNodes.size() * sizeof(BVHNode) + mWideNodes.size() * (sizeof(WideNode) + sizeof(uint32_t)) + mTriangles.size() * sizeof(Triangle)
+			+ mTriangleIds.size() * sizeof(uint32_t) + mWindingNodes.size() * sizeof(WindingNode) + mWindingOwners.size();
+	}
+
+
+	std::vector<BoundingBox> StaticTree::GetBoxes(const bool onlyLeaf) const
+	{
+		std::vector<BoundingBox> output;
+		for (size_t i = 0; i < mNodesUsed - 1; ++i)
+		{
+			if (IsLeaf(i) || !onlyLeaf)
+				output.emplace_back(mNodes[i].GetBox());
+		}
+		return output;
+	}
+
+
+	std::vector<BoundingBox> StaticTree::GetBoxes(const glm::mat4& modelMat, const bool onlyLeaf) const
+	{
+		std::vector<BoundingBox> output;
+		for (size_t i = 0; i < mNodesUsed; ++i)
+		{
+			if (IsLeaf(i) || !onlyLeaf)
+				output.emplace_back(modelMat * glm::vec4(mNodes[i].min, 1.0), modelMat * glm::vec4(mNodes[i].max, 1.0));
+		}
+		std::cout << output.size() << std::endl;
+		return output;
+	}
+
+
+	void StaticTree::Subdivide(size_t nodeIndex)
+	{
+		// Nodes with fewer triangles are split on the current thread, as a task would cost more than the work
+		constexpr size_t PARALLEL_TRI_CUTOFF = 4096;
+
+		BVHNode& node = mNodes[nodeIndex];
+		UpdateNodeBoundingBox(nodeIndex);
+
+		if (node.triCount <= 1) return;
+
+		uint8_t axis = 4;
+		float splitPos;
+
+		// Find axis, split position, and split cost
+		// Costs are relative to intersecting one triangle, and are scaled by surface area
+		const float splitCost = FindBestSplitPlane(nodeIndex, axis, splitPos);
+		const float nodeArea = node.GetBox().surfaceArea;
+		const bool mustSplit = node.triCount > mOptions.maxLeafSize;
+		if (!mustSplit && splitCost + mOptions.traversalCost * nodeArea >= nodeArea * static_cast<float>(node.triCount)) return;
+
+		size_t beginIter = node.first;
+		if (splitCost < FLT_MAX)
+		{
+			size_t endIter = node.first + (node.triCount - 1);
+			while (beginIter <= endIter)
+			{
+				if (GetCentroid(beginIter)[axis] <= splitPos)
+					++beginIter;
+				else
+					std::swap(mTriIdx[beginIter], mTriIdx[endIter--]);
+			}
+		}
+
+		// Centroids couldn't be separated, split the node in half so leaves stay under the max size
+		if (beginIter == node.first || beginIter == node.first + node.triCount)
+			beginIter = node.first + node.triCount / 2;
+
+		size_t leftCount = beginIter - node.first;
+
+		// create child nodes
+		size_t leftChildIdx;
+		size_t rightChildIdx;
+		{
+			// Ensures left child index and right child index are 1 apart
+			// Also prevents data racing
+			std::unique_lock<std::mutex> lock(nodesUsedMutex);
+			leftChildIdx = mNodesUsed++;
+			rightChildIdx = mNodesUsed++;
+		}
+
+		mNodes[leftChildIdx].first = node.first;
+		mNodes[leftChildIdx].triCount = static_cast<uint32_t>(leftCount);
+
+		mNodes[rightChildIdx].first = static_cast<uint32_t>(beginIter);
+		mNodes[rightChildIdx].triCount = static_cast<uint32_t>(node.triCount - leftCount);
+
+		const bool parallel = node.triCount >= PARALLEL_TRI_CUTOFF;
+		node.first = static_cast<uint32_t>(leftChildIdx);
+		node.triCount = 0;
+
+		// recurse
+		if (parallel)
+		{
+			// Left half is picked up by another thread, this thread keeps the right half
+			Utils::TaskGroup group;
+			group.Run([this, leftChildIdx] { Subdivide(leftChildIdx); });
+			Subdivide(rightChildIdx);
+			group.Wait();
+		}
+		else
+		{
+			Subdivide(leftChildIdx);
+			Subdivide(rightChildIdx);
+		}
+	}
+
+
+	void StaticTree::SubdivideSpatial(const size_t nodeIndex, std::vector<Reference> references)
+	{
+		constexpr size_t PARALLEL_TRI_CUTOFF = 4096;
+		// Spatial splits are only searched for when the best object split's children overlap by more than this fraction of the root's area
+		// From Stich et al., "Spatial Splits in Bounding Volume Hierarchies" (2009)
+		constexpr float SPATIAL_SPLIT_ALPHA = 1e-5f;
+
+		BVHNode& node = mNodes[nodeIndex];
+		BoundingBox nodeBox;
+		for (const Reference& reference : references)
+		{
+			nodeBox.IncludePoint(reference.box.min);
+			nodeBox.IncludePoint(reference.box.max);
+		}
+		nodeBox.UpdateSurfaceArea();
+		node.min = nodeBox.min;
+		node.max = nodeBox.max;
+
+		const size_t count = references.size();
+		const auto makeLeaf = [&]
+		{
+			std::unique_lock<std::mutex> lock(nodesUsedMutex);
+			node.first = static_cast<uint32_t>(mReferenceOutput.size());
+			node.triCount = static_cast<uint32_t>(count);
+			for (const Reference& reference : references)
+				mReferenceOutput.push_back(reference.triangle);
+		};
+
+		if (count <= 1)
+		{
+			makeLeaf();
+			return;
+		}
+
+		uint8_t objectAxis = 4;
+		float objectPos;
+		BoundingBox leftBox, rightBox;
+		const float objectCost = FindObjectSplit(references, objectAxis, objectPos, leftBox, rightBox);
+
+		uint8_t spatialAxis = 4;
+		float spatialPos;
+		float spatialCost = FLT_MAX;
+		const glm::vec3 overlapExtent = glm::min(leftBox.max, rightBox.max) - glm::max(leftBox.min, rightBox.min);
+		const bool childrenOverlap = objectCost == FLT_MAX || (glm::all(glm::greaterThan(overlapExtent, glm::vec3(0.0f))) &&
+			BoundingBox(glm::vec3(0.0f), overlapExtent).surfaceArea > SPATIAL_SPLIT_ALPHA * mRootArea);
+		if (childrenOverlap && mSpatialBudget > 0)
+			spatialCost = FindSpatialSplit(references, nodeBox, spatialAxis, spatialPos);
+
+		const float nodeArea = nodeBox.surfaceArea;
+		const bool mustSplit = count > mOptions.maxLeafSize;
+		if (!mustSplit && std::min(objectCost, spatialCost) + mOptions.traversalCost * nodeArea >= nodeArea * static_cast<float>(count))
+		{
+			makeLeaf();
+			return;
+		}
+
+		std::vector<Reference> left, right;
+		if (spatialCost < objectCost)
+		{
+			size_t straddling = 0;
+			for (const Reference& reference : references)
+				if (reference.box.min[spatialAxis] < spatialPos && reference.box.max[spatialAxis] > spatialPos)
+					++straddling;
+
+			// Reserve room for the duplicated references, falls back to an object split if the budget ran out
+			size_t available = mSpatialBudget;
+			while (available >= straddling && !mSpatialBudget.compare_exchange_weak(available, available - straddling)) {}
+
+			if (available >= straddling)
+			{
+				for (const Reference& reference : references)
+				{
+					if (reference.box.max[spatialAxis] <= spatialPos)
+						left.push_back(reference);
+					else if (reference.box.min[spatialAxis] >= spatialPos)
+						right.push_back(reference);
+					else
+					{
+						BoundingBox leftPart = reference.box;
+						leftPart.max[spatialAxis] = spatialPos;
+						leftPart = ClipTriangle(reference.triangle, leftPart);
+						if (leftPart.min[spatialAxis] <= leftPart.max[spatialAxis])
+							left.push_back(Reference{ leftPart, reference.triangle });
+
+						BoundingBox rightPart = reference.box;
+						rightPart.min[spatialAxis] = spatialPos;
+						rightPart = ClipTriangle(reference.triangle, rightPart);
+						if (rightPart.min[spatialAxis] <= rightPart.max[spatialAxis])
+							right.push_back(Reference{ rightPart, reference.triangle });
+					}
+				}
+
+				// Clipping can leave a side with every reference, which would never finish splitting
+				if (left.empty() || right.empty() || left.size() == count || right.size() == count)
+				{
+					mSpatialBudget += straddling;
+					left.clear();
+					right.clear();
+				}
+			}
+		}
+
+		if (left.empty())
+		{
+			if (objectCost < FLT_MAX)
+			{
+				for (const Reference& reference : references)
+				{
+					if ((reference.box.min[objectAxis] + reference.box.max[objectAxis]) * 0.5f <= objectPos)
+						left.push_back(reference);
+					else
+						right.push_back(reference);
+				}
+			}
+
+			// Centroids couldn't be separated, split the node in half so leaves stay under the max size
+			if (left.empty() || right.empty())
+			{
+				left.assign(references.begin(), references.begin() + count / 2);
+				right.assign(references.begin() + count / 2, references.end());
+			}
+		}
+		std::vector<Reference>().swap(references);
+
+		size_t leftChildIdx;
+		size_t rightChildIdx;
+		{
+			std::unique_lock<std::mutex> lock(nodesUsedMutex);
+			leftChildIdx = mNodesUsed++;
+			rightChildIdx = mNodesUsed++;
+		}
+		node.first = static_cast<uint32_t>(leftChildIdx);
+		node.triCount = 0;
+
+		if (count >= PARALLEL_TRI_CUTOFF)
+		{
+			Utils::TaskGroup group;
+			group.Run([this, leftChildIdx, &left] { SubdivideSpatial(leftChildIdx, std::move(left)); });
+			SubdivideSpatial(rightChildIdx, std::move(right));
+			group.Wait();
+		}
+		else
+		{
+			SubdivideSpatial(leftChildIdx, std::move(left));
+			SubdivideSpatial(rightChildIdx, std::move(right));
+		}
+	}
+
+
+	float StaticTree::FindObjectSplit(const std::vector<Reference>& references, uint8_t& axis, float& splitPos, BoundingBox& leftBox, BoundingBox& rightBox) const
+	{
+		const unsigned int binCount = mOptions.binCount;
+
+		BoundingBox centroidBox;
+		for (const Reference& reference : references)
+			centroidBox.IncludePoint((reference.box.min + reference.box.max) * 0.5f);
+
+		float bestCost = FLT_MAX;
+		for (uint8_t currentAxis = 0; currentAxis < 3; ++currentAxis)
+		{
+			const float extent = centroidBox.max[currentAxis] - centroidBox.min[currentAxis];
+			if (extent <= 0.0f) continue;
+
+			Bin bins[BuildOptions::MAX_BINS] = {};
+			const float scale = static_cast<float>(binCount) / extent;
+			for (const Reference& reference : references)
+			{
+				const float centroid = (reference.box.min[currentAxis] + reference.box.max[currentAxis]) * 0.5f;
+				const unsigned int binIdx = std::min(binCount - 1, static_cast<unsigned int>((centroid - centroidBox.min[currentAxis]) * scale));
+				++bins[binIdx].triCount;
+				bins[binIdx].bounds.IncludePoint(reference.box.min);
+				bins[binIdx].bounds.IncludePoint(reference.box.max);
+			}
+
+			// Boxes left and right of each split plane candidate
+			BoundingBox leftBoxes[BuildOptions::MAX_BINS - 1], rightBoxes[BuildOptions::MAX_BINS - 1];
+			size_t leftCount[BuildOptions::MAX_BINS - 1], rightCount[BuildOptions::MAX_BINS - 1];
+			size_t leftSum = 0, rightSum = 0;
+			BoundingBox leftAccum, rightAccum;
+			for (unsigned int i = 0; i < binCount - 1; ++i)
+			{
+				leftSum += bins[i].triCount;
+				leftCount[i] = leftSum;
+				if (bins[i].triCount > 0)
+					leftAccum.Merge(bins[i].bounds);
+				leftBoxes[i] = leftAccum;
+
+				rightSum += bins[binCount - i - 1].triCount;
+				rightCount[binCount - i - 2] = rightSum;
+				if (bins[binCount - i - 1].triCount > 0)
+					rightAccum.Merge(bins[binCount - i - 1].bounds);
+				rightBoxes[binCount - i - 2] = rightAccum;
+			}
+
+			for (unsigned int i = 0; i < binCount - 1; i++)
+			{
+				if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+				const float planeCost = leftCount[i] * leftBoxes[i].surfaceArea + rightCount[i] * rightBoxes[i].surfaceArea;
+				if (planeCost < bestCost)
+				{
+					bestCost = planeCost;
+					axis = currentAxis;
+					splitPos = centroidBox.min[currentAxis] + extent / static_cast<float>(binCount) * (static_cast<float>(i) + 1.0f);
+					leftBox = leftBoxes[i];
+					rightBox = rightBoxes[i];
+				}
+			}
+		}
+		return bestCost;
+	}
+
+
+	float StaticTree::FindSpatialSplit(const std::vector<Reference>& references, const BoundingBox& nodeBox, uint8_t& axis, float& splitPos) const
+	{
+		const unsigned int binCount = mOptions.binCount;
+
+		// Entries and exits count references starting and ending in each bin
+		struct SpatialBin
+		{
+			BoundingBox bounds;
+			size_t entries{};
+			size_t exits{};
+		};
+
+		float bestCost = FLT_MAX;
+		for (uint8_t currentAxis = 0; currentAxis < 3; ++currentAxis)
+		{
+			const float start = nodeBox.min[currentAxis];
+			const float width = (nodeBox.max[currentAxis] - start) / static_cast<float>(binCount);
+			if (width <= 0.0f) continue;
+
+			SpatialBin bins[BuildOptions::MAX_BINS] = {};
+			const auto binOf = [&](const float position)
+			{
+				return std::min(binCount - 1, static_cast<unsigned int>(std::max(0.0f, (position - start) / width)));
+			};
+
+			for (const Reference& reference : references)
+			{
+				const unsigned int firstBin = binOf(reference.box.min[currentAxis]);
+				const unsigned int lastBin = std::max(firstBin, binOf(reference.box.max[currentAxis]));
+				++bins[firstBin].entries;
+				++bins[lastBin].exits;
+
+				if (firstBin == lastBin)
+				{
+					bins[firstBin].bounds.IncludePoint(reference.box.min);
+					bins[firstBin].bounds.IncludePoint(reference.box.max);
+					continue;
+				}
+
+				// Each bin only grows by the part of the triangle inside it
+				for (unsigned int b = firstBin; b <= lastBin; b++)
+				{
+					BoundingBox slab = reference.box;
+					if (b != firstBin) slab.min[currentAxis] = start + width * static_cast<float>(b);
+					if (b != lastBin) slab.max[currentAxis] = start + width * static_cast<float>(b + 1);
+					const BoundingBox clipped = ClipTriangle(reference.triangle, slab);
+					if (clipped.min[currentAxis] > clipped.max[currentAxis]) continue;
+					bins[b].bounds.IncludePoint(clipped.min);
+					bins[b].bounds.IncludePoint(clipped.max);
+				}
+			}
+
+			float leftArea[BuildOptions::MAX_BINS - 1], rightArea[BuildOptions::MAX_BINS - 1];
+			size_t leftCount[BuildOptions::MAX_BINS - 1], rightCount[BuildOptions::MAX_BINS - 1];
+			size_t leftSum = 0, rightSum = 0;
+			BoundingBox leftBox, rightBox;
+			for (unsigned int i = 0; i < binCount - 1; ++i)
+			{
+				leftSum += bins[i].entries;
+				leftCount[i] = leftSum;
+				if (bins[i].bounds.min.x <= bins[i].bounds.max.x)
+					leftBox.Merge(bins[i].bounds);
+				leftArea[i] = leftBox.surfaceArea;
+
+				rightSum += bins[binCount - i - 1].exits;
+				rightCount[binCount - i - 2] = rightSum;
+				if (bins[binCount - i - 1].bounds.min.x <= bins[binCount - i - 1].bounds.max.x)
+					rightBox.Merge(bins[binCount - i - 1].bounds);
+				rightArea[binCount - i - 2] = rightBox.surfaceArea;
+			}
+
+			for (unsigned int i = 0; i < binCount - 1; i++)
+			{
+				if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+				const float planeCost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (planeCost < bestCost)
+				{
+					bestCost = planeCost;
+					axis = currentAxis;
+					splitPos = start + width * (static_cast<float>(i) + 1.0f);
+				}
+			}
+		}
+		return bestCost;
+	}
+
+
+	BoundingBox StaticTree::ClipTriangle(const uint32_t triangle, const BoundingBox& box) const
 	{
-		LOG(LOG_INFO) << "Creating static tree with " << indices.size() / 3 << " triangles.\n";
-		ClearData();
+		// A triangle clipped by 6 planes has at most 9 corners
+		constexpr unsigned int MAX_CORNERS = 10;
 
-		size_t leafNodeAmount = indices.size() / 3;
+		const Triangle& tri = mTriangles[triangle];
+		glm::vec3 polygon[MAX_CORNERS] = { tri.v1, tri.v2, tri.v3 };
+		glm::vec3 clipped[MAX_CORNERS];
+		unsigned int corners = 3;
 
-#ifdef DEBUG
-		Utils::Timer t("StaticTree");
-#endif
+		// Sutherland-Hodgman against each face of the box
+		for (unsigned int face = 0; face < 6 && corners > 0; face++)
+		{
+			const unsigned int faceAxis = face / 2;
+			const bool isMin = face % 2 == 0;
+			const auto inside = [&](const glm::vec3& point)
+			{
+				return isMin ? point[faceAxis] - box.min[faceAxis] : box.max[faceAxis] - point[faceAxis];
+			};
 
-		// Includes leaf nodes and internal nodes
-		mNodes.resize(leafNodeAmount * 2 + 1);
+			unsigned int clippedCorners = 0;
+			for (unsigned int i = 0; i < corners; i++)
+			{
+				const glm::vec3& current = polygon[i];
+				const glm::vec3& next = polygon[(i + 1) % corners];
+				const float currentDistance = inside(current);
+				const float nextDistance = inside(next);
+
+				if (currentDistance >= 0.0f)
+					clipped[clippedCorners++] = current;
+				if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f) && clippedCorners < MAX_CORNERS)
+					clipped[clippedCorners++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+			}
+			std::copy(clipped, clipped + clippedCorners, polygon);
+			corners = clippedCorners;
+		}
 
-		// Transfer vertice and indice information into triangle vector
-		mCentroids.resize(leafNodeAmount);
-		mTriIdx.resize(leafNodeAmount);
-		mTriangles.resize(leafNodeAmount);
-		for (size_t i = 0; i < leafNodeAmount; i++)
+		BoundingBox output;
+		for (unsigned int i = 0; i < corners; i++)
+			output.IncludePoint(polygon[i]);
+		if (corners == 0) return output;
+
+		// Intersection points can land slightly outside the box
+		output.min = glm::max(output.min, box.min);
+		output.max = glm::min(output.max, box.max);
+		output.UpdateSurfaceArea();
+		return output;
+	}
+
+
+	float StaticTree::ComputeCost() const
+	{
+		BoundingBox box;
+		const float cost = ComputeNodeCost(0, box);
+		return cost / box.surfaceArea;
+	}
+
+
+	float StaticTree::ComputeNodeCost(const size_t nodeIndex, BoundingBox& box) const
+	{
+		const BVHNode& node = mNodes[nodeIndex];
+		if (IsLeaf(nodeIndex))
 		{
-			mTriIdx[i] = i;
+			for (size_t t = node.first; t < node.first + node.triCount; ++t)
+			{
+				const Triangle& tri = GetTriangle(t);
+				box.IncludePoint(tri.v1);
+				box.IncludePoint(tri.v2);
+				box.IncludePoint(tri.v3);
+			}
+			box.UpdateSurfaceArea();
+			return box.surfaceArea * static_cast<float>(node.triCount);
+		}
 
-			Triangle& tri = mTriangles[i];
-			tri.v1 = vertices[indices[i * 3]].position;
-			tri.v2 = vertices[indices[i * 3 + 1]].position;
-			tri.v3 = vertices[indices[i * 3 + 2]].position;
+		// Summed in the same order as RefitNode, so refitting an unmoved mesh gives exactly this cost
+		BoundingBox left, right;
+		const float leftCost = ComputeNodeCost(node.first, left);
+		const float rightCost = ComputeNodeCost(node.first + 1, right);
+		box.Merge(left, right);
+		return box.surfaceArea + leftCost + rightCost;
+	}
 
-			mCentroids[i] = (tri.v1 + tri.v2 + tri.v3) * 0.33333f;
+
+	template <typename Code>
+	void StaticTree::BuildLinear()
+	{
+		const size_t triCount = mTriIdx.size();
+
+		BoundingBox centroidBox;
+		for (const glm::vec3& centroid : mCentroids)
+			centroidBox.IncludePoint(centroid);
+		// Flat meshes have no extent on some axis
+		const glm::vec3 extent = glm::max(centroidBox.max - centroidBox.min, glm::vec3(FLT_MIN));
+
+		std::vector<Code> codes(triCount);
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, triCount, 4096, [&](const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const glm::vec3 position = (mCentroids[mTriIdx[i]] - centroidBox.min) / extent;
+				if constexpr (sizeof(Code) == sizeof(uint32_t))
+					codes[i] = MortonCode30(position);
+				else
+					codes[i] = MortonCode63(position);
+			}
+		});
+
+		Utils::RadixSort(codes, mTriIdx);
+		SubdivideLinear(0, codes);
+	}
+
+
+	template <typename Code>
+	void StaticTree::SubdivideLinear(const size_t nodeIndex, const std::vector<Code>& codes)
+	{
+		constexpr size_t PARALLEL_TRI_CUTOFF = 4096;
+
+		BVHNode& node = mNodes[nodeIndex];
+		if (node.triCount <= mOptions.maxLeafSize)
+		{
+			UpdateNodeBoundingBox(nodeIndex);
+			return;
 		}
 
-		BVHNode& root = mNodes[0];
-		root.first = 0;
-		root.triCount = leafNodeAmount;
-		mNodesUsed = 1;
+		const size_t first = node.first;
+		const size_t last = node.first + node.triCount - 1;
+
+		size_t split;
+		if (codes[first] == codes[last])
+		{
+			// Triangles share a Morton cell, split them evenly
+			split = first + node.triCount / 2;
+		}
+		else
+		{
+			// Codes are sorted and share every bit above the highest differing bit,
+			// so the split is the first code with that bit set
+			const Code difference = codes[first] ^ codes[last];
+			unsigned int highestBit = 0;
+			while (difference >> (highestBit + 1)) ++highestBit;
+
+			const Code splitCode = (codes[last] >> highestBit) << highestBit;
+			split = std::lower_bound(codes.begin() + first, codes.begin() + last + 1, splitCode) - codes.begin();
+		}
+
+		size_t leftChildIdx;
+		size_t rightChildIdx;
+		{
+			std::unique_lock<std::mutex> lock(nodesUsedMutex);
+			leftChildIdx = mNodesUsed++;
+			rightChildIdx = mNodesUsed++;
+		}
+
+		mNodes[leftChildIdx].first = static_cast<uint32_t>(first);
+		mNodes[leftChildIdx].triCount = static_cast<uint32_t>(split - first);
 
-		mThreadPool.Start();
-		mThreadPool.QueueJob([this] { Subdivide(0); });
+		mNodes[rightChildIdx].first = static_cast<uint32_t>(split);
+		mNodes[rightChildIdx].triCount = static_cast<uint32_t>(last + 1 - split);
 
-		while (mThreadPool.Busy()) {}
-		mThreadPool.Clear();
+		const bool parallel = node.triCount >= PARALLEL_TRI_CUTOFF;
+		node.first = static_cast<uint32_t>(leftChildIdx);
+		node.triCount = 0;
 
+		if (parallel)
+		{
+			Utils::TaskGroup group;
+			group.Run([this, leftChildIdx, &codes] { SubdivideLinear(leftChildIdx, codes); });
+			SubdivideLinear(rightChildIdx, codes);
+			group.Wait();
+		}
+		else
+		{
+			SubdivideLinear(leftChildIdx, codes);
+			SubdivideLinear(rightChildIdx, codes);
+		}
 
-#ifdef DEBUG
-		LOG(LOG_INFO) << "Thread pool finished with " << mNodes.size() << " nodes used in " << std::to_string(t.GetElapsed()) << "s.\n";
-#else
-		LOG(LOG_INFO) << "Thread pool finished.\n";
-#endif
+		// Children are done, so bounds are built bottom up instead of rescanning triangles
+		const BVHNode& left = mNodes[leftChildIdx];
+		const BVHNode& right = mNodes[rightChildIdx];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
 	}
 
 
-	std::vector<BoundingBox> StaticTree::QueryTree(const StaticTree& other)
+	uint32_t StaticTree::MortonCode30(const glm::vec3& position)
 	{
-		std::vector<BoundingBox> output;
-		std::stack<std::pair<size_t, size_t>> stack;
+		// Spreads the lower 10 bits so there are 2 zero bits between each
+		const auto expand = [](uint32_t v)
+		{
+			v = (v * 0x00010001u) & 0xFF0000FFu;
+			v = (v * 0x00000101u) & 0x0F00F00Fu;
+			v = (v * 0x00000011u) & 0xC30C30C3u;
+			v = (v * 0x00000005u) & 0x49249249u;
+			return v;
+		};
+		const glm::uvec3 cell = glm::uvec3(glm::clamp(position * 1024.0f, 0.0f, 1023.0f));
+		return (expand(cell.x) << 2) | (expand(cell.y) << 1) | expand(cell.z);
+	}
 
-		stack.emplace(0, 0);
 
-		while (!stack.empty())
+	uint64_t StaticTree::MortonCode63(const glm::vec3& position)
+	{
+		// Spreads the lower 21 bits so there are 2 zero bits between each
+		const auto expand = [](uint64_t v)
 		{
-			auto mine = stack.top().first;
-			auto theirs = stack.top().second;
-			stack.pop();
+			v &= 0x1FFFFFull;
+			v = (v | v << 32) & 0x1F00000000FFFFull;
+			v = (v | v << 16) & 0x1F0000FF0000FFull;
+			v = (v | v << 8) & 0x100F00F00F00F00Full;
+			v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+			v = (v | v << 2) & 0x1249249249249249ull;
+			return v;
+		};
+		const glm::uvec3 cell = glm::uvec3(glm::clamp(position * 2097152.0f, 0.0f, 2097151.0f));
+		return (expand(cell.x) << 2) | (expand(cell.y) << 1) | expand(cell.z);
+	}
+
+
+	void StaticTree::Collapse()
+	{
+		mWideNodes.clear();
+		mWideBinaryNodes.clear();
+		if (mNodesUsed == 0) return;
+		if (mNodes.size() >= WIDE_LEAF)
+		{
+			LOG(LOG_WARNING) << "Static tree: " << mNodes.size() << " nodes is too many to collapse, using the binary tree.\n";
+			return;
+		}
+
+		// Each wide node replaces about three binary internal nodes
+		mWideNodes.reserve(mNodes.size() / 6 + 1);
+		mWideBinaryNodes.reserve(mNodes.size() / 6 + 1);
+		CollapseNode(0);
+	}
+
 
-			if (mNodes[mine].box.IsColliding(other.mNodes[theirs].box))
+	uint32_t StaticTree::CollapseNode(const size_t nodeIndex)
+	{
+		const uint32_t wideIndex = static_cast<uint32_t>(mWideNodes.size());
+		mWideNodes.emplace_back();
+		mWideBinaryNodes.push_back(static_cast<uint32_t>(nodeIndex));
+
+		// Opens the largest internal child until there are four, a tree that is a single leaf gets a node holding just it
+		size_t children[4] = { nodeIndex };
+		unsigned int childCount = 1;
+		if (IsInternal(nodeIndex))
+		{
+			children[0] = mNodes[nodeIndex].first;
+			children[1] = mNodes[nodeIndex].first + 1;
+			childCount = 2;
+		}
+		while (childCount < 4)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (unsigned int i = 0; i < childCount; i++)
 			{
-				if (IsInternal(mine) && other.IsInternal(theirs))
-				{
-					stack.emplace(mNodes[mine].first, other.mNodes[theirs].first);
-					stack.emplace(mNodes[mine].first + 1, other.mNodes[theirs].first);
-					stack.emplace(mNodes[mine].first, other.mNodes[theirs].first + 1);
-					stack.emplace(mNodes[mine].first + 1, other.mNodes[theirs].first + 1);
-				}
-				else if (IsLeaf(mine))
-				{
-					stack.emplace(mine, other.mNodes[theirs].first);
-					stack.emplace(mine, other.mNodes[theirs].first + 1);
-				}
-				else if (other.IsLeaf(theirs))
-				{
-					stack.emplace(mNodes[mine].first, theirs);
-					stack.emplace(mNodes[mine].first + 1, theirs);
-				}
-				else
+				const float area = mNodes[children[i]].GetBox().surfaceArea;
+				if (IsInternal(children[i]) && area > largestArea)
 				{
-					output.emplace_back(mNodes[mine].box);
-					output.emplace_back(other.mNodes[theirs].box);
+					largest = static_cast<int>(i);
+					largestArea = area;
 				}
 			}
+			if (largest < 0) break;
+
+			const size_t opened = children[largest];
+			children[largest] = mNodes[opened].first;
+			children[childCount++] = mNodes[opened].first + 1;
 		}
-		return output;
+
+		uint32_t references[4] = { WIDE_EMPTY, WIDE_EMPTY, WIDE_EMPTY, WIDE_EMPTY };
+		for (unsigned int i = 0; i < childCount; i++)
+			references[i] = IsLeaf(children[i]) ? WIDE_LEAF | static_cast<uint32_t>(children[i]) : CollapseNode(children[i]);
+
+		// Written after the recursion, which can move mWideNodes
+		WideNode& wide = mWideNodes[wideIndex];
+		QuantizeWideNode(wide, nodeIndex, children, childCount);
+		std::copy(references, references + 4, wide.children);
+		return wideIndex;
 	}
 
 
-	std::vector<BoundingBox> StaticTree::QueryTree(const BoundingBox& box)
+	void StaticTree::QuantizeWideNode(WideNode& wide, const size_t nodeIndex, const size_t (&children)[4], const unsigned int childCount) const
 	{
-		std::vector<BoundingBox> output;
-		std::stack<size_t> stack;
+		const BVHNode& node = mNodes[nodeIndex];
+		wide.origin = node.min;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			const float origin = wide.origin[axis];
+			float scale = (node.max[axis] - origin) / 255.0f;
+			while (origin + 255.0f * scale < node.max[axis])
+				scale = std::nextafter(scale, FLT_MAX);
+			wide.scale[axis] = scale;
 
-		stack.emplace(0);
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				wide.childMin[axis][i] = 0;
+				wide.childMax[axis][i] = 0;
+				if (i >= childCount || scale == 0.0f) continue;
+
+				// Rounded outwards, and checked with the same arithmetic traversal uses
+				const BVHNode& child = mNodes[children[i]];
+				int low = std::clamp(static_cast<int>(std::floor((child.min[axis] - origin) / scale)), 0, 255);
+				while (low > 0 && origin + static_cast<float>(low) * scale > child.min[axis]) low--;
+				int high = std::clamp(static_cast<int>(std::ceil((child.max[axis] - origin) / scale)), 0, 255);
+				while (high < 255 && origin + static_cast<float>(high) * scale < child.max[axis]) high++;
+				wide.childMin[axis][i] = static_cast<uint8_t>(low);
+				wide.childMax[axis][i] = static_cast<uint8_t>(high);
+			}
+		}
+	}
 
-		while (!stack.empty())
-		{
-			size_t nodeID = stack.top();
-			stack.pop();
 
-			if (box.IsColliding(mNodes[nodeID].box))
+	void StaticTree::RefitWide()
+	{
+		// Wide nodes handled by a single task
+		constexpr size_t REFIT_GRAIN_SIZE = 1024;
+
+		// Children of each wide node stay the same, only their bounds moved
+		Utils::TaskScheduler::GetInstance().ParallelFor(0, mWideNodes.size(), REFIT_GRAIN_SIZE, [this](const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
 			{
-				if (IsLeaf(nodeID))
-				{
-					output.emplace_back(mNodes[nodeID].box);
-				}
-				else
+				WideNode& wide = mWideNodes[i];
+				size_t children[4] = {};
+				unsigned int childCount = 0;
+				for (; childCount < 4 && wide.children[childCount] != WIDE_EMPTY; childCount++)
 				{
-					stack.emplace(mNodes[nodeID].first);
-					stack.emplace(mNodes[nodeID].first + 1);
+					const uint32_t child = wide.children[childCount];
+					children[childCount] = child & WIDE_LEAF ? child & ~WIDE_LEAF : mWideBinaryNodes[child];
 				}
+				QuantizeWideNode(wide, mWideBinaryNodes[i], children, childCount);
 			}
-		}
-		return output;
+		});
 	}
 
 
-	std::vector<BoundingBox> StaticTree::GetBoxes(const bool onlyLeaf) const
+#ifdef STATIC_TREE_SSE2
+	namespace
 	{
-		std::vector<BoundingBox> output;
-		for (size_t i = 0; i < mNodesUsed - 1; ++i)
+		// Converts four quantized coordinates to floats
+		inline __m128 Dequantize(const uint8_t (&quantized)[4], const float origin, const float scale)
 		{
-			if (IsLeaf(i) || !onlyLeaf)
-				output.emplace_back(mNodes[i].box);
+			int32_t packed;
+			std::memcpy(&packed, quantized, sizeof(int32_t));
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+			return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(scale)), _mm_set1_ps(origin));
 		}
-		return output;
 	}
 
-
-	std::vector<BoundingBox> StaticTree::GetBoxes(const glm::mat4& modelMat, const bool onlyLeaf) const
+	unsigned int StaticTree::IntersectChildren(const WideNode& node, const Ray& ray, const float tMax, float (&tEntry)[4])
 	{
-		std::vector<BoundingBox> output;
-		for (size_t i = 0; i < mNodesUsed; ++i)
+		__m128 tNear = _mm_setzero_ps();
+		__m128 tFar = _mm_set1_ps(tMax);
+		for (unsigned int axis = 0; axis < 3; axis++)
 		{
-			if (IsLeaf(i) || !onlyLeaf)
-				output.emplace_back(modelMat * glm::vec4(mNodes[i].box.min, 1.0), modelMat * glm::vec4(mNodes[i].box.max, 1.0));
+			const __m128 origin = _mm_set1_ps(ray.origin[axis]);
+			const __m128 invDirection = _mm_set1_ps(ray.invdir[axis]);
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(Dequantize(node.childMin[axis], node.origin[axis], node.scale[axis]), origin), invDirection);
+			const __m128 t2 = _mm_mul_ps(_mm_sub_ps(Dequantize(node.childMax[axis], node.origin[axis], node.scale[axis]), origin), invDirection);
+			tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+			tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
 		}
-		std::cout << output.size() << std::endl;
-		return output;
+		_mm_storeu_ps(tEntry, tNear);
+		return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)));
 	}
 
+	unsigned int StaticTree::OverlapChildren(const WideNode& node, const BoundingBox& box)
+	{
+		__m128 overlap = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			const __m128 childMin = Dequantize(node.childMin[axis], node.origin[axis], node.scale[axis]);
+			const __m128 childMax = Dequantize(node.childMax[axis], node.origin[axis], node.scale[axis]);
+			overlap = _mm_and_ps(overlap, _mm_cmple_ps(childMin, _mm_set1_ps(box.max[axis])));
+			overlap = _mm_and_ps(overlap, _mm_cmpge_ps(childMax, _mm_set1_ps(box.min[axis])));
+		}
+		return static_cast<unsigned int>(_mm_movemask_ps(overlap));
+	}
+#else
+	unsigned int StaticTree::IntersectChildren(const WideNode& node, const Ray& ray, const float tMax, float (&tEntry)[4])
+	{
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			float tNear = 0.0f;
+			float tFar = tMax;
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				const float childMin = node.origin[axis] + static_cast<float>(node.childMin[axis][i]) * node.scale[axis];
+				const float childMax = node.origin[axis] + static_cast<float>(node.childMax[axis][i]) * node.scale[axis];
+				const float t1 = (childMin - ray.origin[axis]) * ray.invdir[axis];
+				const float t2 = (childMax - ray.origin[axis]) * ray.invdir[axis];
+				tNear = std::max(tNear, std::min(t1, t2));
+				tFar = std::min(tFar, std::max(t1, t2));
+			}
+			tEntry[i] = tNear;
+			if (tNear <= tFar) mask |= 1u << i;
+		}
+		return mask;
+	}
 
-	void StaticTree::Subdivide(size_t nodeIndex)
+	unsigned int StaticTree::OverlapChildren(const WideNode& node, const BoundingBox& box)
 	{
-		BVHNode& node = mNodes[nodeIndex];
-		UpdateNodeBoundingBox(nodeIndex);
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			bool overlap = true;
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				const float childMin = node.origin[axis] + static_cast<float>(node.childMin[axis][i]) * node.scale[axis];
+				const float childMax = node.origin[axis] + static_cast<float>(node.childMax[axis][i]) * node.scale[axis];
+				overlap = overlap && childMin <= box.max[axis] && childMax >= box.min[axis];
+			}
+			if (overlap) mask |= 1u << i;
+		}
+		return mask;
+	}
+#endif
 
-		if (node.triCount <= TRI_LIMIT) return;
 
-		uint8_t axis = 4;
-		float splitPos;
+	void StaticTree::PrepareWinding() const
+	{
+		if (mWindingReady) return;
 
-		// Find axis, split position, and split cost
-		float splitCost = FindBestSplitPlane(nodeIndex, axis, splitPos);
-		node.box.UpdateSurfaceArea();
-		if (splitCost >= node.box.surfaceArea * static_cast<float>(node.triCount)) return;
+		std::unique_lock<std::mutex> lock(windingMutex);
+		if (mWindingReady) return;
 
-		size_t beginIter = node.first;
-		size_t endIter = node.first + (node.triCount - 1);
-		while (beginIter <= endIter)
+		// Triangles duplicated by spatial splits are only counted in the first leaf holding them
+		mWindingOwners.clear();
+		if (!mTriangleIds.empty())
 		{
-			if (GetCentroid(beginIter)[axis] <= splitPos)
-				++beginIter;
-			else
-				std::swap(mTriIdx[beginIter], mTriIdx[endIter--]);
+			std::vector<uint8_t> seen(mMeshTriangleCount, 0);
+			mWindingOwners.resize(mTriangles.size());
+			for (size_t i = 0; i < mTriangles.size(); ++i)
+			{
+				mWindingOwners[i] = !seen[mTriangleIds[i]];
+				seen[mTriangleIds[i]] = 1;
+			}
 		}
 
-		// Stop split if one side is empty
-		size_t leftCount = beginIter - node.first;
-#ifdef DEBUG
-		assert(leftCount != 0 && leftCount != node.triCount);
-#endif
-		// if (leftCount == 0 || leftCount == node.triCount) return;
+		mWindingNodes.resize(mNodes.size());
+		BuildWindingNode(0);
+		mWindingReady = true;
+	}
 
-		// create child nodes
-		size_t leftChildIdx;
-		size_t rightChildIdx;
+
+	float StaticTree::BuildWindingNode(const size_t nodeIndex) const
+	{
+		const BVHNode& node = mNodes[nodeIndex];
+		WindingNode& winding = mWindingNodes[nodeIndex];
+
+		if (IsLeaf(nodeIndex))
 		{
-			// Ensures left child index and right child index are 1 apart
-			// Also prevents data racing
-			std::unique_lock<std::mutex> lock(nodesUsedMutex);
-			leftChildIdx = mNodesUsed++;
-			rightChildIdx = mNodesUsed++;
+			float area = 0.0f;
+			glm::vec3 weightedCenter(0.0f);
+			winding.normal = glm::vec3(0.0f);
+			for (size_t i = node.first; i < node.first + node.triCount; ++i)
+			{
+				if (!mWindingOwners.empty() && !mWindingOwners[i]) continue;
+
+				const Triangle& tri = GetTriangle(i);
+				const glm::vec3 normal = 0.5f * glm::cross(tri.v2 - tri.v1, tri.v3 - tri.v1);
+				const float triangleArea = glm::length(normal);
+				area += triangleArea;
+				weightedCenter += triangleArea * (tri.v1 + tri.v2 + tri.v3) / 3.0f;
+				winding.normal += normal;
+			}
+			winding.center = area > 0.0f ? weightedCenter / area : 0.5f * (node.min + node.max);
+
+			winding.radius = 0.0f;
+			for (size_t i = node.first; i < node.first + node.triCount; ++i)
+			{
+				if (!mWindingOwners.empty() && !mWindingOwners[i]) continue;
+
+				const Triangle& tri = GetTriangle(i);
+				winding.radius = std::max({ winding.radius, glm::distance(winding.center, tri.v1),
+				                            glm::distance(winding.center, tri.v2), glm::distance(winding.center, tri.v3) });
+			}
+			return area;
 		}
 
-		mNodes[leftChildIdx].first = node.first;
-		mNodes[leftChildIdx].triCount = leftCount;
+		const float leftArea = BuildWindingNode(node.first);
+		const float rightArea = BuildWindingNode(node.first + 1);
+		const WindingNode& left = mWindingNodes[node.first];
+		const WindingNode& right = mWindingNodes[node.first + 1];
+
+		const float area = leftArea + rightArea;
+		winding.center = area > 0.0f ? (leftArea * left.center + rightArea * right.center) / area : 0.5f * (node.min + node.max);
+		winding.normal = left.normal + right.normal;
+		// Bounds the children's spheres rather than finding the farthest point again
+		winding.radius = std::max(glm::distance(winding.center, left.center) + left.radius, glm::distance(winding.center, right.center) + right.radius);
+		return area;
+	}
 
-		mNodes[rightChildIdx].first = beginIter;
-		mNodes[rightChildIdx].triCount = node.triCount - leftCount;
 
-		node.first = leftChildIdx;
-		node.triCount = 0;
+	float StaticTree::RefitNode(const size_t nodeIndex, const unsigned int depth)
+	{
+		BVHNode& node = mNodes[nodeIndex];
+		if (IsLeaf(nodeIndex))
+		{
+			BoundingBox box;
+			for (size_t t = node.first; t < node.first + node.triCount; ++t)
+			{
+				const Triangle& tri = GetTriangle(t);
+				box.IncludePoint(tri.v1);
+				box.IncludePoint(tri.v2);
+				box.IncludePoint(tri.v3);
+			}
+			node.min = box.min;
+			node.max = box.max;
+			return node.GetBox().surfaceArea * static_cast<float>(node.triCount);
+		}
 
-		// recurse
-		mThreadPool.QueueJob([this, leftChildIdx] { Subdivide(leftChildIdx); });
-		mThreadPool.QueueJob([this, rightChildIdx] { Subdivide(rightChildIdx); });
+		// Splits the top of the tree into enough tasks for every thread, assuming it's roughly balanced
+		const unsigned int forkDepth = static_cast<unsigned int>(std::log2(Utils::TaskScheduler::GetInstance().ThreadCount())) + 2;
+
+		float leftCost, rightCost;
+		if (depth < forkDepth)
+		{
+			Utils::TaskGroup group;
+			group.Run([this, &node, &leftCost, depth] { leftCost = RefitNode(node.first, depth + 1); });
+			rightCost = RefitNode(node.first + 1, depth + 1);
+			group.Wait();
+		}
+		else
+		{
+			leftCost = RefitNode(node.first, depth + 1);
+			rightCost = RefitNode(node.first + 1, depth + 1);
+		}
+
+		const BVHNode& left = mNodes[node.first];
+		const BVHNode& right = mNodes[node.first + 1];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
+		return node.GetBox().surfaceArea + leftCost + rightCost;
 	}
 
 
 	float StaticTree::FindBestSplitPlane(size_t nodeIndex, uint8_t& axis, float& splitPos)
 	{
 		BVHNode& node = mNodes[nodeIndex];
+		const unsigned int binCount = mOptions.binCount;
 
 		BoundingBox centroidBox;
 		centroidBox.SetToLimit();
@@ -227,35 +2055,39 @@ namespace Physics {
 		float bestCost = FLT_MAX;
 		for (uint8_t currentAxis = 0; currentAxis < 3; ++currentAxis)
 		{
-			Bin bins[BINS_AMT] = {};
+			const float extent = centroidBox.max[currentAxis] - centroidBox.min[currentAxis];
+			// Every centroid is in the same spot on this axis
+			if (extent <= 0.0f) continue;
 
-			float scale = static_cast<float>(BINS_AMT) / (centroidBox.max[currentAxis] - centroidBox.min[currentAxis]);
+			Bin bins[BuildOptions::MAX_BINS] = {};
+
+			float scale = static_cast<float>(binCount) / extent;
 
 			// Update bins based on triangles in the node
 			for (size_t i = node.first; i < node.first + node.triCount; ++i)
 			{
 				// Determine which bin based on triangle centroid position
-				unsigned binIdx = std::min(static_cast<unsigned>(BINS_AMT - 1),
+				unsigned binIdx = std::min(binCount - 1,
 				                           static_cast<unsigned>((GetCentroid(i)[currentAxis] - centroidBox.min[
 					                           currentAxis]) * scale));
 
 				++bins[binIdx].triCount;
 
 				// Expand bin bounding box based on triangle vertices
-				const Triangle& tri = GetTriangle(i);
+				const Triangle& tri = GetBuildTriangle(i);
 				bins[binIdx].bounds.IncludePoint(tri.v1);
 				bins[binIdx].bounds.IncludePoint(tri.v2);
 				bins[binIdx].bounds.IncludePoint(tri.v3);
 			}
 
 			// Keeps track of each split plane candidate's bounding box area and triangle count
-			float leftArea[BINS_AMT - 1], rightArea[BINS_AMT - 1];
-			size_t leftCount[BINS_AMT - 1], rightCount[BINS_AMT - 1];
+			float leftArea[BuildOptions::MAX_BINS - 1], rightArea[BuildOptions::MAX_BINS - 1];
+			size_t leftCount[BuildOptions::MAX_BINS - 1], rightCount[BuildOptions::MAX_BINS - 1];
 			size_t leftSum = 0, rightSum = 0;
 
 			BoundingBox leftBox, rightBox;
 
-			for (size_t i = 0; i < BINS_AMT - 1; ++i)
+			for (size_t i = 0; i < binCount - 1; ++i)
 			{
 				leftSum += bins[i].triCount;
 				leftCount[i] = leftSum;
@@ -264,16 +2096,16 @@ namespace Physics {
 				leftArea[i] = leftBox.surfaceArea;
 
 
-				rightSum += bins[BINS_AMT - i - 2].triCount;
-				rightCount[BINS_AMT - i - 2] = rightSum;
-				if (bins[BINS_AMT - i - 2].triCount > 0)
-					rightBox.Merge(bins[BINS_AMT - i - 2].bounds);
-				rightArea[BINS_AMT - i - 2] = rightBox.surfaceArea;
+				rightSum += bins[binCount - i - 1].triCount;
+				rightCount[binCount - i - 2] = rightSum;
+				if (bins[binCount - i - 1].triCount > 0)
+					rightBox.Merge(bins[binCount - i - 1].bounds);
+				rightArea[binCount - i - 2] = rightBox.surfaceArea;
 			}
 
 			// calculate SAH cost for each split plane candidate
-			scale = (centroidBox.max[currentAxis] - centroidBox.min[currentAxis]) / BINS_AMT;
-			for (int i = 0; i < BINS_AMT - 1; i++)
+			scale = extent / static_cast<float>(binCount);
+			for (unsigned int i = 0; i < binCount - 1; i++)
 			{
 				const float planeCost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
 
@@ -295,30 +2127,51 @@ namespace Physics {
 		return mCentroids[mTriIdx[index]];
 	}
 
-	const StaticTree::Triangle& StaticTree::GetTriangle(const size_t index) const
+	const StaticTree::Triangle& StaticTree::GetBuildTriangle(const size_t index) const
 	{
 		return mTriangles[mTriIdx[index]];
 	}
 
+	const StaticTree::Triangle& StaticTree::GetTriangle(const size_t index) const
+	{
+		return mTriangles[index];
+	}
+
+	size_t StaticTree::GetTriangleId(const size_t index) const
+	{
+		return mTriangleIds.empty() ? index : mTriangleIds[index];
+	}
+
 	void StaticTree::UpdateNodeBoundingBox(size_t nodeIndex)
 	{
 		BVHNode& node = mNodes[nodeIndex];
-		node.box.SetToLimit();
+		BoundingBox box;
 
 		// Update bounds
 		for (size_t t = node.first; t < node.first + node.triCount; ++t)
 		{
-			const Triangle& tri = GetTriangle(t);
-			node.box.IncludePoint(tri.v1);
-			node.box.IncludePoint(tri.v2);
-			node.box.IncludePoint(tri.v3);
+			const Triangle& tri = GetBuildTriangle(t);
+			box.IncludePoint(tri.v1);
+			box.IncludePoint(tri.v2);
+			box.IncludePoint(tri.v3);
 		}
+		node.min = box.min;
+		node.max = box.max;
 	}
 
 
 	void StaticTree::ClearData()
 	{
 		mNodes.clear();
+		mTriangles.clear();
+		mTriangleIds.clear();
+		mNodesUsed = 0;
+		mMeshTriangleCount = 0;
+		mKey = 0;
+		mKeyReady = true;
+		mWideNodes.clear();
+		mWideBinaryNodes.clear();
+		mWindingReady = false;
 	}
 
 
@@ -1,27 +1,96 @@
 #pragma once
-#define BINS_AMT 8
-#define TRI_LIMIT 1
-#define DEBUG 1
+#include <iosfwd>
 
 #include "BoundingBox.h"
 #include "core/GlobalTypes.h"
-#include "../utils/ThreadPool.h"
+#include "math/Ray.h"
+#include "../utils/TaskScheduler.h"
 
 // Adapted from: https://github.com/jbikker/bvh_article/blob/main/quickbuild.cpp
 // Full article explanation: https://jacco.ompf2.com/2022/04/21/how-to-build-a-bvh-part-3-quick-builds/
 // TODO: Make all models load at the same time
 namespace Physics
 {
+	// Closest triangle hit by a ray
+	struct RayHit
+	{
+		// Distance along the ray, in units of the ray direction's length
+		float t;
+		// Index of the triangle in the mesh's index buffer, divided by 3
+		size_t triangle;
+		// Weights of the triangle's second and third vertices
+		glm::vec2 barycentrics;
+	};
+
+	// Point on the mesh surface closest to a query point
+	struct ClosestHit
+	{
+		glm::vec3 point;
+		// Index of the triangle in the mesh's index buffer, divided by 3
+		size_t triangle;
+		float distance;
+	};
+
+	enum class BuildMethod
+	{
+		// Binned surface area heuristic, slower to build but faster to query
+		SAH,
+		// Triangles sorted along a Morton curve, builds much faster for huge meshes
+		LBVH,
+		// SAH with spatial splits, which clip triangles that straddle a split and reference them from both sides
+		// Slowest to build, fastest to query for meshes with long thin triangles
+		SBVH
+	};
+
+	// Settings used to build a StaticTree, different kinds of meshes can have different best settings
+	struct BuildOptions
+	{
+		static constexpr unsigned int MAX_BINS = 64;
+
+		// Split plane candidates per axis, capped at MAX_BINS
+		unsigned int binCount = 8;
+		// Nodes with more triangles are always split
+		unsigned int maxLeafSize = 4;
+		// Cost of visiting a node relative to intersecting a triangle
+		float traversalCost = 1.0f;
+		// LBVH only uses maxLeafSize
+		BuildMethod method = BuildMethod::SAH;
+		// Extra triangle references SBVH may create, as a fraction of the triangle count
+		float spatialSplitBudget = 0.3f;
+	};
+
 	class StaticTree
 	{
+		// Packed into 32 bytes so two nodes share a cache line
 		struct BVHNode
 		{
-			BoundingBox box;
+			glm::vec3 min{};
 			// Either means first triangle or left child, depending if it is a leaf or not
-			size_t first{};
+			uint32_t first{};
+			glm::vec3 max{};
 			// If higher than 0, node is a leaf node
-			size_t triCount{};
+			uint32_t triCount{};
+
+			BoundingBox GetBox() const { return BoundingBox(min, max); }
+		};
+		static_assert(sizeof(BVHNode) == 32, "BVHNode should fit in 32 bytes");
+
+		// Four children of a collapsed node, which are tested against a ray or box all at once
+		// Child boxes are stored per axis and quantized to 8 bits within the node's bounds, rounded outwards
+		struct alignas(64) WideNode
+		{
+			glm::vec3 origin;
+			// Size of one quantization step along each axis
+			glm::vec3 scale;
+			uint8_t childMin[3][4];
+			uint8_t childMax[3][4];
+			// Wide node index, binary leaf index with WIDE_LEAF set, or WIDE_EMPTY for unused slots
+			uint32_t children[4];
 		};
+		static_assert(sizeof(WideNode) == 64, "WideNode should fit in a cache line");
+
+		static constexpr uint32_t WIDE_LEAF = 0x80000000u;
+		static constexpr uint32_t WIDE_EMPTY = UINT32_MAX;
 
 		struct Bin
 		{
@@ -34,9 +103,18 @@ namespace Physics
 			glm::vec3 v1, v2, v3;
 		};
 
+		// Part of a triangle used while building with spatial splits
+		struct Reference
+		{
+			// Bounds of the part of the triangle on this side of every spatial split above it
+			BoundingBox box;
+			uint32_t triangle;
+		};
+
 		// Index positions of triangles, eventually sorted by centroids depending on node
+		// Only used while building, triangles are put in leaf order afterwards
 		std::vector<size_t> mTriIdx;
-		// Vector of all triangle centroids
+		// Vector of all triangle centroids, only used while building
 		std::vector<glm::vec3> mCentroids;
 
 		// Keeps index position of next free node
@@ -45,32 +123,206 @@ namespace Physics
 		// Using this instead of atomic var because left child idx and right child idx should be next to each other
 		std::mutex nodesUsedMutex;
 
-		// Triangle data
+		// Triangle data, in the order the leaves reference them
 		std::vector<Triangle> mTriangles;
+		// Mesh triangle of each entry in mTriangles, only used when spatial splits duplicated triangles
+		std::vector<uint32_t> mTriangleIds;
 
-		// Thread pool for quick computation
-		Utils::ThreadPool mThreadPool;
+		// Triangle of each reference in leaf order while building with spatial splits
+		std::vector<size_t> mReferenceOutput;
+		// Extra references spatial splits can still create
+		std::atomic<size_t> mSpatialBudget{ 0 };
+		float mRootArea = 0.0f;
+		// Triangles in the mesh, which is fewer than mTriangles if any were duplicated
+		size_t mMeshTriangleCount = 0;
+
+		// Binary tree collapsed into a 4 wide tree for traversal, leaves are the binary tree's leaves
+		std::vector<WideNode> mWideNodes;
+		// Binary node each wide node was collapsed from, so refits can requantize wide nodes in place
+		std::vector<uint32_t> mWideBinaryNodes;
+
+		// Dipole approximation of a node's triangles, used for winding numbers
+		struct WindingNode
+		{
+			// Area weighted centroid
+			glm::vec3 center;
+			// Distance from center to the farthest triangle point
+			float radius;
+			// Sum of area weighted normals
+			glm::vec3 normal;
+		};
+
+		// Built on first use, since most trees are never asked for winding numbers
+		mutable std::vector<WindingNode> mWindingNodes;
+		// Whether each entry in mTriangles is counted, only used when spatial splits duplicated triangles
+		mutable std::vector<uint8_t> mWindingOwners;
+		mutable std::atomic<bool> mWindingReady{ false };
+		mutable std::mutex windingMutex;
+
+		BuildOptions mOptions;
+		// Hash of the mesh and options the tree was built from, only valid while mKeyReady is set
+		mutable uint64_t mKey = 0;
+		// Refitting clears this, the refit tree is only hashed if something asks for its key
+		mutable std::atomic<bool> mKeyReady{ true };
+		mutable std::mutex keyMutex;
+		// SAH cost right after the tree was built, relative to the root's surface area
+		float mBuildCost = 0.0f;
 	public:
 		std::vector<BVHNode> mNodes;
 
 		StaticTree() = default;
 
-		void CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices);
+		// Indices are reordered so triangle i of the mesh is triangle i of the tree
+		void CreateStaticTree(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, const BuildOptions& options = {});
+		// Same as CreateStaticTree, but reuses a tree saved in cacheDirectory by an earlier build of the same mesh and options
+		// Newly built trees are saved there
+		void CreateStaticTree(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, const std::string& cacheDirectory, const BuildOptions& options = {});
 
-		std::vector<BoundingBox> QueryTree(const StaticTree& other);
+		// Builds the tree with several candidate options and keeps the one that answers sampleRays fastest
+		// Rays are in the mesh's local space, if none are given they're generated around the mesh
+		// Returns the options that were picked
+		BuildOptions Autotune(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, std::vector<Ray> sampleRays = {});
+		const BuildOptions& GetBuildOptions() const { return mOptions; }
+
+		// Saves the tree and the indices reordered by its build, in the same format as cache files
+		// Key is what Read checks against, usually GetKey()
+		bool Write(std::ostream& os, uint64_t key, const std::vector<unsigned>& indices) const;
+		// Loads a tree saved by Write, returns false if it was saved with another key or is truncated or corrupt
+		// Indices has to hold as many indices as the mesh has, they're replaced with the saved ones
+		bool Read(std::istream& is, uint64_t key, std::vector<unsigned>& indices, const BuildOptions& options = {});
+
+		// Identifies a mesh's positions and triangles together with the options its tree is built with
+		// Triangle order doesn't change it, so a mesh whose indices a build reordered keeps its key
+		static uint64_t HashMesh(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices, const BuildOptions& options);
+		// HashMesh of the mesh the tree was built from, 0 if the tree is empty
+		// A refit tree gets a key hashed from its refit triangles instead, the first time it's asked for
+		uint64_t GetKey() const;
+
+		// Updates the tree for moved vertices while keeping its topology, indices have to be the ones reordered by the build
+		// If the tree's SAH cost grew more than maxCostGrowth times since it was built, it's rebuilt instead, which reorders indices
+		// Returns true if the tree was rebuilt
+		bool Refit(const std::vector<MeshPt>& vertices, std::vector<unsigned>& indices, float maxCostGrowth = 1.5f);
+
+		// Returns pairs of intersecting triangles between this mesh and another, as indices into each mesh's index buffer divided by 3
+		// Model matrices place each mesh in the world
+		std::vector<std::pair<size_t, size_t>> QueryTree(const StaticTree& other, const glm::mat4& modelMat, const glm::mat4& otherModelMat) const;
 		std::vector<BoundingBox> QueryTree(const BoundingBox& box);
 
+		// Returns the closest triangle hit closer than tMax, ray has to be in the mesh's local space
+		std::pair<RayHit, bool> Raycast(const Ray& ray, float tMax = FLT_MAX) const;
+		// Returns triangles whose bounds overlap box, box has to be in the mesh's local space, in no particular order
+		std::vector<size_t> QueryTriangles(const BoundingBox& box) const;
+		// Returns every triangle hit closer than tMax, closest first
+		std::vector<RayHit> RaycastAll(const Ray& ray, float tMax = FLT_MAX) const;
+
+		// Generalized winding number of the mesh around point, about 1 inside and 0 outside even if the mesh has holes
+		// Inside is -1 instead for meshes wound inside out
+		// Distant nodes are approximated by their dipole once farther than accuracy times their radius, higher is more exact
+		float WindingNumber(const glm::vec3& point, float accuracy = 2.0f) const;
+		// Same as WindingNumber for each of count points, queries are split across threads
+		std::vector<float> WindingNumbers(const glm::vec3* points, size_t count, float accuracy = 2.0f) const;
+		std::vector<float> WindingNumbers(const std::vector<glm::vec3>& points, float accuracy = 2.0f) const;
+		// True if the winding number around point is at least one half, whichever way the mesh is wound
+		bool Contains(const glm::vec3& point) const;
+
+		// Returns the closest point on the mesh within maxDistance, point has to be in the mesh's local space
+		std::pair<ClosestHit, bool> ClosestPoint(const glm::vec3& point, float maxDistance = FLT_MAX) const;
+		// Same as ClosestPoint for each of count points, queries are split across threads
+		std::vector<std::pair<ClosestHit, bool>> ClosestPoints(const glm::vec3* points, size_t count, float maxDistance = FLT_MAX) const;
+		std::vector<std::pair<ClosestHit, bool>> ClosestPoints(const std::vector<glm::vec3>& points, float maxDistance = FLT_MAX) const;
+
+		// Bytes used by the tree and its copy of the triangles
+		size_t GetMemoryUsage() const;
+		// Bounds of the whole mesh in its local space
+		BoundingBox GetBounds() const;
 		std::vector<BoundingBox> GetBoxes(bool onlyLeaf = true) const;
 		std::vector<BoundingBox> GetBoxes(const glm::mat4& modelMat, bool onlyLeaf = true) const;
 
 	private:
-		
+		// Changing how trees are built or stored has to bump this, so old cache files are rebuilt
+		static constexpr uint32_t CACHE_VERSION = 4;
+
+		// Written at the start of cache files
+		struct CacheHeader
+		{
+			char magic[4];
+			uint32_t version;
+			// Hash of the mesh and build settings the tree was built from
+			uint64_t key;
+			uint64_t nodeCount;
+			uint64_t triangleCount;
+			uint64_t triangleIdCount;
+			uint64_t indexCount;
+		};
+
+		// Returns false if the file doesn't exist or doesn't match the key
+		bool ReadCache(const std::string& filepath, uint64_t key, std::vector<unsigned>& indices, const BuildOptions& options);
+		void WriteCache(const std::string& filepath, uint64_t key, const std::vector<unsigned>& indices) const;
+		// Checks every node points inside the node and triangle arrays, for trees loaded from a file
+		bool IsValid() const;
+		// Sum of a hash of each triangle's indices, the same for any order of the triangles
+		static uint64_t HashTriangles(const std::vector<unsigned>& indices);
+
 		void Subdivide(size_t nodeIndex);
 
+		// Subdivide with spatial splits, references are owned by the node until it's split
+		void SubdivideSpatial(size_t nodeIndex, std::vector<Reference> references);
+		float FindObjectSplit(const std::vector<Reference>& references, uint8_t& axis, float& splitPos, BoundingBox& leftBox, BoundingBox& rightBox) const;
+		float FindSpatialSplit(const std::vector<Reference>& references, const BoundingBox& nodeBox, uint8_t& axis, float& splitPos) const;
+		// Returns the bounds of the part of the triangle inside the box, which can be empty
+		BoundingBox ClipTriangle(uint32_t triangle, const BoundingBox& box) const;
+
+		// Sorts triangles by the Morton codes of their centroids and splits where the codes' highest differing bit changes
+		// Code is uint32_t for 30-bit codes or uint64_t for 63-bit codes
+		template <typename Code>
+		void BuildLinear();
+		template <typename Code>
+		void SubdivideLinear(size_t nodeIndex, const std::vector<Code>& codes);
+		// Interleaves coordinates in [0, 1] into a Morton code
+		static uint32_t MortonCode30(const glm::vec3& position);
+		static uint64_t MortonCode63(const glm::vec3& position);
+		// Builds winding nodes if the tree changed since they were last built
+		void PrepareWinding() const;
+		// Fills in winding nodes of the node's subtree, returns the subtree's triangle area
+		float BuildWindingNode(size_t nodeIndex) const;
+
+		// Recomputes bounds of the node's subtree from its triangles, returns the subtree's SAH cost
+		float RefitNode(size_t nodeIndex, unsigned int depth);
+		// SAH cost of the whole tree relative to the root's surface area
+		// Leaf boxes are taken around whole triangles, like a refit does, rather than the clipped references of a spatial split build
+		float ComputeCost() const;
+		// Returns the SAH cost of the node's subtree, and its bounds around whole triangles in box
+		float ComputeNodeCost(size_t nodeIndex, BoundingBox& box) const;
+
+		// Builds the wide tree from the binary one, has to be called whenever binary nodes change
+		void Collapse();
+		// Collapses the binary node's subtree, returns the index of its wide node
+		uint32_t CollapseNode(size_t nodeIndex);
+		// Quantizes the binary children's boxes within the binary node's bounds
+		void QuantizeWideNode(WideNode& wide, size_t nodeIndex, const size_t (&children)[4], unsigned int childCount) const;
+		// Requantizes every wide node from the refit binary nodes, keeping the wide tree's topology
+		void RefitWide();
+		std::pair<RayHit, bool> RaycastWide(const Ray& ray, float tMax) const;
+		// Returns a bit per child the ray enters before tMax, with entry distances in tEntry
+		static unsigned int IntersectChildren(const WideNode& node, const Ray& ray, float tMax, float (&tEntry)[4]);
+		// Returns a bit per child whose box overlaps box
+		static unsigned int OverlapChildren(const WideNode& node, const BoundingBox& box);
+
+		// Nodes are visited closest first, stack holds squared distance and index of nodes still to visit
+		// Passed in so batched queries reuse its memory
+		std::pair<ClosestHit, bool> ClosestPoint(const glm::vec3& point, float maxDistance, std::vector<std::pair<float, uint32_t>>& stack) const;
+		// Squared distance from point to the node's bounds
+		float NodeDistanceSquared(size_t nodeIndex, const glm::vec3& point) const;
+
 		float FindBestSplitPlane(size_t nodeIndex, uint8_t& axis, float& splitPos);
 
+		// Only valid while building
 		glm::vec3 GetCentroid(size_t index) const;
+		const Triangle& GetBuildTriangle(size_t index) const;
+
 		const Triangle& GetTriangle(size_t index) const;
+		// Index of the mesh triangle stored at index
+		size_t GetTriangleId(size_t index) const;
 
 		void UpdateNodeBoundingBox(size_t nodeIndex);
 		void ClearData();
@@ -9,7 +9,7 @@
 #include "../renderer/VAO.h"
 
 #include "../math/mesh/MeshImport.h"
-#include "../physics/StaticTree.h"
+#include "../physics/InstanceTree.h"
 #include "../utils/Timer.h"
 
 #include "Renderable.h"
@@ -20,7 +20,8 @@ public:
 	std::vector<MeshPt> vertices;
 	std::vector<unsigned int> indices;
 
-	Physics::StaticTree mTree{};
+	// Shared with every other mesh loaded from the same data, unless InitTree was asked for a tree of its own
+	std::shared_ptr<Physics::StaticTree> mTree;
 
 	// Initializes the object
 	Mesh(const char* filename, bool is_stl);
@@ -28,12 +29,24 @@ public:
 	explicit Mesh(const MeshData& data);
 
 	BoundingBox CalcBoundingBox();
-	void InitTree();
+	// Meshes that deform need a tree of their own, refitting a shared tree would move every mesh sharing it
+	// Trees are only cached on disk when given a cache directory, e.g. BASE_DIR + "/res/cache/bvh/"
+	void InitTree(const Physics::BuildOptions& options = {}, bool shared = true, const std::string& cacheDirectory = "");
+	// Updates the tree after vertices were moved, InitTree has to be called first without sharing the tree
+	void RefitTree();
+
+	// Returns the closest triangle hit by a world space ray, InitTree has to be called first
+	// Hit distance is in the same units as the world space ray
+	std::pair<Physics::RayHit, bool> Raycast(const Ray& ray, float tMax = FLT_MAX);
 
 	void AddRigidbody();
 
 private:
+	bool mTreeShared = false;
+
 	void InitVAO() override;
+	// Replaces the indices in the VAO's element buffer, after a tree build reordered them
+	void UploadIndices();
 	size_t GetSize() override;
 };
 
@@ -90,12 +103,59 @@ inline BoundingBox Mesh::CalcBoundingBox()
 			box.min[i] = std::min(box.min[i], point[i]);
 		}
 	}
+	box.UpdateSurfaceArea();
 	return box;
 }
 
-inline void Mesh::InitTree()
+inline void Mesh::InitTree(const Physics::BuildOptions& options, const bool shared, const std::string& cacheDirectory)
 {
-	mTree.CreateStaticTree(vertices, indices);
+	// Reorders indices to match the tree's triangles, which only changes the order triangles are drawn in
+	mTreeShared = shared;
+	if (shared)
+		mTree = Physics::TreeLibrary::GetInstance().Acquire(vertices, indices, cacheDirectory, options);
+	else
+	{
+		mTree = std::make_shared<Physics::StaticTree>();
+		if (cacheDirectory.empty())
+			mTree->CreateStaticTree(vertices, indices, options);
+		else
+			mTree->CreateStaticTree(vertices, indices, cacheDirectory, options);
+	}
+
+	// Triangle ids the tree returns have to index the drawn triangles too
+	UploadIndices();
+}
+
+
+inline void Mesh::RefitTree()
+{
+	if (!mTree)
+	{
+		LOG(LOG_ERROR) << "Can't refit a mesh without a tree.\n";
+		return;
+	}
+	if (mTreeShared)
+	{
+		LOG(LOG_WARNING) << "Can't refit a shared tree, call InitTree without sharing it first.\n";
+		return;
+	}
+	// Refitting keeps the order, rebuilding reorders indices again
+	if (mTree->Refit(vertices, indices))
+		UploadIndices();
+}
+
+
+inline std::pair<Physics::RayHit, bool> Mesh::Raycast(const Ray& ray, const float tMax)
+{
+	if (!mTree) return std::make_pair(Physics::RayHit{ tMax, 0, glm::vec2(0.0f) }, false);
+
+	transform.CalculateModelMat();
+	const glm::mat4 inverseModel = glm::inverse(transform.modelMat);
+
+	// Direction isn't normalized, so distances along the local ray match the world ray
+	const Ray localRay(glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f)),
+	                   glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f)));
+	return mTree->Raycast(localRay, tMax);
 }
 
 
@@ -114,6 +174,14 @@ inline void Mesh::InitVAO()
 	EBO::Unbind();
 }
 
+inline void Mesh::UploadIndices()
+{
+	// The element buffer is part of the VAO's state, binding the VAO binds it too
+	mVAO.Bind();
+	GL_FCHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data()));
+	VAO::Unbind();
+}
+
 inline size_t Mesh::GetSize()
 {
 	return indices.size();
@@ -8,7 +8,7 @@
 #include <fstream>
 #include <iostream>
 #include <cerrno>
-#include <utils/Logger.h>
+#include <utils/GLError.h>
 
 #include "../core/GlobalTypes.h"
 
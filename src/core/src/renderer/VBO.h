@@ -1,6 +1,7 @@
 #pragma once
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <utils/GLError.h>
 
 #include <glm/glm.hpp>
 
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+// Parallel least significant digit radix sort
+// Keys are sorted together with a value per key, equal keys keep their order
+namespace Utils
+{
+    template <typename Key, typename Value>
+    void RadixSort(std::vector<Key>& keys, std::vector<Value>& values)
+    {
+        static_assert(std::is_unsigned<Key>::value, "Radix sort keys have to be unsigned integers");
+
+        constexpr unsigned int DIGIT_BITS = 8;
+        constexpr size_t BUCKET_COUNT = size_t{ 1 } << DIGIT_BITS;
+        // Below this, splitting the work costs more than it saves
+        constexpr size_t MIN_CHUNK_SIZE = 16384;
+
+        const size_t count = keys.size();
+        if (count < 2) return;
+
+        TaskScheduler& scheduler = TaskScheduler::GetInstance();
+        const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(scheduler.ThreadCount() * 4, count / MIN_CHUNK_SIZE));
+        const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+        std::vector<Key> keysOut(count);
+        std::vector<Value> valuesOut(count);
+        // Bucket counts of each chunk, later turned into the chunk's write positions
+        std::vector<size_t> offsets(chunkCount * BUCKET_COUNT);
+
+        for (unsigned int shift = 0; shift < sizeof(Key) * 8; shift += DIGIT_BITS)
+        {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            scheduler.ParallelFor(0, chunkCount, 1, [&](const size_t chunkBegin, const size_t chunkEnd)
+            {
+                for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+                {
+                    size_t* histogram = &offsets[chunk * BUCKET_COUNT];
+                    const size_t end = std::min(count, (chunk + 1) * chunkSize);
+                    for (size_t i = chunk * chunkSize; i < end; i++)
+                        ++histogram[(keys[i] >> shift) & (BUCKET_COUNT - 1)];
+                }
+            });
+
+            // Every key has the same digit, nothing moves
+            bool sorted = false;
+            for (size_t bucket = 0; bucket < BUCKET_COUNT && !sorted; bucket++)
+            {
+                size_t bucketTotal = 0;
+                for (size_t chunk = 0; chunk < chunkCount; chunk++)
+                    bucketTotal += offsets[chunk * BUCKET_COUNT + bucket];
+                sorted = bucketTotal == count;
+            }
+            if (sorted) continue;
+
+            // Buckets are laid out in order, and within a bucket chunks are laid out in order
+            size_t position = 0;
+            for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+            {
+                for (size_t chunk = 0; chunk < chunkCount; chunk++)
+                {
+                    const size_t bucketCount = offsets[chunk * BUCKET_COUNT + bucket];
+                    offsets[chunk * BUCKET_COUNT + bucket] = position;
+                    position += bucketCount;
+                }
+            }
+
+            scheduler.ParallelFor(0, chunkCount, 1, [&](const size_t chunkBegin, const size_t chunkEnd)
+            {
+                for (size_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+                {
+                    size_t* writePositions = &offsets[chunk * BUCKET_COUNT];
+                    const size_t end = std::min(count, (chunk + 1) * chunkSize);
+                    for (size_t i = chunk * chunkSize; i < end; i++)
+                    {
+                        const size_t destination = writePositions[(keys[i] >> shift) & (BUCKET_COUNT - 1)]++;
+                        keysOut[destination] = keys[i];
+                        valuesOut[destination] = values[i];
+                    }
+                }
+            });
+
+            keys.swap(keysOut);
+            values.swap(valuesOut);
+        }
+    }
+}
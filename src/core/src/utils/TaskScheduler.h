@@ -0,0 +1,231 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../utils/Logger.h"
+
+// Shared worker threads for fork-join parallelism
+// Threads are started once and reused, and a thread waiting on its tasks runs queued tasks instead of spinning
+namespace Utils
+{
+    class TaskScheduler;
+
+    // Set of tasks that can be waited on together
+    // Tasks may create their own groups, nested waits keep running other queued tasks
+    class TaskGroup
+    {
+    public:
+        explicit TaskGroup(TaskScheduler& scheduler);
+        TaskGroup();
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        // Queues a task to be run by any thread
+        void Run(std::function<void()> task);
+
+        // Returns once every task in the group has finished
+        void Wait();
+
+    private:
+        friend class TaskScheduler;
+
+        TaskScheduler& mScheduler;
+        // Tasks queued or running
+        std::atomic<size_t> mPending{ 0 };
+    };
+
+    class TaskScheduler
+    {
+    public:
+        TaskScheduler(const TaskScheduler&) = delete;
+        void operator=(const TaskScheduler&) = delete;
+
+        ~TaskScheduler();
+
+        static TaskScheduler& GetInstance()
+        {
+            static TaskScheduler instance;
+            return instance;
+        }
+
+        // Worker threads plus the calling thread
+        unsigned int ThreadCount() const { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+        // Splits [begin, end) into chunks of at least grainSize and runs func(chunkBegin, chunkEnd) on each
+        template <typename Func>
+        void ParallelFor(size_t begin, size_t end, size_t grainSize, Func func);
+
+    private:
+        friend class TaskGroup;
+
+        struct Task
+        {
+            std::function<void()> func;
+            TaskGroup* group;
+        };
+
+        // Ensures queue is only read and modified by one thread at a time
+        std::mutex queueMutex;
+        // Queue of tasks
+        std::deque<Task> mTasks;
+
+        // Wakes workers when tasks are queued and waiters when a group finishes
+        std::condition_variable activateCondition;
+
+        // Tells threads whether to terminate themselves
+        bool shouldTerminate = false;
+
+        std::vector<std::thread> mThreads;
+
+        TaskScheduler();
+
+        void Push(Task task);
+
+        // Runs queued tasks until told to terminate
+        void ThreadLoop();
+
+        // Runs a task and marks it finished in its group
+        void Execute(Task& task);
+
+        // Runs queued tasks on the calling thread until the group has finished
+        void Wait(TaskGroup& group);
+    };
+
+    inline TaskGroup::TaskGroup(TaskScheduler& scheduler): mScheduler(scheduler) {}
+
+    inline TaskGroup::TaskGroup(): mScheduler(TaskScheduler::GetInstance()) {}
+
+    inline TaskGroup::~TaskGroup()
+    {
+        Wait();
+    }
+
+    inline void TaskGroup::Run(std::function<void()> task)
+    {
+        ++mPending;
+        mScheduler.Push(TaskScheduler::Task{ std::move(task), this });
+    }
+
+    inline void TaskGroup::Wait()
+    {
+        mScheduler.Wait(*this);
+    }
+
+    inline TaskScheduler::TaskScheduler()
+    {
+        // The thread waiting on a group does work as well, so one less worker is needed
+        const unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 2u);
+        const unsigned int workerCount = hardwareThreads - 1;
+
+        LOG(LOG_INFO) << "Starting task scheduler with " << workerCount << " worker threads.\n";
+
+        mThreads.reserve(workerCount);
+        for (unsigned int i = 0; i < workerCount; i++)
+            mThreads.emplace_back(&TaskScheduler::ThreadLoop, this);
+    }
+
+    inline TaskScheduler::~TaskScheduler()
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            shouldTerminate = true;
+        }
+        activateCondition.notify_all();
+
+        for (std::thread& thread : mThreads)
+            thread.join();
+    }
+
+    template <typename Func>
+    void TaskScheduler::ParallelFor(const size_t begin, const size_t end, size_t grainSize, Func func)
+    {
+        if (begin >= end) return;
+
+        // Enough chunks to balance load across threads without making them tiny
+        grainSize = std::max(grainSize, (end - begin + ThreadCount() * 4 - 1) / (ThreadCount() * 4));
+        if (end - begin <= grainSize)
+        {
+            func(begin, end);
+            return;
+        }
+
+        TaskGroup group(*this);
+        size_t chunkBegin = begin;
+        for (; chunkBegin + grainSize < end; chunkBegin += grainSize)
+        {
+            const size_t chunkEnd = chunkBegin + grainSize;
+            group.Run([&func, chunkBegin, chunkEnd] { func(chunkBegin, chunkEnd); });
+        }
+        // Last chunk runs on the calling thread
+        func(chunkBegin, end);
+        group.Wait();
+    }
+
+    inline void TaskScheduler::Push(Task task)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            mTasks.emplace_back(std::move(task));
+        }
+        // Wake up a thread
+        activateCondition.notify_one();
+    }
+
+    inline void TaskScheduler::ThreadLoop()
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                // Waits until there is a task or it should terminate itself
+                activateCondition.wait(lock, [this] { return !mTasks.empty() || shouldTerminate; });
+                if (shouldTerminate)
+                    return;
+
+                task = std::move(mTasks.front());
+                mTasks.pop_front();
+            }
+            Execute(task);
+        }
+    }
+
+    inline void TaskScheduler::Execute(Task& task)
+    {
+        task.func();
+
+        // Last task in the group, wake up whoever is waiting on it
+        if (task.group->mPending.fetch_sub(1) == 1)
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            activateCondition.notify_all();
+        }
+    }
+
+    inline void TaskScheduler::Wait(TaskGroup& group)
+    {
+        while (group.mPending != 0)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                activateCondition.wait(lock, [this, &group] { return !mTasks.empty() || group.mPending == 0; });
+                if (group.mPending == 0)
+                    return;
+
+                // Newest task first, which is most likely to belong to this group and be in cache
+                task = std::move(mTasks.back());
+                mTasks.pop_back();
+            }
+            Execute(task);
+        }
+    }
+}
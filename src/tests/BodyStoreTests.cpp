@@ -0,0 +1,74 @@
+#include "Test.h"
+
+#include <cmath>
+#include <random>
+
+#include "physics/BodyStore.h"
+
+using namespace Physics;
+
+namespace
+{
+	// Same bodies every time, with a count that leaves a tail after the 8 wide AVX2 loop
+	void FillStore(BodyStore& store)
+	{
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		const auto vector = [&] { return glm::vec3(unit(random), unit(random), unit(random)); };
+		for (unsigned int i = 0; i < 1003; i++)
+		{
+			const glm::quat orientation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+			store.Add(vector() * 10.0f, orientation, vector() * 3.0f, vector() * 5.0f, vector() * 20.0f, 1.5f + unit(random));
+		}
+	}
+
+	bool Near(const float a, const float b)
+	{
+		return std::abs(a - b) <= 1e-5f * std::max(1.0f, std::abs(a));
+	}
+
+	bool Near(const BodyStore::Vectors& a, const BodyStore::Vectors& b, const size_t i)
+	{
+		return Near(a.x[i], b.x[i]) && Near(a.y[i], b.y[i]) && Near(a.z[i], b.z[i]);
+	}
+}
+
+TEST(SimdIntegrationMatchesScalar)
+{
+	const BodyStore::Kernel kernels[] = { BodyStore::Kernel::SSE2, BodyStore::Kernel::AVX2 };
+	for (const BodyStore::Kernel kernel : kernels)
+	{
+		// Nothing to compare on CPUs without this instruction set
+		if (kernel > BodyStore::GetSupportedKernel()) continue;
+
+		BodyStore scalar, simd;
+		FillStore(scalar);
+		FillStore(simd);
+		CHECK(scalar.SetKernel(BodyStore::Kernel::SCALAR) == BodyStore::Kernel::SCALAR);
+		CHECK(simd.SetKernel(kernel) == kernel);
+
+		const float dt = 1.0f / 60.0f;
+		const glm::vec3 gravity(0.0f, -9.81f, 0.0f);
+		for (unsigned int step = 0; step < 120; step++)
+		{
+			scalar.IntegrateVelocities(dt, gravity, 0.999f);
+			simd.IntegrateVelocities(dt, gravity, 0.999f);
+			scalar.IntegratePositions(dt);
+			simd.IntegratePositions(dt);
+		}
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < scalar.Size(); i++)
+		{
+			const bool same = Near(scalar.positions, simd.positions, i) && Near(scalar.previousPositions, simd.previousPositions, i)
+				&& Near(scalar.linearVelocities, simd.linearVelocities, i) && Near(scalar.angularVelocities, simd.angularVelocities, i)
+				&& Near(scalar.forces, simd.forces, i)
+				&& Near(scalar.orientationW[i], simd.orientationW[i]) && Near(scalar.orientationX[i], simd.orientationX[i])
+				&& Near(scalar.orientationY[i], simd.orientationY[i]) && Near(scalar.orientationZ[i], simd.orientationZ[i]);
+			mismatches += !same;
+		}
+		CHECK(mismatches == 0);
+		if (mismatches > 0)
+			std::printf("%zu of %zu bodies differ between the %s and scalar kernels\n", mismatches, scalar.Size(), simd.GetKernelName());
+	}
+}
@@ -0,0 +1,108 @@
+#include "Test.h"
+
+#include <cmath>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "physics/Narrowphase.h"
+
+using namespace Physics;
+
+namespace
+{
+	// Corners of a cube with half extents of 1, scaled into boxes when used as a hull
+	const glm::vec3 CUBE_POINTS[] = {
+		{ -1, -1, -1 }, { 1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 },
+		{ -1, -1, 1 }, { 1, -1, 1 }, { -1, 1, 1 }, { 1, 1, 1 }
+	};
+
+	ConvexShape MakeBox(const glm::vec3& position, const glm::vec3& halfExtents, const glm::quat& orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f))
+	{
+		ConvexShape shape;
+		shape.type = ShapeType::BOX;
+		shape.halfExtents = halfExtents;
+		shape.position = position;
+		shape.rotation = glm::mat3_cast(orientation);
+		return shape;
+	}
+
+	// Same box as a point cloud, so it goes through GJK and EPA
+	ConvexShape MakeHull(const glm::vec3& position, const glm::vec3& halfExtents, const glm::quat& orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f))
+	{
+		ConvexShape shape = MakeBox(position, halfExtents, orientation);
+		shape.type = ShapeType::HULL;
+		shape.points = CUBE_POINTS;
+		shape.pointCount = 8;
+		shape.scale = halfExtents;
+		return shape;
+	}
+}
+
+TEST(RestingBoxHasFourContacts)
+{
+	const ConvexShape ground = MakeBox(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(5.0f, 1.0f, 5.0f));
+	// Sunk 1cm into the ground and turned, so its edges don't line up with the ground's
+	const ConvexShape box = MakeBox(glm::vec3(0.3f, 0.49f, 0.2f), glm::vec3(0.5f), glm::angleAxis(0.3f, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	ContactManifold manifold{};
+	CHECK(CollideBoxes(ground, box, manifold));
+	CHECK(manifold.pointCount == 4);
+	CHECK(glm::dot(manifold.normal, glm::vec3(0.0f, 1.0f, 0.0f)) > 0.999f);
+	for (unsigned int i = 0; i < manifold.pointCount; i++)
+		CHECK(std::abs(manifold.points[i].depth - 0.01f) < 1e-4f);
+}
+
+TEST(NarrowphaseKeepsRestingBoxContacts)
+{
+	std::unordered_map<Entity, ConvexShape> shapes;
+	shapes[1] = MakeBox(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(5.0f, 1.0f, 5.0f));
+	shapes[2] = MakeBox(glm::vec3(0.0f, 0.49f, 0.0f), glm::vec3(0.5f));
+
+	Narrowphase narrowphase;
+	for (unsigned int update = 0; update < 3; update++)
+	{
+		narrowphase.Update({ 2, 1 }, shapes);
+		CHECK(narrowphase.GetManifolds().size() == 1);
+		if (narrowphase.GetManifolds().empty()) return;
+
+		// Pairs are ordered by entity, so the normal points from the ground up to the box
+		const ContactManifold& manifold = narrowphase.GetManifolds()[0];
+		CHECK(manifold.a == 1 && manifold.b == 2);
+		CHECK(manifold.pointCount == 4);
+		CHECK(manifold.normal.y > 0.999f);
+	}
+}
+
+TEST(ConvexDepthMatchesOverlap)
+{
+	// Overlaps by 0.1 along x and 0.9 along y, so x is the shallowest way out
+	{
+		const ConvexShape a = MakeHull(glm::vec3(0.0f), glm::vec3(0.5f));
+		const ConvexShape b = MakeHull(glm::vec3(0.9f, 0.1f, 0.0f), glm::vec3(0.5f));
+		ContactManifold manifold{};
+		CHECK(CollideConvex(a, b, manifold));
+		CHECK(manifold.pointCount == 1);
+		CHECK(std::abs(manifold.points[0].depth - 0.1f) < 1e-3f);
+		CHECK(glm::dot(manifold.normal, glm::vec3(1.0f, 0.0f, 0.0f)) > 0.999f);
+	}
+
+	// Box standing on an edge, 5cm into the top face of the one below
+	{
+		const float edgeHeight = 0.5f * std::sqrt(2.0f);
+		const ConvexShape a = MakeHull(glm::vec3(0.0f), glm::vec3(0.5f));
+		const ConvexShape b = MakeHull(glm::vec3(0.0f, 0.5f + edgeHeight - 0.05f, 0.0f), glm::vec3(0.5f),
+		                               glm::angleAxis(glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+		ContactManifold manifold{};
+		CHECK(CollideConvex(a, b, manifold));
+		CHECK(std::abs(manifold.points[0].depth - 0.05f) < 1e-3f);
+		CHECK(glm::dot(manifold.normal, glm::vec3(0.0f, 1.0f, 0.0f)) > 0.999f);
+	}
+
+	// Hulls apart by 0.2 along x
+	{
+		const ConvexShape a = MakeHull(glm::vec3(0.0f), glm::vec3(0.5f));
+		const ConvexShape b = MakeHull(glm::vec3(1.2f, 0.0f, 0.0f), glm::vec3(0.5f));
+		ContactManifold manifold{};
+		CHECK(!CollideConvex(a, b, manifold));
+	}
+}
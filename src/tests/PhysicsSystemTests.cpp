@@ -0,0 +1,71 @@
+#include "Test.h"
+
+#include <algorithm>
+
+#include "components/Components.h"
+#include "core/World.h"
+#include "physics/PhysicsSystem.h"
+
+extern World world;
+
+TEST(StackComesToRestAndSleeps)
+{
+	world.RegisterComponent<Components::Transform>();
+	world.RegisterComponent<Components::Rigidbody>();
+	const auto physicsSystem = world.RegisterSystem<PhysicsSystem>();
+	Signature signature;
+	signature.set(world.GetComponentType<Components::Transform>());
+	signature.set(world.GetComponentType<Components::Rigidbody>());
+	world.SetSystemSignature<PhysicsSystem>(signature);
+
+	const Entity ground = world.CreateEntity();
+	Components::Transform groundTransform{};
+	groundTransform.worldPos = glm::vec3(0.0f, -0.5f, 0.0f);
+	world.AddComponent(ground, groundTransform);
+	physicsSystem->BuildTree({ { ground, BoundingBox(glm::vec3(-10.0f, -1.0f, -10.0f), glm::vec3(10.0f, 0.0f, 10.0f)) } }, Physics::BodyType::STATIC);
+	physicsSystem->AddBoxCollider(ground, glm::vec3(10.0f, 0.5f, 10.0f));
+
+	// Four unit boxes stacked just touching each other and the ground
+	constexpr unsigned int STACK_HEIGHT = 4;
+	std::vector<Entity> boxes;
+	std::vector<std::pair<Entity, BoundingBox>> proxies;
+	for (unsigned int i = 0; i < STACK_HEIGHT; i++)
+	{
+		const Entity box = world.CreateEntity();
+		Components::Transform transform{};
+		transform.worldPos = glm::vec3(0.0f, 0.5f + static_cast<float>(i), 0.0f);
+		world.AddComponent(box, transform);
+
+		Components::Rigidbody rigidbody{};
+		rigidbody.position = transform.worldPos;
+		rigidbody.previousPosition = rigidbody.position;
+		world.AddComponent(box, rigidbody);
+
+		physicsSystem->AddBoxCollider(box, glm::vec3(0.5f));
+		proxies.emplace_back(box, BoundingBox(transform.worldPos - 0.5f, transform.worldPos + 0.5f));
+		boxes.push_back(box);
+	}
+	physicsSystem->BuildTree(proxies, Physics::BodyType::DYNAMIC);
+	CHECK(physicsSystem->GetAwakeBodyCount() == STACK_HEIGHT);
+
+	// Ten seconds is far longer than settling and TIME_TO_SLEEP take
+	const unsigned int maxSteps = static_cast<unsigned int>(10.0f / physicsSystem->GetFixedStep());
+	unsigned int steps = 0;
+	while (steps < maxSteps && physicsSystem->GetAwakeBodyCount() > 0)
+	{
+		physicsSystem->Update(physicsSystem->GetFixedStep());
+		steps++;
+	}
+	CHECK(physicsSystem->GetAwakeBodyCount() == 0);
+
+	// Resting boxes only sink by the solver's allowed penetration, and don't slide off each other
+	float drift = 0.0f;
+	for (unsigned int i = 0; i < STACK_HEIGHT; i++)
+	{
+		CHECK(world.GetComponent<Components::Rigidbody>(boxes[i]).sleeping);
+		const glm::vec3 start(0.0f, 0.5f + static_cast<float>(i), 0.0f);
+		drift = std::max(drift, glm::length(world.GetComponent<Components::Transform>(boxes[i]).worldPos - start));
+	}
+	CHECK(drift < 0.05f);
+	std::printf("Stack fell asleep after %u steps, moving at most %.4f\n", steps, drift);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+// Minimal test registry, so the tests don't need a framework
+// TEST registers a function before main runs, CHECK reports a failed condition and carries on
+namespace Tests
+{
+	struct Test
+	{
+		const char* name;
+		void (*function)();
+	};
+
+	inline std::vector<Test>& GetTests()
+	{
+		static std::vector<Test> tests;
+		return tests;
+	}
+
+	inline unsigned int& GetFailureCount()
+	{
+		static unsigned int failures = 0;
+		return failures;
+	}
+
+	inline bool Register(const char* name, void (*function)())
+	{
+		GetTests().push_back({ name, function });
+		return true;
+	}
+
+	inline void Check(const bool passed, const char* condition, const char* file, const int line)
+	{
+		if (passed) return;
+		GetFailureCount()++;
+		std::printf("%s:%d: check failed: %s\n", file, line, condition);
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static const bool name##Registered = Tests::Register(#name, name); \
+	static void name()
+
+#define CHECK(condition) Tests::Check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
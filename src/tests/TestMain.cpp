@@ -0,0 +1,19 @@
+#include "Test.h"
+
+#include "core/World.h"
+
+// Systems look up components in the global world, the same as in the app
+World world("tests_log.txt");
+
+int main()
+{
+	for (const Tests::Test& test : Tests::GetTests())
+	{
+		const unsigned int failures = Tests::GetFailureCount();
+		test.function();
+		std::printf("%s %s\n", Tests::GetFailureCount() == failures ? "PASS" : "FAIL", test.name);
+	}
+
+	std::printf("%zu tests, %u failed checks\n", Tests::GetTests().size(), Tests::GetFailureCount());
+	return Tests::GetFailureCount() == 0 ? 0 : 1;
+}